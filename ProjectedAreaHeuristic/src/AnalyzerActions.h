@@ -62,9 +62,9 @@ namespace pah::analyzerActions {
 		static void pah(float& totalPah, ANALYZER_ACTION_PER_NODE_ARGUMENTS) {
 			if (bvh.getInfluenceArea() == nullptr) return; //it means it is a SAH BVH
 			//TODO float fullProjectionArea = bvh.getInfluenceArea()->getProjectedArea(bvh.getRoot().aabb);
-			float fullProjectionArea = bvh.getInfluenceArea()->getProjectionPlaneArea();
+			float fullProjectionArea = bvh.getNodesInfluenceArea()->getProjectionPlaneArea();
 			
-			auto [pah, hitProb, pa] = PAH_STRATEGY(node, bvh.getInfluenceArea(), fullProjectionArea);
+			auto [pah, hitProb, pa] = PAH_STRATEGY(node, bvh.getNodesInfluenceArea(), fullProjectionArea);
 
 			//add to JSON
 			localLog["metrics"]["pah"] = pah;
@@ -75,6 +75,23 @@ namespace pah::analyzerActions {
 			else { totalPah += hitProb * NODE_COST * 2.0f; } //if a node is internal, its cost is: hitProbability * (costNode * 2) where 2 is the number of children we now must visit
 		}
 
+		/**
+		 * @brief Calculates the blended PAH/SAH cost for the node (see @p bvhStrategies::computeCostPahSahBlend), and updates the total, like @p pah and @p sah do.
+		 * Since the blend is linear, the total is also (1 - offDistributionFraction) * pahCost + offDistributionFraction * sahCost, which allows to compare different mixes with the measured traversal costs.
+		 */
+		static void blend(float& totalBlend, ANALYZER_ACTION_PER_NODE_ARGUMENTS) {
+			if (bvh.getInfluenceArea() == nullptr) return; //it means it is a SAH BVH
+			float rootSa = bvh.getRoot().aabb.surfaceArea();
+			auto [blend, hitProb, sa] = bvhStrategies::computeCostPahSahBlend(node, bvh.getNodesInfluenceArea(), rootSa);
+
+			//add to JSON
+			localLog["metrics"]["blend"] = blend;
+
+			//update global variable
+			if (node.isLeaf()) { totalBlend += blend; }
+			else { totalBlend += hitProb * NODE_COST * 2.0f; }
+		}
+
 		/**
 		 * @brief Updates the maximum level of the BVH.
 		 */
@@ -120,14 +137,14 @@ namespace pah::analyzerActions {
 		static void siblingsOverlapping(std::tuple<float,float,float,float>& totalAndOverlappingArea, ANALYZER_ACTION_PER_NODE_ARGUMENTS) {
 			if (node.isLeaf() || !bvh.getInfluenceArea() || currentLevel > maxLevelToConsider) return;
 
-			const auto& contourPointsLeft = ConvexHull2d{ bvh.getInfluenceArea()->getProjectedHull(node.leftChild->aabb) };
-			const auto& contourPointsRight = ConvexHull2d{ bvh.getInfluenceArea()->getProjectedHull(node.rightChild->aabb) };
+			const auto& contourPointsLeft = ConvexHull2d{ bvh.getNodesInfluenceArea()->getProjectedHull(node.leftChild->aabb) };
+			const auto& contourPointsRight = ConvexHull2d{ bvh.getNodesInfluenceArea()->getProjectedHull(node.rightChild->aabb) };
 			auto overlappingChildrenHull = overlappingHull(contourPointsLeft, contourPointsRight);
 			float overlappingChildrenArea = overlappingChildrenHull.computeArea();
 			float smallestChildrenArea = glm::min(contourPointsLeft.computeArea(), contourPointsRight.computeArea());
 
 			// compute culled areas
-			auto projectionPlaneHull = ConvexHull2d{ bvh.getInfluenceArea()->getProjectionPlaneHull() };
+			auto projectionPlaneHull = ConvexHull2d{ bvh.getNodesInfluenceArea()->getProjectionPlaneHull() };
 			const auto& contourPointsLeftCulled = overlappingHull(contourPointsLeft, projectionPlaneHull);
 			const auto& contourPointsRightCulled = overlappingHull(contourPointsRight, projectionPlaneHull);
 			auto overlappingChildrenHullCulled = overlappingHull(contourPointsLeftCulled, contourPointsRightCulled);
@@ -175,6 +192,15 @@ namespace pah::analyzerActions {
 			log["globalInfo"]["pahCost"] = totalPah;
 		}
 
+		/**
+		 * @brief Simply adds the total blended PAH/SAH cost, and the off-distribution fraction it was computed with, to the JSON.
+		 */
+		static void blend(float& totalBlend, ANALYZER_ACTION_FINAL_ARGUMENTS) {
+			if (bvh.getInfluenceArea() == nullptr) return;
+			log["globalInfo"]["blendedCost"] = totalBlend;
+			log["globalInfo"]["offDistributionFraction"] = bvh.getInfluenceArea()->getOffDistributionFraction();
+		}
+
 		/**
 		 * @brief Simply adds the max level to the JSON.
 		 */
@@ -3,22 +3,94 @@
 #include <limits>
 #include <chrono>
 #include <queue>
+#include <execution>
+#include <future>
+#include <bit>
+#include <numeric>
 
 using namespace std;
 using namespace pah::utilities;
 
 
+/**
+ * @brief Spreads the lowest 10 bits of @p v, so that there are 2 zeros between each of them.
+ */
+static unsigned int expandBits(unsigned int v) {
+	v = (v * 0x00010001u) & 0xFF0000FFu;
+	v = (v * 0x00000101u) & 0x0F00F00Fu;
+	v = (v * 0x00000011u) & 0xC30C30C3u;
+	v = (v * 0x00000005u) & 0x49249249u;
+	return v;
+}
+
+/**
+ * @brief Returns the 30 bits Morton code of @p point, quantized on a 1024x1024x1024 grid over @p bounds.
+ */
+static unsigned int mortonCode(const pah::Aabb& bounds, const pah::Vector3& point) {
+	pah::Vector3 extent = bounds.max - bounds.min;
+	pah::Vector3 normalized = (point - bounds.min) / glm::max(extent, pah::Vector3{ numeric_limits<float>::min() });
+	auto quantize = [](float x) { return static_cast<unsigned int>(glm::clamp(x * 1024.0f, 0.0f, 1023.0f)); };
+	return (expandBits(quantize(normalized.x)) << 2) | (expandBits(quantize(normalized.y)) << 1) | expandBits(quantize(normalized.z));
+}
+
+/**
+ * @brief Sorts @p triangles by their Morton @p codes (least significant digit radix sort, 8 bits at a time).
+ */
+static void radixSort(vector<unsigned int>& codes, vector<const pah::Triangle*>& triangles) {
+	vector<unsigned int> codesBuffer(codes.size());
+	vector<const pah::Triangle*> trianglesBuffer(triangles.size());
+	for (int shift = 0; shift < 32; shift += 8) {
+		array<int, 257> offsets{};
+		for (auto c : codes) offsets[((c >> shift) & 0xFF) + 1]++;
+		for (int d = 0; d < 256; ++d) offsets[d + 1] += offsets[d];
+		for (int i = 0; i < codes.size(); ++i) {
+			int destination = offsets[(codes[i] >> shift) & 0xFF]++;
+			codesBuffer[destination] = codes[i];
+			trianglesBuffer[destination] = triangles[i];
+		}
+		codes.swap(codesBuffer);
+		triangles.swap(trianglesBuffer);
+	}
+}
+
+/**
+ * @brief Returns the Morton codes of the barycenters of @p triangles (computed in parallel), and the triangles, both sorted by code.
+ */
+static pair<vector<unsigned int>, vector<const pah::Triangle*>> sortByMortonCode(const vector<const pah::Triangle*>& triangles) {
+	pah::Aabb barycentersBounds = pah::Aabb::minAabb();
+	for (auto t : triangles) barycentersBounds += pah::Aabb{ t->barycenter(), t->barycenter() };
+	vector<unsigned int> codes(triangles.size());
+	std::transform(std::execution::par_unseq, triangles.begin(), triangles.end(), codes.begin(), [&barycentersBounds](const pah::Triangle* t) {
+		return mortonCode(barycentersBounds, t->barycenter());
+		});
+	vector<const pah::Triangle*> sortedTriangles = triangles;
+	radixSort(codes, sortedTriangles);
+	return { std::move(codes), std::move(sortedTriangles) };
+}
+
+/**
+ * @brief Adds to @p refinable the highest nodes of the subtree of @p node, at level @p currentLevel, that were built linearly by a build with a time budget (see @p pah::Bvh::refine), with their levels.
+ */
+static void findRefinable(pah::Bvh::Node& node, int currentLevel, vector<pair<pah::Bvh::Node*, int>>& refinable) {
+	if (node.refinable) refinable.emplace_back(&node, currentLevel);
+	else if (!node.isLeaf()) {
+		findRefinable(*node.leftChild, currentLevel + 1, refinable);
+		findRefinable(*node.rightChild, currentLevel + 1, refinable);
+	}
+}
+
+
 // ======| Bvh |======
 pah::Bvh::Bvh(const Properties& properties, const InfluenceArea& influenceArea, ComputeCostType computeCost, ChooseSplittingPlanesType chooseSplittingPlanes, ShouldStopType shouldStop, std::string name)
 	: name{ name }, properties {properties}, influenceArea{ &influenceArea }, 
 	computeCost{ computeCost }, chooseSplittingPlanes{ chooseSplittingPlanes }, shouldStop{ shouldStop },
-	computeCostFallback{ DEFAULT_BVH_FALLBACK_STRATEGY_COMPUTE_COST }, chooseSplittingPlanesFallback{ DEFAULT_BVH_FALLBACK_STRATEGY_SPLITTING_PLANE }, shouldStopFallback{ DEFAULT_BVH_FALLBACK_STRATEGY_SHOULD_STOP } {
+	computeCostFallback{ DEFAULT_BVH_FALLBACK_STRATEGY_COMPUTE_COST }, computeCostBatchFallback{ DEFAULT_BVH_FALLBACK_STRATEGY_COMPUTE_COST_BATCH }, chooseSplittingPlanesFallback{ DEFAULT_BVH_FALLBACK_STRATEGY_SPLITTING_PLANE }, shouldStopFallback{ DEFAULT_BVH_FALLBACK_STRATEGY_SHOULD_STOP } {
 }
 
 pah::Bvh::Bvh(const Properties& properties, ComputeCostType computeCost, ChooseSplittingPlanesType chooseSplittingPlanes, ShouldStopType shouldStop, std::string name)
 	: name{ name }, properties { properties }, 
 	influenceArea{ nullptr }, computeCost{ computeCost }, chooseSplittingPlanes{ chooseSplittingPlanes }, shouldStop{ shouldStop },
-	computeCostFallback{ DEFAULT_BVH_FALLBACK_STRATEGY_COMPUTE_COST }, chooseSplittingPlanesFallback{ DEFAULT_BVH_FALLBACK_STRATEGY_SPLITTING_PLANE }, shouldStopFallback{ DEFAULT_BVH_FALLBACK_STRATEGY_SHOULD_STOP } {
+	computeCostFallback{ DEFAULT_BVH_FALLBACK_STRATEGY_COMPUTE_COST }, computeCostBatchFallback{ DEFAULT_BVH_FALLBACK_STRATEGY_COMPUTE_COST_BATCH }, chooseSplittingPlanesFallback{ DEFAULT_BVH_FALLBACK_STRATEGY_SPLITTING_PLANE }, shouldStopFallback{ DEFAULT_BVH_FALLBACK_STRATEGY_SHOULD_STOP } {
 }
 
 void pah::Bvh::build(const std::vector<Triangle>& triangles) {
@@ -39,39 +111,84 @@ void pah::Bvh::build(const std::vector<Triangle>& triangles, unsigned int seed)
 	build(triangles | std::views::transform([](const auto& t) {return &t; }) | std::ranges::to<std::vector>(), seed);
 }
 
+void pah::Bvh::build(const std::vector<Triangle>& triangles, DurationMs budget) {
+	build(triangles | std::views::transform([](const auto& t) {return &t; }) | std::ranges::to<std::vector>(), budget);
+}
+
+void pah::Bvh::build(const std::vector<const Triangle*>& triangles, DurationMs budget) {
+	//the final action simply adds the measured time to the total time
+	INFO(TimeLogger timeLogger{ [this](DurationMs duration) { totalBuildTime = duration; } };);
+
+	buildDeadline = chrono::steady_clock::now() + chrono::duration_cast<chrono::steady_clock::duration>(budget);
+	random_device randomDevice;
+	build(triangles, randomDevice()); //the seed is random
+	buildDeadline = nullopt;
+	INFO(timeLogger.stop(););
+}
+
 void pah::Bvh::build(const std::vector<const Triangle*>& triangles, unsigned int seed) {
 	id = chrono::duration_cast<std::chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count(); //set the id based on current time: the id is just used to check for equality betweeen 2 BVHs (and this is the only non const function)
 	rng = mt19937{ seed }; //initialize random number generator
-	//from an array of triangles, to an array to pointers
-	root = { triangles }; //initizalize root
-	rootMetric = computeCost(root, influenceArea, -1).area; //initialize the root metric (generally its area/projected area)
-	rootMetricFallback = computeCostFallback(root, influenceArea, -1).area; //initialize the root metric (generally its area/projected area)
+
+	//with oriented nodes, the whole construction happens in ray space, where the nodes are axis aligned
+	orientedNodesSpace = nullptr;
+	optional<Matrix3> basis = orientedNodes && influenceArea != nullptr ? influenceArea->getRaySpaceBasis() : nullopt;
+	if (basis) {
+		auto space = make_shared<OrientedNodesSpace>(*basis, influenceArea->createRaySpaceInfluenceArea());
+		space->triangles.reserve(triangles.size());
+		for (auto t : triangles) space->triangles.emplace_back(*basis * (*t)[0], *basis * (*t)[1], *basis * (*t)[2]);
+		space->originalTriangles = triangles;
+		orientedNodesSpace = space;
+	}
+	const InfluenceArea* nodesInfluenceArea = getNodesInfluenceArea();
+
+	if (orientedNodesSpace) root = { orientedNodesSpace->triangles | std::views::transform([](const auto& t) {return &t; }) | std::ranges::to<std::vector>() }; //from an array of triangles, to an array to pointers
+	else root = { triangles }; //initizalize root
+	rootMetric = computeCost(root, nodesInfluenceArea, -1).area; //initialize the root metric (generally its area/projected area)
+	rootMetricFallback = computeCostFallback(root, nodesInfluenceArea, -1).area; //initialize the root metric (generally its area/projected area)
+	raySpaceBasis = raySpaceBinning && nodesInfluenceArea != nullptr ? nodesInfluenceArea->getRaySpaceBasis() : nullopt;
 	
-	splitNode(root, Axis::X, std::numeric_limits<float>::max(), 1);
+	if (buildMode == BuildMode::TopDown) {
+		SplitState state{ rng, static_cast<int>(properties.maxSpatialSplitsDuplication * triangles.size()), properties.lazyBuildLevels > 0 ? properties.lazyBuildLevels : numeric_limits<int>::max() };
+		if (buildDeadline) buildBreadthFirst(root, std::numeric_limits<float>::max(), 1, state, *buildDeadline);
+		else splitNode(root, Axis::X, std::numeric_limits<float>::max(), 1, state);
+		rng = state.rng;
+	}
+	else {
+		auto [codes, sortedTriangles] = sortByMortonCode(root.triangles);
+		if (buildMode == BuildMode::Linear) buildLinearNode(root, codes, sortedTriangles, 1);
+		else buildAgglomerative(sortedTriangles);
+	}
+
+	if (treeletLeaves >= 3 && !buildDeadline) for (int i = 0; i < treeletIterations; ++i) restructureTreeletsRecursive(root, treeletLeaves);
+	if (!root.triangles.empty()) updateBuildCosts(root);
 }
 
 pah::Bvh::TraversalResults pah::Bvh::traverse(const Ray& ray) const {	
 	TraversalResults res{ .bvh = this };
 	TIME(TimeLogger timeLogger{ [&res](auto duration) {res.traversalTime = duration; } });
 
-	queue<const Node*> toVisit{};
+	queue<Node*> toVisit{}; //not const, because the lazy subtrees are built when they are reached
 	toVisit.push(&root);
 	float closestHit = numeric_limits<float>::max();
+	//with oriented nodes, the ray is transformed once to the space of the nodes (rotations preserve the hit distances)
+	const Ray& nodesRay = orientedNodesSpace ? Ray{ orientedNodesSpace->basis * ray.getOrigin(), orientedNodesSpace->basis * ray.getDirection() } : ray;
 
 	while (toVisit.size() > 0) {
-		const Node& current = *toVisit.front();
+		Node& current = *toVisit.front();
 		toVisit.pop(); //queue::front doesn't remove the element from the queue, it just accesses it
 		//we enter the if statement iff there is a hit with the box and this hit is closer than the closest hit found so far
-		if (const auto& boxHitInfo = collisionDetection::areColliding(ray, current.aabb); boxHitInfo.hit){//}&& boxHitInfo.distance < closestHit) {
+		if (const auto& boxHitInfo = collisionDetection::areColliding(nodesRay, current.aabb); boxHitInfo.hit){//}&& boxHitInfo.distance < closestHit) {
 			res.intersectionTestsTotal++;
 			res.intersectionTestsWithNodes++;
+			if (current.lazySubtree) buildLazySubtree(current);
 			if (current.isLeaf()) {
 				const auto& triangles = current.triangles;
 				res.traversalCost += LEAF_COST * triangles.size();
 				for (const Triangle* triangle : triangles) {
 					res.intersectionTestsTotal++;
 					res.intersectionTestsWithTriangles++;
-					const auto& hitInfo = collisionDetection::areColliding(ray, **triangle);
+					const auto& hitInfo = collisionDetection::areColliding(nodesRay, **triangle);
 					if (hitInfo.hit && hitInfo.distance < closestHit) {
 						closestHit = hitInfo.distance;
 						res.closestHit = triangle;
@@ -87,11 +204,12 @@ pah::Bvh::TraversalResults pah::Bvh::traverse(const Ray& ray) const {
 		}
 	}
 
+	if (orientedNodesSpace && res.closestHit) res.closestHit = orientedNodesSpace->originalTriangles[res.closestHit - orientedNodesSpace->triangles.data()];
 	INFO(timeLogger.stop(););
 	return res;
 }
 
-void pah::Bvh::splitNode(Node& node, Axis fatherSplittingAxis, float fatherHitProbability, int currentLevel) {
+void pah::Bvh::splitNode(Node& node, Axis fatherSplittingAxis, float fatherHitProbability, int currentLevel, SplitState& state, bool fallbackSubtree) const {
 	//the final action simply adds the measured time to the total time
 	TIME(TimeLogger timeLoggerTotal{ [&timingInfo = node.nodeTimingInfo](DurationMs duration) { timingInfo.logTotal(duration); } };);
 
@@ -99,9 +217,15 @@ void pah::Bvh::splitNode(Node& node, Axis fatherSplittingAxis, float fatherHitPr
 	ComputeCostReturnType bestLeftCostSoFar = { MAX,MAX,MAX }, bestRightCostSoFar = { MAX,MAX,MAX };
 	Node bestLeft{ Aabb::maxAabb() }, bestRight{ Aabb::maxAabb() };
 	Axis usedAxis; //we save what axis we actually used
-	auto splittingPlanes = chooseSplittingPlanesWrapper(node, influenceArea, fatherSplittingAxis, rng, currentLevel);
+
+	//once a node uses the fallback strategies, its whole subtree does
+	bool useFallback = fallbackSubtree || isFallbackNode(node, fatherHitProbability, currentLevel);
+	//the hit probability of the node comes from its father: if the father didn't use the fallback strategies, it must be recomputed to be comparable with the ones of the children
+	if (useFallback && !fallbackSubtree && fatherHitProbability != numeric_limits<float>::max()) fatherHitProbability = computeCostFallback(node, getNodesInfluenceArea(), rootMetricFallback).hitProbability;
+	auto splittingPlanes = chooseSplittingPlanesWrapper(node, getNodesInfluenceArea(), fatherSplittingAxis, state.rng, currentLevel, useFallback);
 
 	bool found = false; //flag to check if we found at least one split (maybe all the splits place the triangles on one side, leaving the other one empty)
+	bool bestFallback = false; //whether the best split found so far was evaluated with the fallback strategies
 
 	//the final action simply adds the measured time to the total split time
 	TIME(TimeLogger timeLoggerSplitting{ [&timingInfo = node.nodeTimingInfo](DurationMs duration) { timingInfo.logSplittingTot(duration); } };);
@@ -117,25 +241,52 @@ void pah::Bvh::splitNode(Node& node, Axis fatherSplittingAxis, float fatherHitPr
 			if (bestCutSoFarQuality <= properties.acceptableChildrenFatherHitProbabilityRatio) break;
 
 			forceFallback = true;
-			auto chooseSplittingPlanesResult = chooseSplittingPlanesWrapper(node, influenceArea, fatherSplittingAxis, rng, currentLevel, forceFallback);
+			auto chooseSplittingPlanesResult = chooseSplittingPlanesWrapper(node, getNodesInfluenceArea(), fatherSplittingAxis, state.rng, currentLevel, forceFallback);
 			Axis sahAxis = chooseSplittingPlanesResult[0].first == lastUsedAxis ? chooseSplittingPlanesResult[1].first : chooseSplittingPlanesResult[0].first; // we have already used the longest option, so try a different one
 			axis = sahAxis;
 			bestLeftCostSoFar = { MAX,MAX,MAX }; bestRightCostSoFar = { MAX,MAX,MAX };
 		}
 
 		node.nodeTimingInfo.chooseSplittingPlanesCount++;
+		//if there is a batched compute cost strategy, evaluate all the bins at once, and only create the children of the best one
+		bool fallback = forceFallback || useFallback;
+		const auto& computeCostBatchToUse = fallback ? computeCostBatchFallback : computeCostBatch;
+		float rootMetricToUse = fallback ? rootMetricFallback : rootMetric;
+		bool raySpace = raySpaceBasis.has_value() && !fallback; //the fallback strategies choose world axes
+		if (computeCostBatchToUse) {
+			auto [foundInAxis, splittingPlanePosition, costLeft, costRight] = findBestBinnedSplit(node, axis, computeCostBatchToUse, rootMetricToUse, raySpace);
+			if (foundInAxis && costLeft.cost + costRight.cost < bestLeftCostSoFar.cost + bestRightCostSoFar.cost) {
+				const auto& [leftTriangles, rightTriangles] = splitTriangles(node, node.triangles, axis, splittingPlanePosition, raySpace);
+				TIME(TimeLogger timeLoggerNodes{ [&timingInfo = node.nodeTimingInfo](auto duration) { timingInfo.logNodesCreation(duration); } };);
+				found = true;
+				usedAxis = axis;
+				bestLeftCostSoFar = costLeft;
+				bestRightCostSoFar = costRight;
+				bestLeft = Node{ referencesBounds(node, leftTriangles) }; //after a spatial split, triangles may stick out of the node
+				bestLeft.triangles = leftTriangles;
+				bestRight = Node{ referencesBounds(node, rightTriangles) };
+				bestRight.triangles = rightTriangles;
+				bestFallback = fallback;
+			}
+			if (forceFallback) break;
+			lastUsedAxis = axis;
+			continue;
+		}
+
 		//split for each bin
+		auto [min, max] = splittingBounds(node, axis, raySpace);
 		for (int i = 1; i < properties.bins - 1; ++i) {
-			float splittingPlanePosition = at(node.aabb.min, axis) + (at(node.aabb.max, axis) - at(node.aabb.min, axis)) / properties.bins * i;
-			const auto& [leftTriangles, rightTriangles] = splitTriangles(node, node.triangles, axis, splittingPlanePosition);
+			float splittingPlanePosition = min + (max - min) / properties.bins * i;
+			const auto& [leftTriangles, rightTriangles] = splitTriangles(node, node.triangles, axis, splittingPlanePosition, raySpace);
 			if (leftTriangles.size() <= 0 || rightTriangles.size() <= 0) continue; //we must have triangles on both sides to procede
 
 			TIME(TimeLogger timeLoggerNodes{ [&timingInfo = node.nodeTimingInfo](auto duration) { timingInfo.logNodesCreation(duration); } };);
-			Node left = { leftTriangles }, right = { rightTriangles };
+			Node left{ referencesBounds(node, leftTriangles) }, right{ referencesBounds(node, rightTriangles) }; //after a spatial split, triangles may stick out of the node
+			left.triangles = leftTriangles; right.triangles = rightTriangles;
 			TIME(timeLoggerNodes.stop(););
 
-			auto costLeft = computeCostWrapper(node, left, influenceArea, forceFallback ? rootMetricFallback : rootMetric, currentLevel, forceFallback);
-			auto costRight = computeCostWrapper(node, right, influenceArea, forceFallback ? rootMetricFallback : rootMetric, currentLevel, forceFallback);
+			auto costLeft = computeCostWrapper(node, left, getNodesInfluenceArea(), rootMetricToUse, currentLevel, fallback);
+			auto costRight = computeCostWrapper(node, right, getNodesInfluenceArea(), rootMetricToUse, currentLevel, fallback);
 
 			//update best split (also check that we have triangles on both sides, else we might get stuck)
 			if (costLeft.cost + costRight.cost < bestLeftCostSoFar.cost + bestRightCostSoFar.cost) {
@@ -145,11 +296,46 @@ void pah::Bvh::splitNode(Node& node, Axis fatherSplittingAxis, float fatherHitPr
 				bestRightCostSoFar = costRight;
 				bestLeft = std::move(left);
 				bestRight = std::move(right);
+				bestFallback = fallback;
 			}
 		}
 		if (forceFallback) break; //if it was forced to use SAH, it means that the splitting plane quality was low. Therefore it is useless to keep trying (since planes are sorted by their quality).
 		lastUsedAxis = axis;
 	}
+
+	//if the children of the best object split overlap too much, try to clip the triangles crossing the splitting planes instead (spatial splits)
+	const auto& spatialComputeCostBatch = bestFallback ? computeCostBatchFallback : computeCostBatch;
+	if (found && state.spatialSplitsReferencesLeft > 0 && spatialComputeCostBatch) {
+		float spatialRootMetric = bestFallback ? rootMetricFallback : rootMetric;
+		Aabb overlap = bestLeft.aabb.intersection(bestRight.aabb);
+		ComputeCostReturnType overlapCost{ 0,0,0 };
+		int overlapTrianglesCount = 1;
+		if (overlap.min.x < overlap.max.x && overlap.min.y < overlap.max.y && overlap.min.z < overlap.max.z) spatialComputeCostBatch({ &overlap, 1 }, { &overlapTrianglesCount, 1 }, getNodesInfluenceArea(), spatialRootMetric, { &overlapCost, 1 });
+
+		if (overlapCost.hitProbability >= properties.minSpatialSplitOverlap) {
+			SpatialSplit bestSpatial{ .found = false, .splittingPlanePosition = 0, .costLeft = { MAX,MAX,MAX }, .costRight = { MAX,MAX,MAX }, .leftAabb = Aabb::minAabb(), .rightAabb = Aabb::minAabb(), .duplicatedReferences = 0 };
+			Axis spatialAxis;
+			for (Axis axis : { Axis::X, Axis::Y, Axis::Z }) {
+				auto spatial = findBestSpatialSplit(node, axis, spatialComputeCostBatch, spatialRootMetric, state.spatialSplitsReferencesLeft);
+				if (spatial.found && spatial.costLeft.cost + spatial.costRight.cost < bestLeftCostSoFar.cost + bestRightCostSoFar.cost && (!bestSpatial.found || spatial.costLeft.cost + spatial.costRight.cost < bestSpatial.costLeft.cost + bestSpatial.costRight.cost)) {
+					bestSpatial = spatial;
+					spatialAxis = axis;
+				}
+			}
+
+			if (bestSpatial.found) {
+				auto [leftTriangles, rightTriangles] = splitTrianglesSpatial(node, node.triangles, spatialAxis, bestSpatial.splittingPlanePosition);
+				usedAxis = spatialAxis;
+				bestLeftCostSoFar = bestSpatial.costLeft;
+				bestRightCostSoFar = bestSpatial.costRight;
+				bestLeft = Node{ bestSpatial.leftAabb };
+				bestLeft.triangles = std::move(leftTriangles);
+				bestRight = Node{ bestSpatial.rightAabb };
+				bestRight.triangles = std::move(rightTriangles);
+				state.spatialSplitsReferencesLeft -= bestSpatial.duplicatedReferences;
+			}
+		}
+	}
 	TIME(timeLoggerSplitting.stop();); //log the time it took to split this node
 
 	if (!found) 
@@ -161,12 +347,596 @@ void pah::Bvh::splitNode(Node& node, Axis fatherSplittingAxis, float fatherHitPr
 
 	TIME(timeLoggerTotal.stop();); //log the time it took for this node (of course we exclude recursive calls)
 
-	//recurse on children
+	//recurse on children (below the lazy levels, the children are only split when a traversal reaches them)
 	currentLevel++;
-	if (!shouldStopWrapper(node, *node.leftChild, properties, currentLevel, bestLeftCostSoFar, currentLevel))
-		splitNode(*node.leftChild, usedAxis, bestLeftCostSoFar.hitProbability, currentLevel);
-	if (!shouldStopWrapper(node, *node.rightChild, properties, currentLevel, bestRightCostSoFar, currentLevel))
-		splitNode(*node.rightChild, usedAxis, bestRightCostSoFar.hitProbability, currentLevel);
+	int spatialSplitsReferencesToShare = state.spatialSplitsReferencesLeft;
+	long long childrenTriangles = node.leftChild->triangles.size() + node.rightChild->triangles.size();
+	auto splitChild = [&](Node& child, const ComputeCostReturnType& childCost) {
+		if (shouldStopWrapper(node, child, properties, currentLevel, childCost, currentLevel, useFallback || isFallbackNode(child, childCost.hitProbability, currentLevel))) return;
+		if (currentLevel > state.lastBuiltLevel) {
+			//each lazy subtree gets its own random number generator and a share of the spatial splits budget left, proportional to its triangles.
+			//The share is taken from the budget, so that the lazy subtrees together can't duplicate more references than it allows
+			int spatialSplitsReferences = static_cast<int>(glm::min(spatialSplitsReferencesToShare * static_cast<long long>(child.triangles.size()) / childrenTriangles, static_cast<long long>(properties.maxSpatialSplitsDuplication * child.triangles.size())));
+			state.spatialSplitsReferencesLeft -= spatialSplitsReferences;
+			child.lazySubtree = make_unique<LazySubtree>(usedAxis, childCost.hitProbability, currentLevel, useFallback, SplitState{ mt19937{ state.rng() }, spatialSplitsReferences, numeric_limits<int>::max() });
+		}
+		else splitNode(child, usedAxis, childCost.hitProbability, currentLevel, state, useFallback);
+	};
+	splitChild(*node.leftChild, bestLeftCostSoFar);
+	splitChild(*node.rightChild, bestRightCostSoFar);
+}
+
+void pah::Bvh::buildLazySubtree(Node& node) const {
+	std::call_once(node.lazySubtree->built, [this, &node]() {
+		//the traversals that reach node wait here, and the others don't read it, so it can be split while the Bvh is being traversed
+		LazySubtree& lazySubtree = *node.lazySubtree;
+		if (!node.isLeaf()) return; //e.g. a copy of a built node
+		float leafBuildCost = node.buildCost;
+		splitNode(node, lazySubtree.fatherSplittingAxis, lazySubtree.fatherHitProbability, lazySubtree.level, lazySubtree.state, lazySubtree.fallbackSubtree);
+		if (node.isLeaf()) return;
+		float buildCost = updateBuildCosts(node);
+		//the ancestors can't be reached from here, and other traversals may be reading them: refit adds the change to them (see propagateLazyBuildCosts)
+		if (leafBuildCost >= 0.0f) lazySubtree.buildCostChange = buildCost - leafBuildCost;
+	});
+}
+
+void pah::Bvh::buildBreadthFirst(Node& node, float hitProbability, int currentLevel, SplitState& state, std::chrono::steady_clock::time_point deadline) {
+	//each node is split by one level: its children are left unbuilt, with the arguments to split them, and they are split after the other nodes of their father's level
+	queue<Node*> toSplit;
+	auto queueChildren = [&toSplit](Node& father) {
+		if (father.isLeaf()) return;
+		if (father.leftChild->lazySubtree) toSplit.push(&*father.leftChild);
+		if (father.rightChild->lazySubtree) toSplit.push(&*father.rightChild);
+	};
+	//node is split with the state of the caller, so that it advances (e.g. its random number generator); its children get their own states
+	int lastBuiltLevel = std::exchange(state.lastBuiltLevel, currentLevel);
+	splitNode(node, Axis::X, hitProbability, currentLevel, state);
+	state.lastBuiltLevel = lastBuiltLevel;
+	queueChildren(node);
+	while (!toSplit.empty() && chrono::steady_clock::now() < deadline) {
+		Node& current = *toSplit.front();
+		toSplit.pop();
+		auto lazySubtree = std::move(current.lazySubtree);
+		lazySubtree->state.lastBuiltLevel = lazySubtree->level;
+		splitNode(current, lazySubtree->fatherSplittingAxis, lazySubtree->fatherHitProbability, lazySubtree->level, lazySubtree->state, lazySubtree->fallbackSubtree);
+		queueChildren(current);
+	}
+
+	//out of time: the subtrees left are built linearly
+	for (; !toSplit.empty(); toSplit.pop()) {
+		Node& current = *toSplit.front();
+		int level = current.lazySubtree->level;
+		current.lazySubtree = nullptr;
+		auto [codes, sortedTriangles] = sortByMortonCode(current.triangles);
+		buildLinearNode(current, codes, sortedTriangles, level);
+		current.refinable = true;
+	}
+}
+
+int pah::Bvh::refine(DurationMs budget) {
+	buildDeadline = chrono::steady_clock::now() + chrono::duration_cast<chrono::steady_clock::duration>(budget);
+	vector<pair<Node*, int>> refinable;
+	findRefinable(root, 1, refinable);
+
+	//the largest subtrees lose the most from being built linearly
+	std::ranges::sort(refinable, std::greater{}, [](const auto& subtree) { return subtree.first->triangles.size(); });
+	int refined = 0;
+	for (; refined < refinable.size() && chrono::steady_clock::now() < *buildDeadline; ++refined) rebuildSubtree(*refinable[refined].first, refinable[refined].second); //the parts of the subtree that don't make it in time are refinable again
+	buildDeadline = nullopt;
+
+	vector<pair<Node*, int>> left;
+	findRefinable(root, 1, left);
+	return static_cast<int>(left.size());
+}
+
+bool pah::Bvh::isFallbackNode(const Node& node, float hitProbability, int currentLevel) const {
+	return currentLevel > properties.maxNonFallbackLevels ||
+		hitProbability < properties.minNonFallbackHitProbability ||
+		node.triangles.size() < properties.minNonFallbackTriangles;
+}
+
+void pah::Bvh::buildLinearNode(Node& node, std::span<const unsigned int> codes, std::span<const Triangle* const> triangles, int currentLevel) {
+	node.triangles.assign(triangles.begin(), triangles.end());
+	if (triangles.size() < 2 || triangles.size() < properties.maxTrianglesPerLeaf || currentLevel > properties.maxLevels) {
+		node.aabb = Aabb{ node.triangles };
+		return;
+	}
+
+	//split after the last triangle whose code has the same highest bits of the first one (if all the codes are the same, split in the middle)
+	int split = static_cast<int>(triangles.size()) / 2;
+	if (codes.front() != codes.back()) {
+		int commonPrefix = std::countl_zero(codes.front() ^ codes.back());
+		split = static_cast<int>(std::partition_point(codes.begin(), codes.end(), [&codes, commonPrefix](unsigned int c) { return std::countl_zero(codes.front() ^ c) > commonPrefix; }) - codes.begin());
+	}
+
+	node.leftChild = make_unique<Node>();
+	node.rightChild = make_unique<Node>();
+	if (triangles.size() >= PARALLEL_BUILD_MIN_TRIANGLES) {
+		auto left = std::async(std::launch::async, [&]() { buildLinearNode(*node.leftChild, codes.first(split), triangles.first(split), currentLevel + 1); });
+		buildLinearNode(*node.rightChild, codes.subspan(split), triangles.subspan(split), currentLevel + 1);
+		left.get();
+	}
+	else {
+		buildLinearNode(*node.leftChild, codes.first(split), triangles.first(split), currentLevel + 1);
+		buildLinearNode(*node.rightChild, codes.subspan(split), triangles.subspan(split), currentLevel + 1);
+	}
+	node.aabb = node.leftChild->aabb;
+	node.aabb += node.rightChild->aabb;
+}
+
+void pah::Bvh::buildAgglomerative(const std::vector<const Triangle*>& triangles) {
+	//the initial clusters are runs of consecutive triangles along the Morton curve, as big as the largest leaf allowed
+	const int leafSize = glm::max(1, properties.maxTrianglesPerLeaf - 1);
+	vector<unique_ptr<Node>> clusters;
+	for (int i = 0; i < triangles.size(); i += leafSize) {
+		vector<const Triangle*> leafTriangles{ triangles.begin() + i, triangles.begin() + glm::min(i + leafSize, static_cast<int>(triangles.size())) };
+		clusters.push_back(make_unique<Node>(leafTriangles));
+	}
+	if (clusters.size() <= 1) return; //the root is a leaf
+
+	const int radius = glm::max(1, properties.agglomerativeSearchRadius);
+	//the distance is the hit probability of the merged node: the surface area breaks the ties (e.g. between nodes outside the influence area), then the indices, so that the pair with the lowest distance is always merged
+	using Distance = tuple<float, float, int, int>;
+	while (clusters.size() > 1) {
+		const int n = static_cast<int>(clusters.size());
+		vector<int> indices(n);
+		std::iota(indices.begin(), indices.end(), 0);
+
+		//distances[i * radius + k] is the distance between clusters i and i + k + 1
+		vector<pair<float, float>> distances(static_cast<size_t>(n) * radius);
+		std::for_each(std::execution::par, indices.begin(), indices.end(), [&](int i) {
+			int count = glm::min(radius, n - 1 - i);
+			vector<Aabb> merged(count);
+			vector<float> mergedHitProbabilities(count);
+			for (int k = 0; k < count; ++k) {
+				merged[k] = clusters[i]->aabb;
+				merged[k] += clusters[i + k + 1]->aabb;
+			}
+			hitProbabilities(merged, mergedHitProbabilities);
+			for (int k = 0; k < count; ++k) distances[static_cast<size_t>(i) * radius + k] = { mergedHitProbabilities[k], merged[k].surfaceArea() };
+			});
+
+		vector<int> nearest(n);
+		std::for_each(std::execution::par, indices.begin(), indices.end(), [&](int i) {
+			Distance best{ numeric_limits<float>::max(), numeric_limits<float>::max(), n, n };
+			for (int j = glm::max(0, i - radius); j <= glm::min(n - 1, i + radius); ++j) {
+				if (j == i) continue;
+				auto [first, second] = std::minmax(i, j);
+				auto [hitProbability, surfaceArea] = distances[static_cast<size_t>(first) * radius + (second - first - 1)];
+				if (Distance distance{ hitProbability, surfaceArea, first, second }; distance < best) {
+					best = distance;
+					nearest[i] = j;
+				}
+			}
+			});
+
+		//merge the clusters that are the nearest of each other: the merged cluster takes the place of the first one, so that they stay sorted along the Morton curve
+		std::for_each(std::execution::par, indices.begin(), indices.end(), [&](int i) {
+			int j = nearest[i];
+			if (j < i || nearest[j] != i) return;
+			Aabb aabb = clusters[i]->aabb;
+			aabb += clusters[j]->aabb;
+			auto merged = make_unique<Node>(aabb);
+			merged->triangles = clusters[i]->triangles;
+			merged->triangles.insert(merged->triangles.end(), clusters[j]->triangles.begin(), clusters[j]->triangles.end());
+			merged->leftChild = std::move(clusters[i]);
+			merged->rightChild = std::move(clusters[j]);
+			clusters[i] = std::move(merged);
+			});
+		std::erase(clusters, nullptr);
+	}
+
+	root = std::move(*clusters[0]);
+}
+
+void pah::Bvh::restructureTreelets(int treeletLeaves, int iterations) {
+	if (treeletLeaves > MAX_TREELET_LEAVES) throw std::invalid_argument{ "Treelets can have at most " + std::to_string(MAX_TREELET_LEAVES) + " leaves" };
+	if (treeletLeaves < 3 || root.triangles.empty()) return; //with 2 leaves there is only one topology
+	for (int i = 0; i < iterations; ++i) restructureTreeletsRecursive(root, treeletLeaves);
+	updateBuildCosts(root); //the restructured treelets have new internal nodes, so refit must compare against their new costs
+}
+
+void pah::Bvh::restructureTreeletsRecursive(Node& node, int treeletLeaves) {
+	if (node.isLeaf()) return;
+	if (node.triangles.size() >= PARALLEL_BUILD_MIN_TRIANGLES) {
+		auto left = std::async(std::launch::async, [&]() { restructureTreeletsRecursive(*node.leftChild, treeletLeaves); });
+		restructureTreeletsRecursive(*node.rightChild, treeletLeaves);
+		left.get();
+	}
+	else {
+		restructureTreeletsRecursive(*node.leftChild, treeletLeaves);
+		restructureTreeletsRecursive(*node.rightChild, treeletLeaves);
+	}
+	restructureTreelet(node, treeletLeaves);
+}
+
+void pah::Bvh::restructureTreelet(Node& node, int treeletLeaves) {
+	//form the treelet: starting from the children of node, keep replacing the leaf of the treelet with the highest hit probability with its children
+	//the treelet is not modified until we know that a better topology exists, so the leaves are the slots of their parents where they are stored
+	vector<unique_ptr<Node>*> leaves{ &node.leftChild, &node.rightChild };
+	array<float, MAX_TREELET_LEAVES> leavesHitProbabilities;
+	array<Aabb, 2> childrenAabbs{ node.leftChild->aabb, node.rightChild->aabb };
+	hitProbabilities(childrenAabbs, span{ leavesHitProbabilities }.first(2));
+	float currentCost = 0.0f; //cost of the internal nodes of the treelet, apart from its root
+	while (leaves.size() < treeletLeaves) {
+		int largest = -1;
+		for (int i = 0; i < leaves.size(); ++i) {
+			if (!(*leaves[i])->isLeaf() && (largest == -1 || leavesHitProbabilities[i] > leavesHitProbabilities[largest])) largest = i;
+		}
+		if (largest == -1) break; //all the leaves of the treelet are leaves of the Bvh
+
+		Node& expanded = **leaves[largest];
+		currentCost += leavesHitProbabilities[largest] * NODE_COST * 2.0f;
+		leaves[largest] = &expanded.leftChild;
+		leaves.push_back(&expanded.rightChild);
+		childrenAabbs = { expanded.leftChild->aabb, expanded.rightChild->aabb };
+		array<float, 2> childrenHitProbabilities;
+		hitProbabilities(childrenAabbs, childrenHitProbabilities);
+		leavesHitProbabilities[largest] = childrenHitProbabilities[0];
+		leavesHitProbabilities[leaves.size() - 1] = childrenHitProbabilities[1];
+	}
+	if (leaves.size() < 3) return; //there is only one topology
+
+	//each subset of the leaves is a bit mask: compute the bounds and hit probability of the node enclosing each subset
+	const int n = static_cast<int>(leaves.size());
+	const int subsets = 1 << n;
+	vector<Aabb> aabbs(subsets, Aabb::minAabb());
+	for (int s = 1; s < subsets; ++s) {
+		int lowest = std::countr_zero(static_cast<unsigned int>(s));
+		aabbs[s] = aabbs[s & (s - 1)];
+		aabbs[s] += (*leaves[lowest])->aabb;
+	}
+	vector<float> subsetsHitProbabilities(subsets);
+	hitProbabilities(aabbs, subsetsHitProbabilities);
+
+	//dynamic programming on the subsets, from the smallest: the cost of the leaves is the same in every topology, so only the internal nodes count
+	vector<float> costs(subsets, 0.0f);
+	vector<int> bestPartitions(subsets, 0);
+	for (int s = 1; s < subsets; ++s) {
+		if (std::popcount(static_cast<unsigned int>(s)) < 2) continue;
+		int lowest = s & -s;
+		float bestCost = numeric_limits<float>::max();
+		for (int p = (s - 1) & s; p > 0; p = (p - 1) & s) {
+			if ((p & lowest) == 0) continue; //each partition is considered once, as the side with the lowest leaf
+			if (float cost = costs[p] + costs[s ^ p]; cost < bestCost) {
+				bestCost = cost;
+				bestPartitions[s] = p;
+			}
+		}
+		costs[s] = bestCost + subsetsHitProbabilities[s] * NODE_COST * 2.0f;
+	}
+
+	//keep the current topology, unless the best one is cheaper (e.g. all the nodes outside of the influence area have the same PAH cost, so any topology would do)
+	const int all = subsets - 1;
+	if (costs[all] - subsetsHitProbabilities[all] * NODE_COST * 2.0f >= currentCost * (1.0f - TREELET_MIN_IMPROVEMENT)) return;
+
+	//rebuild the treelet from the best partitions: first take the ownership of the leaves, then the old internal nodes can be destroyed
+	vector<unique_ptr<Node>> ownedLeaves;
+	for (auto leaf : leaves) ownedLeaves.push_back(std::move(*leaf));
+	std::function<unique_ptr<Node>(int)> rebuild = [&](int s) {
+		if (std::popcount(static_cast<unsigned int>(s)) == 1) return std::move(ownedLeaves[std::countr_zero(static_cast<unsigned int>(s))]);
+		auto internal = make_unique<Node>(aabbs[s]);
+		internal->leftChild = rebuild(bestPartitions[s]);
+		internal->rightChild = rebuild(s ^ bestPartitions[s]);
+		gatherTriangles(*internal);
+		return internal;
+		};
+	node.leftChild = rebuild(bestPartitions[all]);
+	node.rightChild = rebuild(all ^ bestPartitions[all]);
+}
+
+void pah::Bvh::hitProbabilities(std::span<const Aabb> aabbs, std::span<float> hitProbabilities) const {
+	if (computeCostBatch) {
+		vector<int> trianglesCounts(aabbs.size(), 1);
+		vector<ComputeCostReturnType> costs(aabbs.size());
+		computeCostBatch(aabbs, trianglesCounts, getNodesInfluenceArea(), rootMetric, costs);
+		for (int i = 0; i < aabbs.size(); ++i) hitProbabilities[i] = costs[i].hitProbability;
+		return;
+	}
+	for (int i = 0; i < aabbs.size(); ++i) hitProbabilities[i] = computeCost(Node{ aabbs[i] }, getNodesInfluenceArea(), rootMetric).hitProbability;
+}
+
+void pah::Bvh::gatherTriangles(Node& node) const {
+	node.triangles = node.leftChild->triangles;
+	node.triangles.insert(node.triangles.end(), node.rightChild->triangles.begin(), node.rightChild->triangles.end());
+	if (properties.maxSpatialSplitsDuplication > 0) { //after spatial splits, both children may have the same triangles
+		std::ranges::sort(node.triangles);
+		node.triangles.erase(std::unique(node.triangles.begin(), node.triangles.end()), node.triangles.end());
+	}
+}
+
+void pah::Bvh::insert(const Triangle& triangle) {
+	if (orientedNodesSpace) throw std::logic_error{ "Bvh::insert is not supported with oriented nodes." };
+	auto leaf = make_unique<Node>(vector<const Triangle*>{ &triangle });
+	if (root.triangles.empty()) {
+		root = std::move(*leaf);
+		//like in build, the metrics of the root normalize the hit probabilities; insert only compares them with each other, so any positive value works if the triangle has none (e.g. it is culled)
+		rootMetric = computeCost(root, getNodesInfluenceArea(), -1).area;
+		rootMetricFallback = computeCostFallback(root, getNodesInfluenceArea(), -1).area;
+		if (!(rootMetric > 0.0f)) rootMetric = 1.0f;
+		if (!(rootMetricFallback > 0.0f)) rootMetricFallback = 1.0f;
+		return;
+	}
+	const Aabb leafAabb = leaf->aabb;
+	float leafHitProbability;
+	hitProbabilities({ &leafAabb, 1 }, { &leafHitProbability, 1 });
+
+	//branch and bound search of the best sibling for the new leaf: the cost of a sibling is the cost of the new parent, plus how much its ancestors grow (inherited cost)
+	struct Candidate { Node* node; unique_ptr<Node>* slot; int parent; float inheritedCost; };
+	vector<Candidate> candidates{ { &root, nullptr, -1, 0.0f } };
+	priority_queue<pair<float, int>, vector<pair<float, int>>, greater<>> toVisit; //lowest bound first
+	toVisit.emplace(0.0f, 0);
+	float bestCost = numeric_limits<float>::max();
+	int best = 0;
+	while (!toVisit.empty()) {
+		auto [lowerBound, i] = toVisit.top();
+		toVisit.pop();
+		if (lowerBound >= bestCost) break;
+
+		Candidate candidate = candidates[i];
+		array<Aabb, 2> aabbs{ candidate.node->aabb, candidate.node->aabb };
+		aabbs[1] += leafAabb;
+		array<float, 2> aabbsHitProbabilities;
+		hitProbabilities(aabbs, aabbsHitProbabilities);
+		if (float cost = candidate.inheritedCost + aabbsHitProbabilities[1] * NODE_COST * 2.0f; cost < bestCost) {
+			bestCost = cost;
+			best = i;
+		}
+		if (candidate.node->isLeaf()) continue;
+
+		//the new parent of a descendant is at least as likely to be hit as the new leaf
+		float childrenInheritedCost = candidate.inheritedCost + (aabbsHitProbabilities[1] - aabbsHitProbabilities[0]) * NODE_COST * 2.0f;
+		float childrenLowerBound = childrenInheritedCost + leafHitProbability * NODE_COST * 2.0f;
+		if (childrenLowerBound >= bestCost) continue;
+		for (auto child : { &candidate.node->leftChild, &candidate.node->rightChild }) {
+			candidates.push_back({ child->get(), child, i, childrenInheritedCost });
+			toVisit.emplace(childrenLowerBound, static_cast<int>(candidates.size()) - 1);
+		}
+	}
+
+	//the new parent takes the place of the sibling
+	const Candidate& sibling = candidates[best];
+	Aabb parentAabb = sibling.node->aabb;
+	parentAabb += leafAabb;
+	if (sibling.slot == nullptr) {
+		Node parent{ parentAabb };
+		parent.leftChild = make_unique<Node>(std::move(root));
+		parent.rightChild = std::move(leaf);
+		gatherTriangles(parent);
+		root = std::move(parent);
+		return;
+	}
+	auto parent = make_unique<Node>(parentAabb);
+	parent->leftChild = std::move(*sibling.slot);
+	parent->rightChild = std::move(leaf);
+	gatherTriangles(*parent);
+	*sibling.slot = std::move(parent);
+
+	//refit the ancestors, from the bottom, and rotate them (rotations don't change the Aabb of the rotated node, so the path stays valid)
+	for (int i = sibling.parent; i != -1; i = candidates[i].parent) {
+		Node& ancestor = *candidates[i].node;
+		ancestor.aabb += leafAabb;
+		ancestor.triangles.push_back(&triangle);
+		ancestor.buildCost = -1.0f; //the subtree changed, so refit takes its current cost as the reference
+		rotate(ancestor);
+	}
+}
+
+bool pah::Bvh::remove(const Triangle& triangle) {
+	if (orientedNodesSpace) throw std::logic_error{ "Bvh::remove is not supported with oriented nodes." };
+	Aabb triangleAabb{ glm::min(triangle[0], glm::min(triangle[1], triangle[2])), glm::max(triangle[0], glm::max(triangle[1], triangle[2])) };
+	return removeRecursive(root, &triangle, triangleAabb);
+}
+
+bool pah::Bvh::removeRecursive(Node& node, const Triangle* triangle, const Aabb& triangleAabb) {
+	//after spatial splits, a triangle can be in more leaves, so every node overlapping it is visited
+	if (triangleAabb.min.x > node.aabb.max.x || triangleAabb.max.x < node.aabb.min.x ||
+		triangleAabb.min.y > node.aabb.max.y || triangleAabb.max.y < node.aabb.min.y ||
+		triangleAabb.min.z > node.aabb.max.z || triangleAabb.max.z < node.aabb.min.z) return false;
+
+	if (node.isLeaf()) {
+		if (std::erase(node.triangles, triangle) == 0) return false;
+		if (!node.triangles.empty()) node.aabb = node.aabb.intersection(Aabb{ node.triangles }); //the leaf may be clipped by a spatial split
+		node.buildCost = -1.0f;
+		return true;
+	}
+
+	bool removedLeft = removeRecursive(*node.leftChild, triangle, triangleAabb);
+	bool removedRight = removeRecursive(*node.rightChild, triangle, triangleAabb);
+	if (!removedLeft && !removedRight) return false;
+
+	//if a child is empty, its sibling takes the place of node
+	if (node.leftChild->triangles.empty() || node.rightChild->triangles.empty()) {
+		auto remaining = std::move(node.leftChild->triangles.empty() ? node.rightChild : node.leftChild);
+		node = std::move(*remaining);
+		return true;
+	}
+	node.aabb = node.leftChild->aabb;
+	node.aabb += node.rightChild->aabb;
+	std::erase(node.triangles, triangle);
+	node.buildCost = -1.0f;
+	rotate(node);
+	return true;
+}
+
+void pah::Bvh::rotate(Node& node) {
+	if (node.isLeaf()) return;
+
+	//a rotation swaps a child of node with a child of its sibling: the Aabb of the sibling changes, the one of node doesn't
+	struct Rotation { unique_ptr<Node>* child; Node* sibling; unique_ptr<Node>* grandchild; };
+	array<Rotation, 4> rotations;
+	array<Aabb, 6> aabbs; //the new Aabb of the sibling for each rotation, then the current Aabbs of the children
+	int count = 0;
+	for (auto [child, sibling] : { pair{ &node.leftChild, &node.rightChild }, pair{ &node.rightChild, &node.leftChild } }) {
+		if ((*sibling)->isLeaf()) continue;
+		for (auto [grandchild, otherGrandchild] : { pair{ &(*sibling)->leftChild, &(*sibling)->rightChild }, pair{ &(*sibling)->rightChild, &(*sibling)->leftChild } }) {
+			rotations[count] = { child, sibling->get(), grandchild };
+			aabbs[count] = (*child)->aabb;
+			aabbs[count] += (*otherGrandchild)->aabb;
+			count++;
+		}
+	}
+	if (count == 0) return;
+	aabbs[count] = node.leftChild->aabb;
+	aabbs[count + 1] = node.rightChild->aabb;
+	array<float, 6> aabbsHitProbabilities;
+	hitProbabilities(span{ aabbs }.first(count + 2), span{ aabbsHitProbabilities }.first(count + 2));
+
+	int best = -1;
+	float bestGain = 0.0f;
+	for (int r = 0; r < count; ++r) {
+		float current = rotations[r].sibling == node.leftChild.get() ? aabbsHitProbabilities[count] : aabbsHitProbabilities[count + 1];
+		if (float gain = current - aabbsHitProbabilities[r]; gain > current * TREELET_MIN_IMPROVEMENT && gain > bestGain) {
+			bestGain = gain;
+			best = r;
+		}
+	}
+	if (best == -1) return;
+
+	std::swap(*rotations[best].child, *rotations[best].grandchild);
+	rotations[best].sibling->aabb = aabbs[best];
+	rotations[best].sibling->buildCost = -1.0f;
+	gatherTriangles(*rotations[best].sibling);
+}
+
+pah::Bvh::RefitResults pah::Bvh::refit() {
+	RefitResults results{};
+	if (root.triangles.empty()) return results;
+	if (orientedNodesSpace) { //the nodes are built on copies of the triangles in ray space, which don't follow the original ones
+		auto triangles = orientedNodesSpace->originalTriangles;
+		build(triangles, rng());
+		results.rebuiltSubtrees = 1;
+		results.rebuiltTriangles = static_cast<int>(triangles.size());
+		lastRefitResults = results;
+		return results;
+	}
+
+	//the influence area may have moved too: the costs below are computed where it is now, and the subtrees are rebuilt for it
+	raySpaceBasis = raySpaceBinning && influenceArea != nullptr ? influenceArea->getRaySpaceBasis() : nullopt;
+	if (properties.lazyBuildLevels > 0) propagateLazyBuildCosts(root);
+	float buildCost = root.buildCost;
+	vector<pair<Node*, int>> degraded;
+	auto [cost, expectedCost] = refitRecursive(root, degraded, 1);
+	results.costGrowth = buildCost > 0.0f ? cost / buildCost - 1.0f : 0.0f;
+
+	//the degraded subtrees are disjoint, but they are rebuilt one at a time, because their seeds come from the random number generator of the Bvh
+	for (auto [node, level] : degraded) {
+		results.rebuiltTriangles += static_cast<int>(node->triangles.size());
+		rebuildSubtree(*node, level);
+	}
+	results.rebuiltSubtrees = static_cast<int>(degraded.size());
+	lastRefitResults = results;
+	return results;
+}
+
+std::pair<float, float> pah::Bvh::refitRecursive(Node& node, std::vector<std::pair<Node*, int>>& degraded, int currentLevel) {
+	float cost, expectedCost;
+	size_t firstDegraded = degraded.size(); //the subtrees of the descendants of node are after this one
+	if (node.isLeaf()) {
+		node.aabb = Aabb{ node.triangles }; //the leaf may have been clipped by a spatial split, but the triangles moved, so the clipped bounds are meaningless
+		cost = expectedCost = computeCost(node, getNodesInfluenceArea(), rootMetric).cost;
+	}
+	else {
+		pair<float, float> leftCosts, rightCosts;
+		if (node.triangles.size() >= PARALLEL_BUILD_MIN_TRIANGLES) {
+			vector<pair<Node*, int>> leftDegraded;
+			auto left = std::async(std::launch::async, [&]() { leftCosts = refitRecursive(*node.leftChild, leftDegraded, currentLevel + 1); });
+			rightCosts = refitRecursive(*node.rightChild, degraded, currentLevel + 1);
+			left.get();
+			degraded.insert(degraded.end(), leftDegraded.begin(), leftDegraded.end());
+		}
+		else {
+			leftCosts = refitRecursive(*node.leftChild, degraded, currentLevel + 1);
+			rightCosts = refitRecursive(*node.rightChild, degraded, currentLevel + 1);
+		}
+		node.aabb = node.leftChild->aabb;
+		node.aabb += node.rightChild->aabb;
+		float nodeCost = computeCost(node, getNodesInfluenceArea(), rootMetric).hitProbability * NODE_COST * 2.0f;
+		cost = nodeCost + leftCosts.first + rightCosts.first;
+		expectedCost = nodeCost + leftCosts.second + rightCosts.second;
+	}
+
+	if (node.buildCost < 0.0f) node.buildCost = cost; //the nodes created after the last build (e.g. by insert) start from their current cost
+	//the rebuilt descendants are compared with their cost when they were built, so that node is rebuilt only if its own levels got worse
+	else if (properties.maxRefitCostGrowth > 0.0f && !node.isLeaf() && expectedCost > node.buildCost * (1.0f + properties.maxRefitCostGrowth)) {
+		degraded.resize(firstDegraded); //rebuilding node rebuilds its descendants too
+		degraded.emplace_back(&node, currentLevel);
+		expectedCost = node.buildCost;
+	}
+	return { cost, expectedCost };
+}
+
+void pah::Bvh::rebuildSubtree(Node& node, int currentLevel) {
+	if (&node == &root) { //the root metric changed too
+		auto triangles = root.triangles;
+		build(triangles, rng());
+		return;
+	}
+
+	float hitProbability = computeCost(node, getNodesInfluenceArea(), rootMetric).hitProbability;
+	auto triangles = std::move(node.triangles);
+	node = Node{ triangles };
+	if (buildMode == BuildMode::TopDown) {
+		SplitState state{ mt19937{ rng() }, static_cast<int>(properties.maxSpatialSplitsDuplication * triangles.size()), properties.lazyBuildLevels > 0 ? properties.lazyBuildLevels : numeric_limits<int>::max() };
+		if (buildDeadline) buildBreadthFirst(node, hitProbability, currentLevel, state, *buildDeadline);
+		else splitNode(node, Axis::X, hitProbability, currentLevel, state);
+	}
+	else {
+		auto [codes, sortedTriangles] = sortByMortonCode(node.triangles);
+		buildLinearNode(node, codes, sortedTriangles, currentLevel);
+	}
+	if (treeletLeaves >= 3 && !buildDeadline) for (int i = 0; i < treeletIterations; ++i) restructureTreeletsRecursive(node, treeletLeaves);
+	updateBuildCosts(node);
+}
+
+float pah::Bvh::updateBuildCosts(Node& node) const {
+	if (node.isLeaf()) return node.buildCost = computeCost(node, getNodesInfluenceArea(), rootMetric).cost;
+
+	float leftCost, rightCost;
+	if (node.triangles.size() >= PARALLEL_BUILD_MIN_TRIANGLES) {
+		auto left = std::async(std::launch::async, [&]() { leftCost = updateBuildCosts(*node.leftChild); });
+		rightCost = updateBuildCosts(*node.rightChild);
+		left.get();
+	}
+	else {
+		leftCost = updateBuildCosts(*node.leftChild);
+		rightCost = updateBuildCosts(*node.rightChild);
+	}
+	return node.buildCost = computeCost(node, getNodesInfluenceArea(), rootMetric).hitProbability * NODE_COST * 2.0f + leftCost + rightCost;
+}
+
+float pah::Bvh::propagateLazyBuildCosts(Node& node) {
+	float change = node.lazySubtree ? std::exchange(node.lazySubtree->buildCostChange, 0.0f) : 0.0f; //already in the cost of node
+	if (node.isLeaf()) return change;
+
+	float childrenChange = propagateLazyBuildCosts(*node.leftChild) + propagateLazyBuildCosts(*node.rightChild);
+	if (node.buildCost >= 0.0f) node.buildCost += childrenChange;
+	return change + childrenChange;
+}
+
+void pah::Bvh::update(const std::vector<const Triangle*>& triangles) {
+	if (orientedNodesSpace) { //insert and remove don't support oriented nodes
+		build(triangles, rng());
+		lastRefitResults = { 0.0f, 1, static_cast<int>(triangles.size()) };
+		return;
+	}
+	refit(); //first, so that the nodes enclose the triangles to remove
+
+	auto current = root.triangles, updated = triangles;
+	std::ranges::sort(current);
+	std::ranges::sort(updated);
+	vector<const Triangle*> removed, added;
+	std::ranges::set_difference(current, updated, back_inserter(removed));
+	std::ranges::set_difference(updated, current, back_inserter(added));
+	if (removed.size() + added.size() > updated.size() * UPDATE_MAX_CHANGED_TRIANGLES) {
+		build(triangles, rng());
+		lastRefitResults.rebuiltSubtrees = 1;
+		lastRefitResults.rebuiltTriangles = static_cast<int>(triangles.size());
+		return;
+	}
+
+	for (auto t : removed) remove(*t);
+	for (auto t : added) insert(*t);
 }
 
 const pah::Bvh::Node& pah::Bvh::getRoot() const {
@@ -177,15 +947,191 @@ const pah::InfluenceArea* pah::Bvh::getInfluenceArea() const {
 	return influenceArea;
 }
 
+const pah::InfluenceArea* pah::Bvh::getNodesInfluenceArea() const {
+	return orientedNodesSpace ? orientedNodesSpace->influenceArea.get() : influenceArea;
+}
+
 INFO(const pah::DurationMs pah::Bvh::getTotalBuildTime() const {
 	return totalBuildTime;
 })
 
+const pah::Bvh::RefitResults& pah::Bvh::getLastRefitResults() const {
+	return lastRefitResults;
+}
+
 const pah::Bvh::Properties pah::Bvh::getProperties() const {
 	return properties;
 }
 
-pah::Bvh::ComputeCostReturnType pah::Bvh::computeCostWrapper(const Node& parent, const Node& node, const InfluenceArea* influenceArea, float rootArea, int level, bool forceDefault) {
+pah::Bvh::BinnedSplit pah::Bvh::findBestBinnedSplit(const Node& node, Axis axis, const std::function<ComputeCostBatchType>& computeCostBatch, float rootMetric, bool raySpace) const {
+	constexpr float MAX = numeric_limits<float>::max();
+	BinnedSplit best{ .found = false, .splittingPlanePosition = 0, .costLeft = { MAX,MAX,MAX }, .costRight = { MAX,MAX,MAX } };
+	const int bins = properties.bins;
+	const auto [min, max] = splittingBounds(node, axis, raySpace);
+	const float extent = max - min;
+	if (bins < 3 || extent <= 0) return best; //all the barycenters lie on the same plane: there is no way to separate them
+
+	//planePositions[i] is the plane between bin i-1 and bin i. They are computed exactly as in splitNode, so that the triangles end up in the same side
+	vector<float> planePositions(bins + 1);
+	for (int i = 1; i < bins; ++i) planePositions[i] = min + extent / bins * i;
+	planePositions[0] = -MAX; planePositions[bins] = MAX;
+
+	//bin the triangles by barycenter (see reference)
+	vector<Aabb> binsAabbs(bins, Aabb::minAabb());
+	vector<int> binsCounts(bins, 0);
+	TIME(TimeLogger timeLoggerSplitting{ [&timingInfo = node.nodeTimingInfo](DurationMs duration) { timingInfo.logSplitTriangles(duration); } };);
+	for (auto t : node.triangles) {
+		auto [bounds, center] = reference(node, *t);
+		float barycenter = splittingCoordinate(center, axis, raySpace);
+		int bin = glm::clamp(static_cast<int>((barycenter - min) / extent * bins), 0, bins - 1);
+		while (barycenter < planePositions[bin]) bin--; //fix the rounding errors of the division
+		while (barycenter >= planePositions[bin + 1]) bin++;
+		binsAabbs[bin] += bounds;
+		binsCounts[bin]++;
+	}
+	TIME(timeLoggerSplitting.stop(););
+
+	//sweep the bins from left to right and from right to left to find the children of each candidate plane (only the planes considered by splitNode, from 1 to bins - 2)
+	vector<Aabb> leftAabbs(bins), rightAabbs(bins);
+	vector<int> leftCounts(bins, 0), rightCounts(bins, 0);
+	Aabb accumulated = Aabb::minAabb(); int accumulatedCount = 0;
+	for (int i = 1; i < bins; ++i) {
+		accumulated += binsAabbs[i - 1]; accumulatedCount += binsCounts[i - 1];
+		leftAabbs[i] = accumulated; leftCounts[i] = accumulatedCount;
+	}
+	accumulated = Aabb::minAabb(); accumulatedCount = 0;
+	for (int i = bins - 1; i >= 1; --i) {
+		accumulated += binsAabbs[i]; accumulatedCount += binsCounts[i];
+		rightAabbs[i] = accumulated; rightCounts[i] = accumulatedCount;
+	}
+
+	//gather the valid candidates (triangles on both sides): first all the left children, then all the right ones
+	vector<int> candidates;
+	for (int i = 1; i < bins - 1; ++i) {
+		if (leftCounts[i] > 0 && rightCounts[i] > 0) candidates.push_back(i);
+	}
+	if (candidates.empty()) return best;
+	const int n = candidates.size();
+	vector<Aabb> aabbs(2 * n);
+	vector<int> trianglesCounts(2 * n);
+	for (int c = 0; c < n; ++c) {
+		aabbs[c] = leftAabbs[candidates[c]]; trianglesCounts[c] = leftCounts[candidates[c]];
+		aabbs[n + c] = rightAabbs[candidates[c]]; trianglesCounts[n + c] = rightCounts[candidates[c]];
+	}
+
+	vector<ComputeCostReturnType> costs(2 * n);
+	{
+		//each cost counts as one evaluation, like in computeCostWrapper
+		TIME(TimeLogger timeLogger{ [&](auto duration) { node.nodeTimingInfo.logComputeCost(duration, static_cast<int>(costs.size())); } };);
+		computeCostBatch(aabbs, trianglesCounts, getNodesInfluenceArea(), rootMetric, costs);
+	}
+
+	//keep the first best candidate, like the loop in splitNode does
+	for (int c = 0; c < n; ++c) {
+		if (costs[c].cost + costs[n + c].cost < best.costLeft.cost + best.costRight.cost) {
+			best = { .found = true, .splittingPlanePosition = planePositions[candidates[c]], .costLeft = costs[c], .costRight = costs[n + c] };
+		}
+	}
+	return best;
+}
+
+pah::Bvh::SpatialSplit pah::Bvh::findBestSpatialSplit(const Node& node, Axis axis, const std::function<ComputeCostBatchType>& computeCostBatch, float rootMetric, int spatialSplitsReferencesLeft) const {
+	constexpr float MAX = numeric_limits<float>::max();
+	SpatialSplit best{ .found = false, .splittingPlanePosition = 0, .costLeft = { MAX,MAX,MAX }, .costRight = { MAX,MAX,MAX }, .leftAabb = Aabb::minAabb(), .rightAabb = Aabb::minAabb(), .duplicatedReferences = 0 };
+	const int bins = properties.bins, a = static_cast<int>(axis);
+	const float min = at(node.aabb.min, axis), extent = at(node.aabb.max, axis) - min;
+	if (bins < 3 || extent <= 0) return best;
+
+	//planePositions[i] is the plane between bin i-1 and bin i, like in findBestBinnedSplit
+	vector<float> planePositions(bins + 1);
+	for (int i = 1; i < bins; ++i) planePositions[i] = min + extent / bins * i;
+	planePositions[0] = -MAX; planePositions[bins] = MAX;
+	auto binOf = [&](float coordinate) {
+		int bin = glm::clamp(static_cast<int>((coordinate - min) / extent * bins), 0, bins - 1);
+		while (coordinate < planePositions[bin]) bin--; //fix the rounding errors of the division
+		while (coordinate >= planePositions[bin + 1]) bin++;
+		return bin;
+	};
+
+	//clip each triangle to the bins it overlaps, and count the bins where triangles start (entries) and end (exits)
+	vector<Aabb> binsAabbs(bins, Aabb::minAabb());
+	vector<int> entries(bins, 0), exits(bins, 0);
+	TIME(TimeLogger timeLoggerSplitting{ [&timingInfo = node.nodeTimingInfo](DurationMs duration) { timingInfo.logSplitTriangles(duration); } };);
+	for (auto t : node.triangles) {
+		Aabb bounds = reference(node, *t).first;
+		int first = binOf(at(bounds.min, axis));
+		int last = binOf(at(bounds.max, axis));
+		entries[first]++;
+		exits[last]++;
+		for (int bin = first; bin <= last; ++bin) {
+			Aabb binAabb = node.aabb;
+			binAabb.min[a] = glm::max(binAabb.min[a], planePositions[bin]);
+			binAabb.max[a] = glm::min(binAabb.max[a], planePositions[bin + 1]);
+			binsAabbs[bin] += binAabb.clip(*t);
+		}
+	}
+	TIME(timeLoggerSplitting.stop(););
+
+	//sweep the bins: the left child of plane i has the triangles entering before it, the right one the triangles exiting after it
+	vector<Aabb> leftAabbs(bins), rightAabbs(bins);
+	vector<int> leftCounts(bins, 0), rightCounts(bins, 0);
+	Aabb accumulated = Aabb::minAabb(); int accumulatedCount = 0;
+	for (int i = 1; i < bins; ++i) {
+		accumulated += binsAabbs[i - 1]; accumulatedCount += entries[i - 1];
+		leftAabbs[i] = accumulated; leftCounts[i] = accumulatedCount;
+	}
+	accumulated = Aabb::minAabb(); accumulatedCount = 0;
+	for (int i = bins - 1; i >= 1; --i) {
+		accumulated += binsAabbs[i]; accumulatedCount += exits[i];
+		rightAabbs[i] = accumulated; rightCounts[i] = accumulatedCount;
+	}
+
+	//gather the valid candidates: both children must have fewer triangles than the node (else we might get stuck), non empty bounds, and they must fit in the duplication budget
+	const int trianglesCount = node.triangles.size();
+	auto isEmpty = [](const Aabb& aabb) { return aabb.min.x > aabb.max.x || aabb.min.y > aabb.max.y || aabb.min.z > aabb.max.z; };
+	vector<int> candidates;
+	for (int i = 1; i < bins - 1; ++i) {
+		if (leftCounts[i] > 0 && rightCounts[i] > 0 && leftCounts[i] < trianglesCount && rightCounts[i] < trianglesCount &&
+			!isEmpty(leftAabbs[i]) && !isEmpty(rightAabbs[i]) &&
+			leftCounts[i] + rightCounts[i] - trianglesCount <= spatialSplitsReferencesLeft) candidates.push_back(i);
+	}
+	if (candidates.empty()) return best;
+	const int n = candidates.size();
+	vector<Aabb> aabbs(2 * n);
+	vector<int> trianglesCounts(2 * n);
+	for (int c = 0; c < n; ++c) {
+		aabbs[c] = leftAabbs[candidates[c]]; trianglesCounts[c] = leftCounts[candidates[c]];
+		aabbs[n + c] = rightAabbs[candidates[c]]; trianglesCounts[n + c] = rightCounts[candidates[c]];
+	}
+
+	vector<ComputeCostReturnType> costs(2 * n);
+	{
+		TIME(TimeLogger timeLogger{ [&](auto duration) { node.nodeTimingInfo.logComputeCost(duration, static_cast<int>(costs.size())); } };);
+		computeCostBatch(aabbs, trianglesCounts, getNodesInfluenceArea(), rootMetric, costs);
+	}
+
+	for (int c = 0; c < n; ++c) {
+		if (costs[c].cost + costs[n + c].cost < best.costLeft.cost + best.costRight.cost) {
+			int i = candidates[c];
+			best = { .found = true, .splittingPlanePosition = planePositions[i], .costLeft = costs[c], .costRight = costs[n + c], .leftAabb = aabbs[c], .rightAabb = aabbs[n + c], .duplicatedReferences = leftCounts[i] + rightCounts[i] - trianglesCount };
+		}
+	}
+	return best;
+}
+
+std::pair<float, float> pah::Bvh::splittingBounds(const Node& node, Axis axis, bool raySpace) const {
+	if (!raySpace) return { at(node.aabb.min, axis), at(node.aabb.max, axis) };
+	//the bounds of the rotated Aabb: each component of the row contributes its min along the corresponding world axis
+	float min = 0, max = 0;
+	for (int c = 0; c < 3; ++c) {
+		float a = (*raySpaceBasis)[c][static_cast<int>(axis)] * node.aabb.min[c], b = (*raySpaceBasis)[c][static_cast<int>(axis)] * node.aabb.max[c];
+		min += glm::min(a, b);
+		max += glm::max(a, b);
+	}
+	return { min, max };
+}
+
+pah::Bvh::ComputeCostReturnType pah::Bvh::computeCostWrapper(const Node& parent, const Node& node, const InfluenceArea* influenceArea, float rootArea, int level, bool forceDefault) const {
 	//the final action simply adds the measured time to the total compute cost time, and increases the compute cost counter
 	TIME(TimeLogger timeLogger{ [&timingInfo = parent.nodeTimingInfo](auto duration) { timingInfo.logComputeCost(duration); } };);
 	if (forceDefault || level > properties.maxNonFallbackLevels) return computeCostFallback(node, influenceArea, rootArea);
@@ -193,7 +1139,7 @@ pah::Bvh::ComputeCostReturnType pah::Bvh::computeCostWrapper(const Node& parent,
 	//here timeLogger will be destroyed, and it will log (by calling finalAction)
 }
 
-pah::Bvh::ChooseSplittingPlanesReturnType pah::Bvh::chooseSplittingPlanesWrapper(const Node& node, const InfluenceArea* influenceArea, Axis axis, mt19937& rng, int level, bool forceDefault) {
+pah::Bvh::ChooseSplittingPlanesReturnType pah::Bvh::chooseSplittingPlanesWrapper(const Node& node, const InfluenceArea* influenceArea, Axis axis, mt19937& rng, int level, bool forceDefault) const {
 	//the final action simply adds the measured time to the total choose splitting plane time, and increases the choose splitting plane counter
 	TIME(TimeLogger timeLogger{ [&timingInfo = node.nodeTimingInfo](auto duration) { timingInfo.logChooseSplittingPlanes(duration); } };);
 	if (forceDefault || level > properties.maxNonFallbackLevels) return chooseSplittingPlanesFallback(node, influenceArea, axis, rng);
@@ -201,7 +1147,7 @@ pah::Bvh::ChooseSplittingPlanesReturnType pah::Bvh::chooseSplittingPlanesWrapper
 	//here timeLogger will be destroyed, and it will log (by calling finalAction)
 }
 
-pah::Bvh::ShouldStopReturnType pah::Bvh::shouldStopWrapper(const Node& parent, const Node& node, const Properties& properties, int currentLevel, const ComputeCostReturnType& nodeCost, int level, bool forceDefault) {
+pah::Bvh::ShouldStopReturnType pah::Bvh::shouldStopWrapper(const Node& parent, const Node& node, const Properties& properties, int currentLevel, const ComputeCostReturnType& nodeCost, int level, bool forceDefault) const {
 	//the final action simply adds the measured time to the total should stop time, and increases the should stop counter
 	TIME(TimeLogger timeLogger{ [&timingInfo = parent.nodeTimingInfo](auto duration) { timingInfo.logShouldStop(duration); } };);
 	if (forceDefault || level > properties.maxNonFallbackLevels) return shouldStopFallback(node, properties, currentLevel, nodeCost);
@@ -210,8 +1156,13 @@ pah::Bvh::ShouldStopReturnType pah::Bvh::shouldStopWrapper(const Node& parent, c
 }
 
 
-void pah::Bvh::setFallbackComputeCostStrategy(ComputeCostType computeCostFallback) {
+void pah::Bvh::setComputeCostBatchStrategy(ComputeCostBatchType computeCostBatch) {
+	this->computeCostBatch = computeCostBatch;
+}
+
+void pah::Bvh::setFallbackComputeCostStrategy(ComputeCostType computeCostFallback, ComputeCostBatchType computeCostBatchFallback) {
 	this->computeCostFallback = computeCostFallback;
+	this->computeCostBatchFallback = computeCostBatchFallback; //if it is nullptr, the batched evaluation is disabled for the fallback strategy
 }
 
 void pah::Bvh::setFallbackChooseSplittingPlaneStrategy(ChooseSplittingPlanesType chooseSplittingPlaneFallback) {
@@ -221,3 +1172,21 @@ void pah::Bvh::setFallbackChooseSplittingPlaneStrategy(ChooseSplittingPlanesType
 void pah::Bvh::setFallbackShouldStopStrategy(ShouldStopType shouldStopFallback) {
 	this->shouldStopFallback = shouldStopFallback;
 }
+
+void pah::Bvh::setRaySpaceBinning(bool raySpaceBinning) {
+	this->raySpaceBinning = raySpaceBinning;
+}
+
+void pah::Bvh::setOrientedNodes(bool orientedNodes) {
+	this->orientedNodes = orientedNodes;
+}
+
+void pah::Bvh::setBuildMode(BuildMode buildMode) {
+	this->buildMode = buildMode;
+}
+
+void pah::Bvh::setTreeletRestructuring(int treeletLeaves, int iterations) {
+	if (treeletLeaves > MAX_TREELET_LEAVES) throw std::invalid_argument{ "Treelets can have at most " + std::to_string(MAX_TREELET_LEAVES) + " leaves" };
+	this->treeletLeaves = treeletLeaves;
+	this->treeletIterations = iterations;
+}
@@ -7,6 +7,8 @@
 #include <array>
 #include <algorithm>
 #include <random>
+#include <span>
+#include <mutex>
 
 #include "Utilities.h"
 #include "InfluenceArea.h"
@@ -51,9 +53,12 @@ namespace pah {
 				splittingTot = duration;
 			}
 
-			void logComputeCost(DurationMs duration) {
+			/**
+			 * @brief Logs @p count cost evaluations, which took @p duration in total (a batch evaluates many of them at once).
+			 */
+			void logComputeCost(DurationMs duration, int count = 1) {
 				computeCostTot += duration;
-				computeCostCount++;
+				computeCostCount += count;
 			}
 
 			void logSplitTriangles(DurationMs duration) {
@@ -115,6 +120,37 @@ namespace pah {
 			}
 		};
 
+		/**
+		 * @brief State of a top down construction that changes while the nodes are split (see @p splitNode).
+		 * Each subtree built lazily has its own (see @p Properties::lazyBuildLevels), so that concurrent traversals can build different subtrees at the same time.
+		 */
+		struct SplitState {
+			std::mt19937 rng;
+			int spatialSplitsReferencesLeft; /**< How many triangle references spatial splits can still add. */
+			int lastBuiltLevel; /**< The children of the nodes at this level are left unbuilt (see @p LazySubtree). */
+		};
+
+		/**
+		 * @brief The arguments to split a @p Node whose subtree was left unbuilt (see @p Properties::lazyBuildLevels).
+		 */
+		struct LazySubtree {
+			Axis fatherSplittingAxis;
+			float fatherHitProbability;
+			int level;
+			bool fallbackSubtree;
+			SplitState state;
+			mutable std::once_flag built; //the subtree is built by the first traversal that reaches it, the others wait for it
+			float buildCostChange = 0.0f; //how much the build cost of the node changed when its subtree was built, not yet added to its ancestors (see @p Bvh::propagateLazyBuildCosts)
+
+			LazySubtree(Axis fatherSplittingAxis, float fatherHitProbability, int level, bool fallbackSubtree, SplitState state) :
+				fatherSplittingAxis{ fatherSplittingAxis }, fatherHitProbability{ fatherHitProbability }, level{ level }, fallbackSubtree{ fallbackSubtree }, state{ std::move(state) } {
+			}
+
+			LazySubtree(const LazySubtree& orig) : LazySubtree{ orig.fatherSplittingAxis, orig.fatherHitProbability, orig.level, orig.fallbackSubtree, orig.state } {
+				buildCostChange = orig.buildCostChange;
+			}
+		};
+
 		/**
 		 * @brief Node of a @p Bvh.
 		 */
@@ -123,6 +159,9 @@ namespace pah {
 			std::unique_ptr<Node> leftChild;
 			std::unique_ptr<Node> rightChild;
 			std::vector<const Triangle*> triangles;
+			float buildCost = -1.0f; /**< The cost of the subtree of this @p Node when it was built, according to the compute cost strategy. It is negative if unknown (see @p Bvh::refit). */
+			std::unique_ptr<LazySubtree> lazySubtree; /**< If set, the subtree of this @p Node is built the first time a traversal reaches it (see @p Properties::lazyBuildLevels). Until then, the @p Node is a leaf. */
+			bool refinable = false; /**< Whether the subtree of this @p Node was built linearly, because a build with a time budget ran out of time (see @p Bvh::refine). */
 			TIME(mutable NodeTimingInfo nodeTimingInfo;)
 
 			/**
@@ -147,6 +186,9 @@ namespace pah {
 			Node(const Node& orig) :
 				aabb{ orig.aabb },
 				triangles{ orig.triangles },
+				buildCost{ orig.buildCost },
+				lazySubtree{ orig.lazySubtree != nullptr && orig.isLeaf() ? new LazySubtree(*orig.lazySubtree) : nullptr }, //once built, the copied children are enough
+				refinable{ orig.refinable },
 				TIME(nodeTimingInfo{ orig.nodeTimingInfo }),
 				leftChild{ orig.leftChild != nullptr ? new Node(*orig.leftChild) : nullptr },
 				rightChild{ orig.rightChild != nullptr ? new Node(*orig.rightChild) : nullptr } {
@@ -155,6 +197,9 @@ namespace pah {
 			Node& operator=(const Node& orig) {
 				aabb = orig.aabb;
 				triangles = orig.triangles;
+				buildCost = orig.buildCost;
+				lazySubtree = orig.lazySubtree != nullptr && orig.isLeaf() ? std::make_unique<LazySubtree>(*orig.lazySubtree) : nullptr;
+				refinable = orig.refinable;
 				TIME(nodeTimingInfo = orig.nodeTimingInfo);
 				leftChild = orig.leftChild != nullptr ? std::make_unique<Node>(*orig.leftChild) : nullptr;
 				rightChild = orig.rightChild != nullptr ? std::make_unique<Node>(*orig.rightChild) : nullptr;
@@ -164,6 +209,9 @@ namespace pah {
 			Node(Node&& orig) :
 				aabb{ std::move(orig.aabb) },
 				triangles{ std::move(orig.triangles) },
+				buildCost{ orig.buildCost },
+				lazySubtree{ std::move(orig.lazySubtree) },
+				refinable{ orig.refinable },
 				TIME(nodeTimingInfo{ std::move(orig.nodeTimingInfo) }),
 				leftChild{ std::move(orig.leftChild) },
 				rightChild{ std::move(orig.rightChild) } {
@@ -172,6 +220,9 @@ namespace pah {
 			Node& operator=(Node&& orig) {
 				aabb = std::move(orig.aabb);
 				triangles = std::move(orig.triangles);
+				buildCost = orig.buildCost;
+				lazySubtree = std::move(orig.lazySubtree);
+				refinable = orig.refinable;
 				TIME(nodeTimingInfo = std::move(orig.nodeTimingInfo));
 				leftChild = std::move(orig.leftChild);
 				rightChild = std::move(orig.rightChild);
@@ -186,6 +237,15 @@ namespace pah {
 			}
 		};
 
+		/**
+		 * @brief How @p build creates the hierarchy of the @p Bvh.
+		 */
+		enum class BuildMode {
+			TopDown, /**< The nodes are split recursively by the strategies (see @p splitNode). */
+			Linear, /**< Linear BVH: the triangles are sorted along a Morton curve, and each node is split where the highest bit of their Morton codes changes. It only uses @p Properties::maxTrianglesPerLeaf and @p Properties::maxLevels, so it is much faster but the @p Bvh is worse (see @p setTreeletRestructuring). */
+			Agglomerative /**< Bottom-up, locally-ordered clustering (PLOC): the clusters are sorted along a Morton curve, and each cluster is merged with its nearest one within @p Properties::agglomerativeSearchRadius positions, if they are both the nearest of each other. The distance is the hit probability of the merged node, according to the compute cost strategy. */
+		};
+
 		/**
 		 * @brief Info about the results of a traversal of the @p Bvh of a @p Ray.
 		 */
@@ -204,6 +264,15 @@ namespace pah {
 			}
 		};
 
+		/**
+		 * @brief Info about the results of a @p Bvh::refit.
+		 */
+		struct RefitResults {
+			float costGrowth; /**< How much the cost of the @p Bvh grew since it was built, relative to that cost (e.g. 0.3 means 30% more expensive), before rebuilding any subtree. */
+			int rebuiltSubtrees;
+			int rebuiltTriangles;
+		};
+
 		/**
 		 * @brief Properties used to build the @p Bvh.
 		 */
@@ -218,12 +287,21 @@ namespace pah {
 			float splitPlaneQualityThreshold;
 			float acceptableChildrenFatherHitProbabilityRatio;
 			float excellentChildrenFatherHitProbabilityRatio;
+			float minNonFallbackHitProbability = 0.0f; /**< Nodes with a hit probability (e.g. projected area relative to the root) lower than this use the fallback strategies for their whole subtree. */
+			int minNonFallbackTriangles = 0; /**< Nodes with fewer triangles than this use the fallback strategies for their whole subtree. */
+			float maxSpatialSplitsDuplication = 0.0f; /**< How many triangle references spatial splits can add, relative to the number of triangles of the @p Bvh. 0 disables spatial splits. */
+			float minSpatialSplitOverlap = 0.01f; /**< Spatial splits of a @p Node are only tried if the overlap of the children of its best object split has at least this hit probability. */
+			int agglomerativeSearchRadius = 16; /**< With @p BuildMode::Agglomerative, how many clusters before and after each one along the Morton curve are candidates to be merged with it. */
+			float maxRefitCostGrowth = 0.0f; /**< @p refit rebuilds the subtrees whose cost grew by more than this fraction of their cost when they were built. 0 disables the rebuilds. */
+			int lazyBuildLevels = 0; /**< With @p BuildMode::TopDown, @p build only splits the nodes up to this level: the subtrees below are built the first time a traversal reaches them (see @p traverse). 0 disables lazy construction. */
 		};
 
 		//custom alias
 		using ComputeCostReturnType = struct { float cost, hitProbability, area; };		using ComputeCostType = ComputeCostReturnType(const Node&, const InfluenceArea*, float rootMetric);
 		using ChooseSplittingPlanesReturnType = std::vector<std::pair<Axis, float>>;	using ChooseSplittingPlanesType = ChooseSplittingPlanesReturnType(const Node&, const InfluenceArea*, Axis father, std::mt19937& rng);
 		using ShouldStopReturnType = bool;												using ShouldStopType = ShouldStopReturnType(const Node&, const Properties&, int currentLevel, const ComputeCostReturnType& nodeCost);
+		//evaluates the cost of many candidate leaves at once, described by their Aabb and number of triangles. It must give the same results of the corresponding ComputeCostType for leaf nodes
+		using ComputeCostBatchType = void(std::span<const Aabb> aabbs, std::span<const int> trianglesCounts, const InfluenceArea*, float rootMetric, std::span<ComputeCostReturnType> costs);
 
 
 		Bvh(const Properties&, const InfluenceArea&, ComputeCostType computeCost, ChooseSplittingPlanesType chooseSplittingPlanes, ShouldStopType shouldStop, std::string name);
@@ -240,9 +318,14 @@ namespace pah {
 		}
 
 		/**
-		 * @brief Changes the fallback compute cost strategy.
+		 * @brief Sets the batched version of the compute cost strategy. If set, the candidate splits of a node are binned in a single pass over its triangles, and their costs are evaluated all at once.
+		 * It must be the batched counterpart of the compute cost strategy passed to the constructor (e.g. @p bvhStrategies::computeCostPahBatch for @p bvhStrategies::computeCostPah).
 		 */
-		void setFallbackComputeCostStrategy(ComputeCostType computeCostFallback);
+		void setComputeCostBatchStrategy(ComputeCostBatchType computeCostBatch);
+		/**
+		 * @brief Changes the fallback compute cost strategy, and optionally its batched version (see @p setComputeCostBatchStrategy).
+		 */
+		void setFallbackComputeCostStrategy(ComputeCostType computeCostFallback, ComputeCostBatchType computeCostBatchFallback = nullptr);
 		/**
 		 * @brief Changes the fallback choose splitting plane strategy.
 		 */
@@ -251,6 +334,29 @@ namespace pah {
 		 * @brief Changes the fallback should stop strategy.
 		 */
 		void setFallbackShouldStopStrategy(ShouldStopType shouldStopFallback);
+		/**
+		 * @brief If enabled, and the @p InfluenceArea has a ray space (see @p InfluenceArea::getRaySpaceBasis), the splitting planes of the nodes built with the non-fallback strategies are perpendicular to the axes of the ray space, not to the world axes.
+		 * e.g. for a @p PlaneInfluenceArea, X and Y are the axes of the projection plane, and Z is the direction of the rays.
+		 * The nodes are still world space @p Aabb s, which fit oblique ray space splits loosely: for planes far from the world axes, world space splits usually give a cheaper @p Bvh, unless the nodes are oriented too (see @p setOrientedNodes).
+		 */
+		void setRaySpaceBinning(bool raySpaceBinning);
+		/**
+		 * @brief If enabled, and the @p InfluenceArea has a ray space (see @p InfluenceArea::getRaySpaceBasis), the nodes are oriented bounding boxes aligned to the ray space.
+		 * They are stored as @p Aabb s in ray space: the @p Bvh is built on a copy of the triangles transformed to ray space, against @p InfluenceArea::createRaySpaceInfluenceArea, and each @p Ray is transformed once before traversing it.
+		 * Therefore the boxes and the triangles of the nodes are in ray space (see @p getNodesInfluenceArea), while the triangles hit by @p traverse are the original ones.
+		 */
+		void setOrientedNodes(bool orientedNodes);
+		/**
+		 * @brief Changes how the hierarchy is created (see @p BuildMode). The default is @p BuildMode::TopDown.
+		 */
+		void setBuildMode(BuildMode buildMode);
+		/**
+		 * @brief If @p treeletLeaves is at least 3, after each build the @p Bvh is optimized by @p iterations passes of treelet restructuring.
+		 * Going from the leaves to the root, the descendants of each node with the highest hit probability are expanded until there are @p treeletLeaves of them, then the topology of the nodes above them is replaced with the one with the lowest cost, according to the compute cost strategy.
+		 * It is mostly useful to recover the quality lost by @p BuildMode::Linear. @p treeletLeaves can be at most @p MAX_TREELET_LEAVES, since the cost grows as 3^treeletLeaves.
+		 */
+		void setTreeletRestructuring(int treeletLeaves, int iterations = 1);
+		static constexpr int MAX_TREELET_LEAVES = 8;
 
 		/**
 		 * @brief Constructs the @p Bvh on a set of triangles. The seed for the random operations during the construction is random.
@@ -270,33 +376,236 @@ namespace pah {
 		void build(const std::vector<Triangle>& triangles, unsigned int seed);
 		void build(const std::vector<const Triangle*>& triangles, unsigned int seed);
 
+		/**
+		 * @brief Constructs the @p Bvh on a set of triangles within the time @p budget: when it is over, the @p Bvh is always complete. The seed for the random operations during the construction is random.
+		 * With @p BuildMode::TopDown the nodes are split breadth first, so the top levels, which are traversed by most rays, are built by the strategies. When the time is over, the subtrees left are built as linear BVHs (see @p BuildMode::Linear), which is much faster, and they can be improved later by @p refine.
+		 * The time is checked between the nodes, so the budget is exceeded by the time to split one node and to build the subtrees left linearly. Other build modes ignore the budget. @p Properties::lazyBuildLevels and treelet restructuring are not applied.
+		 */
+		void build(const std::vector<Triangle>& triangles, DurationMs budget);
+		void build(const std::vector<const Triangle*>& triangles, DurationMs budget);
+
+		/**
+		 * @brief Rebuilds with the strategies the subtrees that the last build with a time budget had to build linearly, largest first, until @p budget is over. Returns how many of them are left.
+		 * The subtrees are rebuilt breadth first too, so when the time is over, their lower levels are built linearly again, and they are left for the next call. Calling it between frames, a @p Bvh built under a tight budget gets as good as a complete build.
+		 * Like @p refit, it must not be called while the @p Bvh is being traversed.
+		 */
+		int refine(DurationMs budget);
+
+		/**
+		 * @brief Optimizes the @p Bvh, already built, by @p iterations passes of treelet restructuring (see @p setTreeletRestructuring), under its compute cost strategy (e.g. PAH for a PAH @p Bvh).
+		 * The treelets of different subtrees are disjoint, so large subtrees are restructured in parallel. Then @p Node::buildCost is updated, so the cost of the root never increases.
+		 */
+		void restructureTreelets(int treeletLeaves, int iterations = 1);
+
+		/**
+		 * @brief Inserts @p triangle in the @p Bvh without rebuilding it. The @p Bvh can also be empty, or never built. @p triangle must outlive the @p Bvh.
+		 * The new leaf becomes the sibling of the node that minimizes the increase of the cost of the @p Bvh, according to the compute cost strategy (e.g. the increase of the projected areas for a PAH @p Bvh), found by branch and bound.
+		 * Then the nodes on the path to the root are refitted, and rotated if it lowers their cost (see @p rotate).
+		 * It is not supported with oriented nodes (see @p setOrientedNodes).
+		 */
+		void insert(const Triangle& triangle);
+		/**
+		 * @brief Removes @p triangle from the @p Bvh, without rebuilding it. Returns false if @p triangle is not in the @p Bvh.
+		 * Leaves that become empty are removed, and their ancestors are refitted and rotated (see @p rotate).
+		 * It is not supported with oriented nodes (see @p setOrientedNodes).
+		 */
+		bool remove(const Triangle& triangle);
+
+		/**
+		 * @brief Updates the @p Bvh, already built, after the vertices of its triangles moved (e.g. animated geometry), keeping its topology: the @p Aabb s of the nodes are recomputed from the leaves to the root, large subtrees in parallel.
+		 * Moving triangles make the @p Bvh worse, so the cost of each subtree is compared to its cost when it was built: the highest subtrees whose cost grew by more than @p Properties::maxRefitCostGrowth are rebuilt (the whole @p Bvh if the root did).
+		 * The costs are computed with the compute cost strategy, so a PAH @p Bvh is rebuilt when it gets worse for the rays of its @p InfluenceArea, not when it gets worse on average. For the same reason, the @p InfluenceArea can move too, and the subtrees that got worse for its new position are rebuilt.
+		 * With oriented nodes (see @p setOrientedNodes) the nodes are built on copies of the triangles, so the @p Bvh is always rebuilt.
+		 */
+		RefitResults refit();
+		/**
+		 * @brief Updates the @p Bvh, already built, so that it contains @p triangles, after the vertices of its triangles moved (see @p refit).
+		 * The triangles that are not in the @p Bvh anymore are removed, and the new ones are inserted (see @p remove and @p insert), unless they are so many that it is better to rebuild the whole @p Bvh.
+		 */
+		void update(const std::vector<const Triangle*>& triangles);
+
 		/**
 		 * @brief Traverses the @p Bvh and returns some stats about the traversal.
+		 * The unbuilt subtrees reached by the ray are built first (see @p Properties::lazyBuildLevels): each of them is built exactly once, even if many threads traverse the @p Bvh at the same time.
 		 */
 		TraversalResults traverse(const Ray& ray) const;
 
 
 		const Node& getRoot() const; /**< @brief Returns the root of the @p Bvh. */
 		const InfluenceArea* getInfluenceArea() const; /**< @brief Returns the @p InfluenceArea of the @p Bvh. */
+		const InfluenceArea* getNodesInfluenceArea() const; /**< @brief Returns the @p InfluenceArea of the @p Bvh in the space of its nodes, to be used with their @p Aabb s. It is the same as @p getInfluenceArea, unless the nodes are oriented (see @p setOrientedNodes). */
 		INFO(const DurationMs getTotalBuildTime() const;); /**< @brief Returns the time it took to build this @p Bvh. */
 		const Properties getProperties() const; /**< @brief Returns the properties of this @p Bvh. */
+		const RefitResults& getLastRefitResults() const; /**< @brief Returns the results of the last @p refit or @p update. */
 
 		const std::string name;
 	private:
 		/**
 		 * @brief Given a @p Node, it splits it into 2 children according to the strategies set during @p Bvh construction.
 		 */
-		void splitNode(Node& node, Axis fatherSplittingAxis, float fatherHitProbability, int currentLevel);
+		void splitNode(Node& node, Axis fatherSplittingAxis, float fatherHitProbability, int currentLevel, SplitState& state, bool fallbackSubtree = false) const;
+
+		/**
+		 * @brief Builds the subtree of @p node, left unbuilt by @p splitNode (see @p Properties::lazyBuildLevels), unless another traversal already did.
+		 * It is const because it is called by @p traverse, but it only changes @p node and its new descendants (the tree is @p mutable for this reason).
+		 */
+		void buildLazySubtree(Node& node) const;
+
+		/**
+		 * @brief Builds the subtree of @p node, at level @p currentLevel, top down and breadth first, until @p deadline: each node is split by one level, and its children are queued. When the time is over, the subtrees left are built linearly (see @p build with a time budget).
+		 * At least @p node is split, so that @p refine always makes progress.
+		 */
+		void buildBreadthFirst(Node& node, float hitProbability, int currentLevel, SplitState& state, std::chrono::steady_clock::time_point deadline);
+
+		/**
+		 * @brief Returns whether the subtree of @p node should be built with the fallback strategies, because it is deep, or its projected area or triangle count are so small that the fallback strategies would make nearly the same choices, while being much cheaper.
+		 */
+		bool isFallbackNode(const Node& node, float hitProbability, int currentLevel) const;
+
+		/**
+		 * @brief Builds the subtree of @p node as a linear BVH (see @p BuildMode::Linear). @p triangles are the triangles of @p node sorted by Morton code, and @p codes are their codes.
+		 * Large subtrees are built in parallel.
+		 */
+		void buildLinearNode(Node& node, std::span<const unsigned int> codes, std::span<const Triangle* const> triangles, int currentLevel);
+
+		/**
+		 * @brief Builds the @p Bvh with @p BuildMode::Agglomerative. @p triangles are the triangles of the root sorted by Morton code.
+		 * The distances between the clusters, and the merges, are computed in parallel.
+		 */
+		void buildAgglomerative(const std::vector<const Triangle*>& triangles);
+
+		/**
+		 * @brief Applies treelet restructuring (see @p setTreeletRestructuring) to all the nodes of the subtree of @p node, children first.
+		 */
+		void restructureTreeletsRecursive(Node& node, int treeletLeaves);
+
+		/**
+		 * @brief Replaces the treelet rooted in @p node with the one with the lowest cost that has the same leaves (see @p setTreeletRestructuring).
+		 */
+		void restructureTreelet(Node& node, int treeletLeaves);
+
+		/**
+		 * @brief Computes the hit probabilities of many @p Aabb s with the compute cost strategy, at once if there is a batched one.
+		 */
+		void hitProbabilities(std::span<const Aabb> aabbs, std::span<float> hitProbabilities) const;
+
+		/**
+		 * @brief Sets the triangles of the internal @p node to the ones of its children.
+		 */
+		void gatherTriangles(Node& node) const;
+
+		/**
+		 * @brief Tries to swap each child of @p node with each child of its sibling, and applies the swap that lowers the hit probability of the sibling the most, if any.
+		 * The @p Aabb of @p node does not change, so rotations can be applied while going up from a modified node to the root.
+		 */
+		void rotate(Node& node);
+
+		/**
+		 * @brief Removes @p triangle from the subtree of @p node (see @p remove). Returns whether it was found.
+		 */
+		bool removeRecursive(Node& node, const Triangle* triangle, const Aabb& triangleAabb);
+
+		/**
+		 * @brief Refits the subtree of @p node (see @p refit), and adds to @p degraded its highest subtrees (with their levels) that should be rebuilt.
+		 * Returns the cost of the refitted subtree, and its cost once the subtrees in @p degraded are rebuilt (estimated by their costs when they were built).
+		 */
+		std::pair<float, float> refitRecursive(Node& node, std::vector<std::pair<Node*, int>>& degraded, int currentLevel);
+
+		/**
+		 * @brief Rebuilds the subtree of @p node, at level @p currentLevel, from its triangles. Subtrees are always built top down or linearly, since agglomerative builds only work on the whole @p Bvh.
+		 */
+		void rebuildSubtree(Node& node, int currentLevel);
+
+		/**
+		 * @brief Sets @p Node::buildCost of all the nodes of the subtree of @p node, and returns the one of @p node.
+		 */
+		float updateBuildCosts(Node& node) const;
+
+		/**
+		 * @brief Adds to @p Node::buildCost of the ancestors of the lazy subtrees built since the last call the change of the cost of those subtrees (see @p buildLazySubtree), so that @p refit compares the whole @p Bvh against its cost after they were built. Returns the change of the cost of @p node.
+		 */
+		float propagateLazyBuildCosts(Node& node);
+
+		static constexpr float UPDATE_MAX_CHANGED_TRIANGLES = 0.5f; //if update has to insert or remove more triangles than this fraction of the new ones, it rebuilds the Bvh
+		static constexpr float TREELET_MIN_IMPROVEMENT = 0.00001f; //a treelet is restructured only if its cost decreases by at least this fraction
+		static constexpr int PARALLEL_BUILD_MIN_TRIANGLES = 4096; //subtrees with fewer triangles than this are not worth a new task when they are built or restructured in parallel
 
 		//simple wrappers for the custom functions. We use wrappers because there may be some common actions to perform before (e.g. time logging)
-		ComputeCostReturnType computeCostWrapper(const Node& parent, const Node& node, const InfluenceArea* influenceArea, float rootArea, int level, bool forceSah = false);
-		ChooseSplittingPlanesReturnType chooseSplittingPlanesWrapper(const Node& node, const InfluenceArea* influenceArea, Axis axis, std::mt19937& rng, int level, bool forceSah = false);
-		ShouldStopReturnType shouldStopWrapper(const Node& parent, const Node& node, const Properties& properties, int currentLevel, const ComputeCostReturnType& nodeCost, int level, bool forceSah = false);
+		ComputeCostReturnType computeCostWrapper(const Node& parent, const Node& node, const InfluenceArea* influenceArea, float rootArea, int level, bool forceSah = false) const;
+		ChooseSplittingPlanesReturnType chooseSplittingPlanesWrapper(const Node& node, const InfluenceArea* influenceArea, Axis axis, std::mt19937& rng, int level, bool forceSah = false) const;
+		ShouldStopReturnType shouldStopWrapper(const Node& parent, const Node& node, const Properties& properties, int currentLevel, const ComputeCostReturnType& nodeCost, int level, bool forceSah = false) const;
+
+		/**
+		 * @brief Result of @p findBestBinnedSplit: the position of the best splitting plane and the costs of the 2 children (@p found is false if no bin separates the triangles).
+		 */
+		struct BinnedSplit {
+			bool found;
+			float splittingPlanePosition;
+			ComputeCostReturnType costLeft, costRight;
+		};
+
+		/**
+		 * @brief Evaluates all the splitting planes of the bins along @p axis, without creating the children nodes.
+		 * Triangles are binned by barycenter in a single pass, then the bounds of the left and right children are obtained by sweeping the bins, and their costs are computed with a single call to @p computeCostBatch.
+		 */
+		BinnedSplit findBestBinnedSplit(const Node& node, Axis axis, const std::function<ComputeCostBatchType>& computeCostBatch, float rootMetric, bool raySpace) const;
+
+		/**
+		 * @brief Result of @p findBestSpatialSplit: like @p BinnedSplit, plus the bounds of the children, which are tighter than the bounds of their triangles, since the triangles crossing the splitting plane are clipped.
+		 */
+		struct SpatialSplit {
+			bool found;
+			float splittingPlanePosition;
+			ComputeCostReturnType costLeft, costRight;
+			Aabb leftAabb, rightAabb;
+			int duplicatedReferences; //how many triangles end up in both children
+		};
+
+		/**
+		 * @brief Evaluates the spatial splits along @p axis (see @p Properties::maxSpatialSplitsDuplication): the triangles crossing a splitting plane are referenced by both children, which are clipped to the plane.
+		 * Each triangle is clipped to the bins it overlaps, then the bins are swept and the candidates are evaluated with a single call to @p computeCostBatch, like in @p findBestBinnedSplit.
+		 * Only the candidates that fit in the remaining duplication budget, @p spatialSplitsReferencesLeft, are considered.
+		 */
+		SpatialSplit findBestSpatialSplit(const Node& node, Axis axis, const std::function<ComputeCostBatchType>& computeCostBatch, float rootMetric, int spatialSplitsReferencesLeft) const;
+
+		/**
+		 * @brief Returns the coordinate of @p point along @p axis, in ray space if @p raySpace is true (see @p setRaySpaceBinning), else in world space.
+		 */
+		float splittingCoordinate(const Vector3& point, Axis axis, bool raySpace) const {
+			if (!raySpace) return utilities::at(point, axis);
+			int row = static_cast<int>(axis);
+			return (*raySpaceBasis)[0][row] * point.x + (*raySpaceBasis)[1][row] * point.y + (*raySpaceBasis)[2][row] * point.z;
+		}
+
+		/**
+		 * @brief Returns the min and max coordinates (see @p splittingCoordinate) of the @p Aabb of @p node along @p axis.
+		 */
+		std::pair<float, float> splittingBounds(const Node& node, Axis axis, bool raySpace) const;
+
+		/**
+		 * @brief Returns the bounds of the part of @p triangle inside @p node, and the point used to sort it into bins (its barycenter, or the center of the bounds if it sticks out of @p node).
+		 * Triangles only stick out of the nodes below a spatial split, so this is cheap when there are none.
+		 */
+		static std::pair<Aabb, Vector3> reference(const Node& node, const Triangle& triangle) {
+			Aabb bounds{ glm::min(triangle[0], glm::min(triangle[1], triangle[2])), glm::max(triangle[0], glm::max(triangle[1], triangle[2])) };
+			if (node.aabb.fullyContains(bounds)) return { bounds, triangle.barycenter() };
+			bounds = node.aabb.clip(triangle);
+			return { bounds, bounds.center() };
+		}
+
+		/**
+		 * @brief Returns the @p Aabb enclosing the parts of @p triangles inside @p node (see @p reference).
+		 */
+		static Aabb referencesBounds(const Node& node, const std::vector<const Triangle*>& triangles) {
+			Aabb bounds = Aabb::minAabb();
+			for (auto t : triangles) bounds += reference(node, *t).first;
+			return bounds;
+		}
 
 		/**
 		 * @brief Given a list of triangles, an axis and a position on this axis, returns 2 sets of triangles, the ones "to the left" of the plane, and the ones "to the right".
 		 */
-		static std::tuple<std::vector<const Triangle*>, std::vector<const Triangle*>> splitTriangles(const Node& node, const std::vector<const Triangle*>& triangles, Axis axis, float splittingPlanePosition) {
+		std::tuple<std::vector<const Triangle*>, std::vector<const Triangle*>> splitTriangles(const Node& node, const std::vector<const Triangle*>& triangles, Axis axis, float splittingPlanePosition, bool raySpace) const {
 			using namespace utilities;
 			//the final action simply adds the measured time to the total split triangles time, and increases the split triangles counter
 			TIME(TimeLogger timeLogger{ [&timingInfo = node.nodeTimingInfo](DurationMs duration) { timingInfo.splitTrianglesTot += duration; timingInfo.splitTrianglesCount++; } };);
@@ -304,22 +613,60 @@ namespace pah {
 			std::vector<const Triangle*> left, right;
 
 			for (auto t : triangles) {
-				if (at(t->barycenter(), axis) < splittingPlanePosition) left.push_back(t);
+				if (splittingCoordinate(reference(node, *t).second, axis, raySpace) < splittingPlanePosition) left.push_back(t);
 				else right.push_back(t);
 			}
 
 			return { left, right };
 		}
+
+		/**
+		 * @brief Given a list of triangles, an axis and a position on this axis, returns the triangles overlapping each side of the plane (see @p findBestSpatialSplit). Triangles crossing the plane are in both sets.
+		 */
+		static std::tuple<std::vector<const Triangle*>, std::vector<const Triangle*>> splitTrianglesSpatial(const Node& node, const std::vector<const Triangle*>& triangles, Axis axis, float splittingPlanePosition) {
+			using namespace utilities;
+			TIME(TimeLogger timeLogger{ [&timingInfo = node.nodeTimingInfo](DurationMs duration) { timingInfo.splitTrianglesTot += duration; timingInfo.splitTrianglesCount++; } };);
+
+			std::vector<const Triangle*> left, right;
+
+			for (auto t : triangles) {
+				Aabb bounds = reference(node, *t).first;
+				if (at(bounds.min, axis) < splittingPlanePosition) left.push_back(t);
+				if (at(bounds.max, axis) >= splittingPlanePosition) right.push_back(t);
+			}
+
+			return { left, right };
+		}
 		
-		Node root;
+		mutable Node root; //mutable because traverse builds the lazy subtrees (see Properties::lazyBuildLevels)
 		float rootMetric; //stores the cost metric of the root (e.g. surface area if we use SAH, projected area if we use PAH, ...)
 		float rootMetricFallback; 
 		Properties properties;
 		const InfluenceArea* influenceArea;
+		bool raySpaceBinning = false;
+		std::optional<Matrix3> raySpaceBasis; //the ray space used by this build, if raySpaceBinning is enabled and the influence area has one
+
+		/**
+		 * @brief The space of the nodes of a @p Bvh with oriented nodes (see @p setOrientedNodes).
+		 */
+		struct OrientedNodesSpace {
+			Matrix3 basis; //from world space to the space of the nodes
+			std::unique_ptr<InfluenceArea> influenceArea; //the influence area in the space of the nodes
+			std::vector<Triangle> triangles; //the triangles in the space of the nodes
+			std::vector<const Triangle*> originalTriangles; //originalTriangles[i] is triangles[i] in world space
+		};
+		bool orientedNodes = false;
+		BuildMode buildMode = BuildMode::TopDown;
+		int treeletLeaves = 0; //how many leaves the treelets of treelet restructuring have, 0 to disable it
+		int treeletIterations = 0;
+		std::optional<std::chrono::steady_clock::time_point> buildDeadline; //set during a build with a time budget, and during refine
+		std::shared_ptr<const OrientedNodesSpace> orientedNodesSpace; //set by the last build, if orientedNodes is enabled and the influence area has a ray space. It is shared, so that copies of the Bvh point to the same triangles
 
 		//customizable functions
 		std::function<ComputeCostType> computeCost;
 		std::function<ComputeCostType> computeCostFallback;
+		std::function<ComputeCostBatchType> computeCostBatch; //optional, if set it is used in place of computeCost to evaluate the splits
+		std::function<ComputeCostBatchType> computeCostBatchFallback; //optional, if set it is used in place of computeCostFallback to evaluate the splits
 		//the idea is that this function returns a list of suitable axis to try to subdivide the AABB into, and a set of corresponding predicates.
 		//these predicates take into account the "quality" of the axis, and the results obtained from previous axis; and they decide whether is it worth it to try the next axis
 		std::function<ChooseSplittingPlanesType> chooseSplittingPlanes;
@@ -329,6 +676,7 @@ namespace pah {
 
 		std::mt19937 rng; //random number generator
 		INFO(DurationMs totalBuildTime;); //total time of the last build
+		RefitResults lastRefitResults{}; //results of the last refit or update
 		unsigned long long int id; //id of this BVH: it is a cheap way to check if 2 BVHs are equal
 	};
 
@@ -375,12 +723,178 @@ namespace pah {
 			//this function is called with rootProjectedArea < 0 when we want to initialize it
 			if (rootProjectedArea < 0) return { influenceArea->getProjectionPlaneArea() * node.triangles.size() * cost, 1, influenceArea->getProjectionPlaneArea() };
 
-			float projectedArea = overlappingArea(ConvexHull2d{ influenceArea->getProjectedHull(node.aabb) }, ConvexHull2d{ influenceArea->getProjectionPlaneHull() });
+			float projectedArea = influenceArea->getCulledProjectedArea(node.aabb);
 			float hitProbability = glm::min(projectedArea / rootProjectedArea, 1.f);
 			return { hitProbability * node.triangles.size() * cost, hitProbability, projectedArea };
 		}
 
 
+		/**
+		 * @brief Computes the cost of the specified node of a @p Bvh whose @p InfluenceArea is a @p PointInfluenceArea, using as hit probability the ratio between the solid angle of the node (culled by the frustum) and the one of the frustum.
+		 * For other kinds of @p InfluenceArea it is the same as @p computeCostPahWithCulling.
+		 */
+		static Bvh::ComputeCostReturnType computeCostSolidAngle(const Bvh::Node& node, const InfluenceArea* influenceArea, float rootSolidAngle) {
+			const PointInfluenceArea* pointInfluenceArea = dynamic_cast<const PointInfluenceArea*>(influenceArea);
+			if (pointInfluenceArea == nullptr) return computeCostPahWithCulling(node, influenceArea, rootSolidAngle);
+
+			float cost = node.isLeaf() ? LEAF_COST : NODE_COST;
+			//this function is called with rootSolidAngle < 0 when we want to initialize it
+			if (rootSolidAngle < 0) return { pointInfluenceArea->getFrustumSolidAngle() * node.triangles.size() * cost, 1, pointInfluenceArea->getFrustumSolidAngle() };
+
+			float solidAngle = pointInfluenceArea->getCulledSolidAngle(node.aabb);
+			float hitProbability = glm::min(solidAngle / rootSolidAngle, 1.f);
+			return { hitProbability * node.triangles.size() * cost, hitProbability, solidAngle };
+		}
+
+		/**
+		 * @brief Like @p computeCostPahWithCulling, but the projected area is weighted by the ray density map of the @p InfluenceArea (see @p InfluenceArea::setDensityMap).
+		 * The hit probability is the fraction of rays of the map that hit the culled projected hull of the node. Without a density map it is the same as @p computeCostPahWithCulling.
+		 */
+		static Bvh::ComputeCostReturnType computeCostPahWithDensity(const Bvh::Node& node, const InfluenceArea* influenceArea, float rootDensity) {
+			float cost = node.isLeaf() ? LEAF_COST : NODE_COST;
+			//this function is called with rootDensity < 0 when we want to initialize it
+			if (rootDensity < 0) return { influenceArea->getProjectionPlaneDensity() * node.triangles.size() * cost, 1, influenceArea->getProjectionPlaneDensity() };
+
+			float density = influenceArea->getCulledProjectedDensity(node.aabb);
+			float hitProbability = glm::min(density / rootDensity, 1.f);
+			return { hitProbability * node.triangles.size() * cost, hitProbability, density };
+		}
+
+		/**
+		 * @brief Monte Carlo estimate of the hit probability: it is the fraction of the sample rays of the @p InfluenceArea (see @p InfluenceArea::setSampleRays) that hit the node.
+		 * It doesn't depend on the kind of distribution, and its cost is bounded by the number of samples.
+		 * Since no sample ray may hit small nodes, we add one pseudo-ray spread uniformly over the projection plane (i.e. the culled projected area relative to the projection plane), so that in these regions the strategy falls back to @p computeCostPahWithCulling.
+		 * Without sample rays it is the same as @p computeCostPahWithCulling.
+		 */
+		static Bvh::ComputeCostReturnType computeCostMonteCarlo(const Bvh::Node& node, const InfluenceArea* influenceArea, float rootHits) {
+			if (!influenceArea->getSampleRays()) return computeCostPahWithCulling(node, influenceArea, rootHits);
+
+			float cost = node.isLeaf() ? LEAF_COST : NODE_COST;
+			int hits;
+			influenceArea->countSampleRaysHits({ &node.aabb, 1 }, { &hits, 1 });
+			float estimatedHits = hits + influenceArea->getCulledProjectedArea(node.aabb) / influenceArea->getProjectionPlaneArea();
+			//this function is called with rootHits < 0 when we want to initialize it
+			if (rootHits < 0) return { estimatedHits * node.triangles.size() * cost, 1, estimatedHits };
+
+			float hitProbability = glm::min(estimatedHits / rootHits, 1.f);
+			return { hitProbability * node.triangles.size() * cost, hitProbability, estimatedHits };
+		}
+
+		/**
+		 * @brief Blends the hit probability of @p computeCostPahWithCulling with the one of @p computeCostSah, weighted by the off-distribution fraction of the @p InfluenceArea (see @p InfluenceArea::setOffDistributionFraction).
+		 * Rays that follow the distribution of the area hit a node with the PAH probability, the others are assumed to be uniformly distributed and hit it with the SAH probability, so a single @p Bvh can serve mixed traffic.
+		 * The root metric is the surface area of the root; the PAH term is relative to the projection plane, like in @p computeCostPahWithCulling.
+		 */
+		static Bvh::ComputeCostReturnType computeCostPahSahBlend(const Bvh::Node& node, const InfluenceArea* influenceArea, float rootSurfaceArea) {
+			float cost = node.isLeaf() ? LEAF_COST : NODE_COST;
+			float surfaceArea = node.aabb.surfaceArea();
+			//this function is called with rootSurfaceArea < 0 when we want to initialize it
+			if (rootSurfaceArea < 0) return { node.triangles.size() * cost, 1, surfaceArea };
+
+			float offDistributionFraction = influenceArea->getOffDistributionFraction();
+			float pahHitProbability = glm::min(influenceArea->getCulledProjectedArea(node.aabb) / influenceArea->getProjectionPlaneArea(), 1.f);
+			float sahHitProbability = glm::min(surfaceArea / rootSurfaceArea, 1.f);
+			float hitProbability = (1 - offDistributionFraction) * pahHitProbability + offDistributionFraction * sahHitProbability;
+			return { hitProbability * node.triangles.size() * cost, hitProbability, surfaceArea };
+		}
+
+		/**
+		 * @brief Batched version of @p computeCostSah.
+		 */
+		static void computeCostSahBatch(std::span<const Aabb> aabbs, std::span<const int> trianglesCounts, const InfluenceArea*, float rootArea, std::span<Bvh::ComputeCostReturnType> costs) {
+			for (int i = 0; i < aabbs.size(); ++i) {
+				float surfaceArea = aabbs[i].surfaceArea();
+				float hitProbability = glm::min(surfaceArea / rootArea, 1.0f);
+				costs[i] = { hitProbability * trianglesCounts[i] * LEAF_COST, hitProbability, surfaceArea };
+			}
+		}
+
+		/**
+		 * @brief Batched version of @p computeCostPah.
+		 */
+		static void computeCostPahBatch(std::span<const Aabb> aabbs, std::span<const int> trianglesCounts, const InfluenceArea* influenceArea, float rootProjectedArea, std::span<Bvh::ComputeCostReturnType> costs) {
+			std::vector<float> projectedAreas(aabbs.size());
+			influenceArea->getProjectedAreas(aabbs, projectedAreas);
+			for (int i = 0; i < aabbs.size(); ++i) {
+				float hitProbability = glm::min(projectedAreas[i] / rootProjectedArea, 1.f);
+				costs[i] = { hitProbability * trianglesCounts[i] * LEAF_COST, hitProbability, projectedAreas[i] };
+			}
+		}
+
+		/**
+		 * @brief Batched version of @p computeCostPahWithCulling.
+		 */
+		static void computeCostPahWithCullingBatch(std::span<const Aabb> aabbs, std::span<const int> trianglesCounts, const InfluenceArea* influenceArea, float rootProjectedArea, std::span<Bvh::ComputeCostReturnType> costs) {
+			std::vector<float> projectedAreas(aabbs.size());
+			influenceArea->getCulledProjectedAreas(aabbs, projectedAreas);
+			for (int i = 0; i < aabbs.size(); ++i) {
+				float hitProbability = glm::min(projectedAreas[i] / rootProjectedArea, 1.f);
+				costs[i] = { hitProbability * trianglesCounts[i] * LEAF_COST, hitProbability, projectedAreas[i] };
+			}
+		}
+
+
+		/**
+		 * @brief Batched version of @p computeCostPahWithDensity.
+		 */
+		static void computeCostPahWithDensityBatch(std::span<const Aabb> aabbs, std::span<const int> trianglesCounts, const InfluenceArea* influenceArea, float rootDensity, std::span<Bvh::ComputeCostReturnType> costs) {
+			for (int i = 0; i < aabbs.size(); ++i) {
+				float density = influenceArea->getCulledProjectedDensity(aabbs[i]);
+				float hitProbability = glm::min(density / rootDensity, 1.f);
+				costs[i] = { hitProbability * trianglesCounts[i] * LEAF_COST, hitProbability, density };
+			}
+		}
+
+		/**
+		 * @brief Batched version of @p computeCostMonteCarlo. The sample rays are tested against all the candidates at once.
+		 */
+		static void computeCostMonteCarloBatch(std::span<const Aabb> aabbs, std::span<const int> trianglesCounts, const InfluenceArea* influenceArea, float rootHits, std::span<Bvh::ComputeCostReturnType> costs) {
+			if (!influenceArea->getSampleRays()) return computeCostPahWithCullingBatch(aabbs, trianglesCounts, influenceArea, rootHits, costs);
+
+			std::vector<int> hits(aabbs.size());
+			std::vector<float> projectedAreas(aabbs.size());
+			influenceArea->countSampleRaysHits(aabbs, hits);
+			influenceArea->getCulledProjectedAreas(aabbs, projectedAreas);
+			float projectionPlaneArea = influenceArea->getProjectionPlaneArea();
+			for (int i = 0; i < aabbs.size(); ++i) {
+				float estimatedHits = hits[i] + projectedAreas[i] / projectionPlaneArea;
+				float hitProbability = glm::min(estimatedHits / rootHits, 1.f);
+				costs[i] = { hitProbability * trianglesCounts[i] * LEAF_COST, hitProbability, estimatedHits };
+			}
+		}
+
+		/**
+		 * @brief Batched version of @p computeCostPahSahBlend.
+		 */
+		static void computeCostPahSahBlendBatch(std::span<const Aabb> aabbs, std::span<const int> trianglesCounts, const InfluenceArea* influenceArea, float rootSurfaceArea, std::span<Bvh::ComputeCostReturnType> costs) {
+			std::vector<float> projectedAreas(aabbs.size());
+			influenceArea->getCulledProjectedAreas(aabbs, projectedAreas);
+			float offDistributionFraction = influenceArea->getOffDistributionFraction();
+			float projectionPlaneArea = influenceArea->getProjectionPlaneArea();
+			for (int i = 0; i < aabbs.size(); ++i) {
+				float surfaceArea = aabbs[i].surfaceArea();
+				float pahHitProbability = glm::min(projectedAreas[i] / projectionPlaneArea, 1.f);
+				float sahHitProbability = glm::min(surfaceArea / rootSurfaceArea, 1.f);
+				float hitProbability = (1 - offDistributionFraction) * pahHitProbability + offDistributionFraction * sahHitProbability;
+				costs[i] = { hitProbability * trianglesCounts[i] * LEAF_COST, hitProbability, surfaceArea };
+			}
+		}
+
+		/**
+		 * @brief Batched version of @p computeCostSolidAngle.
+		 */
+		static void computeCostSolidAngleBatch(std::span<const Aabb> aabbs, std::span<const int> trianglesCounts, const InfluenceArea* influenceArea, float rootSolidAngle, std::span<Bvh::ComputeCostReturnType> costs) {
+			const PointInfluenceArea* pointInfluenceArea = dynamic_cast<const PointInfluenceArea*>(influenceArea);
+			if (pointInfluenceArea == nullptr) return computeCostPahWithCullingBatch(aabbs, trianglesCounts, influenceArea, rootSolidAngle, costs);
+
+			for (int i = 0; i < aabbs.size(); ++i) {
+				float solidAngle = pointInfluenceArea->getCulledSolidAngle(aabbs[i]);
+				float hitProbability = glm::min(solidAngle / rootSolidAngle, 1.f);
+				costs[i] = { hitProbability * trianglesCounts[i] * LEAF_COST, hitProbability, solidAngle };
+			}
+		}
+
+
 		/**
 		 * @brief Given the @p Aabb, it returns an array where each element contains an axis and a function to evaluate.
 		 * Axis are sorted from longest to shortest. If an axis is too short, it is not incuded.
@@ -433,6 +947,25 @@ namespace pah {
 			return result;
 		}
 
+		/**
+		 * @brief Meant for a @p Bvh with ray-space binning (see @p Bvh::setRaySpaceBinning). It returns the X and Y axes of the ray space, sorted by the extent of the @p Node along them, with the same quality metric of @p chooseSplittingPlanesLongest.
+		 * Splitting along the direction of the rays (Z) barely changes the projected area of the children, so Z is returned last with quality 0: it is never tried, but if the splits along X and Y are not acceptable (see @p Bvh::Properties::acceptableChildrenFatherHitProbabilityRatio), the @p Bvh falls back to a world space split.
+		 * If the @p InfluenceArea has no ray space, it is the same as @p chooseSplittingPlanesLongest.
+		 */
+		static Bvh::ChooseSplittingPlanesReturnType chooseSplittingPlanesRaySpace(const Bvh::Node& node, const InfluenceArea* influenceArea, Axis father, std::mt19937& rng) {
+			using namespace std;
+
+			auto basis = influenceArea->getRaySpaceBasis();
+			if (!basis) return chooseSplittingPlanesLongest<0.f>(node, influenceArea, father, rng);
+
+			//extent of the Aabb along a row of the basis
+			Vector3 size = node.aabb.size();
+			auto extent = [&](int row) { return abs((*basis)[0][row]) * size.x + abs((*basis)[1][row]) * size.y + abs((*basis)[2][row]) * size.z; };
+			float x = extent(0), y = extent(1);
+			if (x >= y) return { {Axis::X, 1.0f}, {Axis::Y, y / x}, {Axis::Z, 0.0f} };
+			return { {Axis::Y, 1.0f}, {Axis::X, x / y}, {Axis::Z, 0.0f} };
+		}
+
 
 		/**
 		 * @brief Returns true if the max level has been passed or if the cost of the leaf is low enough.
@@ -32,6 +32,12 @@ void pah::to_json(json& j, const InfluenceArea& influenceArea) {
 		to_json(j["pointInfluenceArea"], pointInfluenceArea);
 		return;
 	} catch (const std::bad_cast&) { /* try next type */ }
+	try {
+		auto& multiInfluenceArea = dynamic_cast<const MultiInfluenceArea&>(influenceArea);
+		j["type"] = "multi";
+		to_json(j["multiInfluenceArea"], multiInfluenceArea);
+		return;
+	} catch (const std::bad_cast&) { /* try next type */ }
 	
 	throw std::invalid_argument{ "The run-time type of influenceArea cannot be handled by the to_json function." };
 }
@@ -50,6 +56,13 @@ void pah::to_json(json& j, const PointInfluenceArea& pointInfluenceArea) {
 	j["bvhRegion"] = pointInfluenceArea.getBvhRegion();
 }
 
+void pah::to_json(json& j, const MultiInfluenceArea& multiInfluenceArea) {
+	for (const auto& [influenceArea, weight] : multiInfluenceArea.getInfluenceAreas()) {
+		j["influenceAreas"] += json{ { "weight", weight }, { "influenceArea", *influenceArea } };
+	}
+	j["bvhRegion"] = multiInfluenceArea.getBvhRegion();
+}
+
 // ======| Regions |======
 void pah::to_json(json& j, const Region& region) {
 	//we try to cast to the actual type, and then call the proper function with the run-time type; if no cast works, we throw.
@@ -117,6 +130,19 @@ void pah::to_json(json& j, const pah::TopLevelOctree::Node& node) {
 	j["isLeaf"] = node.isLeaf();
 }
 
+void pah::to_json(json& j, const pah::TopLevelBsp::Node& node) {
+	j["id"] = (unsigned long long int) &node;
+	j["aabb"] = node.aabb;
+	if (!node.isLeaf()) j["splittingPlane"] = node.splittingPlane;
+	for (const auto& child : node.children) {
+		if (child != nullptr) j["children"] += (long long int) &*child;
+	}
+	for (const auto& bvhPtr : node.bvhs) {
+		j["bvhs"] += (long long int) bvhPtr;
+	}
+	j["isLeaf"] = node.isLeaf();
+}
+
 // ======| Utilities |======
 void pah::to_json(json& j, const Triangle& triangle) {
 	j["id"] = (unsigned long long int) &triangle;
@@ -174,6 +200,19 @@ void pah::to_json(json& j, const Bvh::Properties& properties) {
 	j["splitPlaneQualityThreshold"] = properties.splitPlaneQualityThreshold;
 	j["acceptableChildrenFatherHitProbabilityRatio"] = properties.acceptableChildrenFatherHitProbabilityRatio;
 	j["excellentChildrenFatherHitProbabilityRatio"] = properties.excellentChildrenFatherHitProbabilityRatio;
+	j["minNonFallbackHitProbability"] = properties.minNonFallbackHitProbability;
+	j["minNonFallbackTriangles"] = properties.minNonFallbackTriangles;
+	j["maxSpatialSplitsDuplication"] = properties.maxSpatialSplitsDuplication;
+	j["minSpatialSplitOverlap"] = properties.minSpatialSplitOverlap;
+	j["agglomerativeSearchRadius"] = properties.agglomerativeSearchRadius;
+	j["maxRefitCostGrowth"] = properties.maxRefitCostGrowth;
+	j["lazyBuildLevels"] = properties.lazyBuildLevels;
+}
+
+void pah::to_json(json& j, const Bvh::RefitResults& refitResults) {
+	j["costGrowth"] = refitResults.costGrowth;
+	j["rebuiltSubtrees"] = refitResults.rebuiltSubtrees;
+	j["rebuiltTriangles"] = refitResults.rebuiltTriangles;
 }
 
 void pah::to_json(json& j, const TopLevelOctree::OctreeProperties& properties) {
@@ -181,6 +220,11 @@ void pah::to_json(json& j, const TopLevelOctree::OctreeProperties& properties) {
 	j["maxLevel"] = properties.maxLevel;
 }
 
+void pah::to_json(json& j, const TopLevelBsp::BspProperties& properties) {
+	j["conservativeApproach"] = properties.conservativeApproach;
+	j["maxLevel"] = properties.maxLevel;
+}
+
 void pah::to_json(json& j, const CumulativeRayCasterResults& crcr) {
 	using namespace std;
 
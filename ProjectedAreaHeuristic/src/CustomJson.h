@@ -28,19 +28,23 @@ namespace pah {
 	void to_json(json& j, const InfluenceArea&);
 	void to_json(json& j, const PlaneInfluenceArea&);
 	void to_json(json& j, const PointInfluenceArea&);
+	void to_json(json& j, const MultiInfluenceArea&);
 	void to_json(json& j, const Region&);
 	void to_json(json& j, const Aabb&);
 	void to_json(json& j, const Obb&);
 	void to_json(json& j, const AabbForObb&);
 	void to_json(json& j, const Frustum&);
 	void to_json(json& j, const TopLevelOctree::Node&);
+	void to_json(json& j, const TopLevelBsp::Node&);
 	void to_json(json& j, const Plane&);
 	void to_json(json& j, const Pov&);
 	void to_json(json& j, const Triangle&);
 	void to_json(json& j, const Bvh::NodeTimingInfo&);
 	void to_json(json& j, const TopLevelOctree::NodeTimingInfo&);
 	void to_json(json& j, const Bvh::Properties&);
+	void to_json(json& j, const Bvh::RefitResults&);
 	void to_json(json& j, const TopLevelOctree::OctreeProperties&);
+	void to_json(json& j, const TopLevelBsp::BspProperties&);
 	void to_json(json& j, const CumulativeRayCasterResults&);
 
 	namespace projection {
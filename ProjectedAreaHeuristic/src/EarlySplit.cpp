@@ -0,0 +1,82 @@
+#include "EarlySplit.h"
+
+#include <queue>
+
+using namespace std;
+using namespace pah;
+
+
+// ======| EarlySplit |======
+pah::EarlySplit::EarlySplit(const std::vector<Triangle>& triangles, const Properties& properties) : properties{ properties }, splitTrianglesCount{ 0 } {
+	Aabb scene = Aabb::minAabb();
+	for (const auto& t : triangles) scene += Aabb{ glm::min(t[0], glm::min(t[1], t[2])), glm::max(t[0], glm::max(t[1], t[2])) };
+	float sceneArea = scene.surfaceArea();
+
+	split(triangles, [sceneArea](const Aabb& aabb) { return aabb.surfaceArea() / sceneArea; });
+}
+
+pah::EarlySplit::EarlySplit(const std::vector<Triangle>& triangles, const Properties& properties, const InfluenceArea& influenceArea) : properties{ properties }, splitTrianglesCount{ 0 } {
+	float planeArea = influenceArea.getProjectionPlaneArea();
+
+	split(triangles, [&influenceArea, planeArea](const Aabb& aabb) { return influenceArea.getProjectedArea(aabb) / planeArea; });
+}
+
+const std::vector<Triangle>& pah::EarlySplit::getTriangles() const {
+	return triangles;
+}
+
+const Triangle* pah::EarlySplit::getOriginal(const Triangle* fragment) const {
+	return originalTriangles[fragment - triangles.data()];
+}
+
+int pah::EarlySplit::getSplitTrianglesCount() const {
+	return splitTrianglesCount;
+}
+
+void pah::EarlySplit::split(const std::vector<Triangle>& originals, const std::function<float(const Aabb&)>& size) {
+	auto fragmentSize = [&size](const Triangle& t) {
+		return size(Aabb{ glm::min(t[0], glm::min(t[1], t[2])), glm::max(t[0], glm::max(t[1], t[2])) });
+		};
+
+	triangles.reserve(originals.size());
+	originalTriangles.reserve(originals.size());
+	priority_queue<pair<float, int>> toSplit; //largest fragment first
+	for (const auto& t : originals) {
+		triangles.push_back(t);
+		originalTriangles.push_back(&t);
+		float s = fragmentSize(t);
+		if (s > properties.maxRelativeSize) toSplit.emplace(s, static_cast<int>(triangles.size()) - 1);
+	}
+
+	vector<bool> isSplit(originals.size(), false);
+	int fragmentsLeft = static_cast<int>(properties.maxDuplication * originals.size());
+	while (!toSplit.empty() && fragmentsLeft > 0) {
+		int i = toSplit.top().second;
+		toSplit.pop();
+
+		//split the longest edge (a, b) in half: the 2 fragments share the new vertex and the opposite vertex c
+		const Triangle& t = triangles[i];
+		int longest = 0;
+		for (int e = 1; e < 3; ++e) {
+			if (glm::distance(t[e], t[(e + 1) % 3]) > glm::distance(t[longest], t[(longest + 1) % 3])) longest = e;
+		}
+		Vector3 a = t[longest], b = t[(longest + 1) % 3], c = t[(longest + 2) % 3];
+		Vector3 m = (a + b) * 0.5f;
+
+		triangles[i] = Triangle{ a, m, c };
+		triangles.emplace_back(m, b, c);
+		originalTriangles.push_back(originalTriangles[i]);
+		fragmentsLeft--;
+
+		auto original = originalTriangles[i] - originals.data();
+		if (!isSplit[original]) {
+			isSplit[original] = true;
+			splitTrianglesCount++;
+		}
+
+		for (int f : { i, static_cast<int>(triangles.size()) - 1 }) {
+			float s = fragmentSize(triangles[f]);
+			if (s > properties.maxRelativeSize) toSplit.emplace(s, f);
+		}
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+
+#include "Utilities.h"
+#include "Regions.h"
+#include "InfluenceArea.h"
+
+namespace pah {
+
+	/**
+	 * @brief Preprocessing pass that subdivides the triangles whose @p Aabb is large, before building a @p Bvh or a @p TopLevel on them (early split clipping).
+	 * Each large triangle is replaced by fragments, obtained by repeatedly splitting its longest edge in half: they cover the same surface, but with much tighter @p Aabb s, especially for skinny triangles that are not aligned to the axes.
+	 * The fragments are plain triangles, so the builders consume them unchanged: build on @p getTriangles, and use @p getOriginal to go from a fragment (e.g. the closest hit of a traversal) to the triangle it comes from.
+	 */
+	class EarlySplit {
+	public:
+		/**
+		 * @brief Properties used to split the triangles.
+		 */
+		struct Properties {
+			float maxRelativeSize; /**< Triangles are split until the surface area of their @p Aabb relative to the @p Aabb of the scene (or their projected area relative to the projection plane of the @p InfluenceArea) is at most this. */
+			float maxDuplication; /**< How many fragments can be added, relative to the number of triangles. The largest fragments are split first. */
+		};
+
+		/**
+		 * @brief Splits the triangles whose @p Aabb is large relative to the @p Aabb of the scene.
+		 * @p triangles must outlive this object, since the fragments point to them (see @p getOriginal).
+		 */
+		EarlySplit(const std::vector<Triangle>& triangles, const Properties& properties);
+		/**
+		 * @brief Splits the triangles whose @p Aabb has a large projected area relative to the projection plane of @p influenceArea.
+		 * @p triangles must outlive this object, since the fragments point to them (see @p getOriginal).
+		 */
+		EarlySplit(const std::vector<Triangle>& triangles, const Properties& properties, const InfluenceArea& influenceArea);
+
+		EarlySplit(const EarlySplit&) = delete;
+		EarlySplit& operator=(const EarlySplit&) = delete;
+
+		const std::vector<Triangle>& getTriangles() const; /**< @brief Returns the triangles to build on: the triangles that were not split and the fragments of the ones that were. */
+		const Triangle* getOriginal(const Triangle* fragment) const; /**< @brief Returns the triangle @p fragment comes from. @p fragment must be one of @p getTriangles. */
+		int getSplitTrianglesCount() const; /**< @brief Returns how many of the original triangles were split. */
+
+	private:
+		/**
+		 * @brief Splits the triangles in decreasing order of @p size, until all the fragments have size at most @p Properties::maxRelativeSize, or the duplication budget is over.
+		 */
+		void split(const std::vector<Triangle>& originalTriangles, const std::function<float(const Aabb&)>& size);
+
+		Properties properties;
+		std::vector<Triangle> triangles;
+		std::vector<const Triangle*> originalTriangles; //originalTriangles[i] is the triangle triangles[i] comes from
+		int splitTrianglesCount;
+	};
+}
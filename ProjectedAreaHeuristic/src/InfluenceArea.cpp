@@ -13,17 +13,93 @@ const pah::Region& pah::InfluenceArea::getBvhRegion() const {
 	return *bvhRegion;
 }
 
+void pah::InfluenceArea::setDensityMap(std::span<const Ray> rays, int columns, int rows) {
+	const auto& projectionPlaneHull = getProjectionPlaneHull();
+	densityMap.emplace(columns, rows, projectionPlaneHull[0], projectionPlaneHull[2]); //the hull starts from the bottom left corner and is counterclockwise
+	for (const auto& ray : rays) {
+		densityMap->addSample(projectRay(ray));
+	}
+	densityMap->buildSummedAreaTable();
+}
+
+const std::optional<pah::DensityMap>& pah::InfluenceArea::getDensityMap() const {
+	return densityMap;
+}
+
+float pah::InfluenceArea::getCulledProjectedDensity(const Aabb& aabb) const {
+	if (!densityMap) return getCulledProjectedArea(aabb);
+	return densityMap->integrate(getCulledProjectedHull(aabb));
+}
+
+float pah::InfluenceArea::getProjectionPlaneDensity() const {
+	if (!densityMap) return getProjectionPlaneArea();
+	return densityMap->total();
+}
+
+void pah::InfluenceArea::setSampleRays(std::span<const Ray> rays, int maxSamples) {
+	sampleRays.emplace(rays, maxSamples);
+}
+
+const std::optional<pah::SampleRays>& pah::InfluenceArea::getSampleRays() const {
+	return sampleRays;
+}
+
+void pah::InfluenceArea::countSampleRaysHits(std::span<const Aabb> aabbs, std::span<int> hitsCounts) const {
+	collisionDetection::countCollisions(*sampleRays, aabbs, hitsCounts);
+}
+
+void pah::InfluenceArea::setOffDistributionFraction(float offDistributionFraction) {
+	if (offDistributionFraction < 0 || offDistributionFraction > 1) throw invalid_argument{ "The off-distribution fraction must be in [0, 1]" };
+	this->offDistributionFraction = offDistributionFraction;
+}
+
+void pah::InfluenceArea::setOffDistributionFraction(std::span<const Ray> rays, float tolerance) {
+	if (rays.empty()) return setOffDistributionFraction(0.0f);
+	auto offDistributionRays = ranges::count_if(rays, [&](const Ray& ray) { return !bvhRegion->contains(ray.getOrigin()) || !isDirectionAffine(ray, tolerance); });
+	setOffDistributionFraction((float)offDistributionRays / rays.size());
+}
+
+float pah::InfluenceArea::getOffDistributionFraction() const {
+	return offDistributionFraction;
+}
+
+std::optional<pah::Matrix3> pah::InfluenceArea::getRaySpaceBasis() const {
+	return nullopt;
+}
+
+std::unique_ptr<pah::InfluenceArea> pah::InfluenceArea::createRaySpaceInfluenceArea() const {
+	return nullptr;
+}
+
+void pah::InfluenceArea::getProjectedAreas(std::span<const Aabb> aabbs, std::span<float> areas) const {
+	for (int i = 0; i < aabbs.size(); ++i) {
+		areas[i] = getProjectedArea(aabbs[i]);
+	}
+}
+
+void pah::InfluenceArea::getCulledProjectedAreas(std::span<const Aabb> aabbs, std::span<float> areas) const {
+	for (int i = 0; i < aabbs.size(); ++i) {
+		areas[i] = getCulledProjectedArea(aabbs[i]);
+	}
+}
+
 
 // ======| PlaneInfluenceArea |======
 pah::PlaneInfluenceArea::PlaneInfluenceArea(Plane plane, float forwardSize, float density)
 	: InfluenceArea{ make_unique<AabbForObb>(plane.getPoint() + plane.getNormal() * (forwardSize / 2.0f), Vector3{plane.width, plane.height, forwardSize / 2.0f}, plane.getNormal()) },
 	viewProjectionMatrix{ projection::computeViewMatrix(plane.getPoint(), plane.getNormal()) },
 	plane{ plane }, density{ density }, farPlane{ forwardSize } {
-	if constexpr (!FAST_ORTHOGRAPHIC_PROJECTIONS) viewProjectionMatrix *= projection::computeOrthographicMatrix(-plane.width, plane.width, -plane.height, plane.height);
+	if constexpr (!FAST_ORTHOGRAPHIC_PROJECTIONS) viewProjectionMatrix = projection::computeOrthographicMatrix(-plane.width, plane.width, -plane.height, plane.height) * viewProjectionMatrix; //first view, then projection
+	//the orthographic projection scales the plane to the canonical view volume, therefore areas are scaled by 1 / (width * height)
+	facesWeights = projection::orthographic::computeFacesWeights(plane.getNormal(), FAST_ORTHOGRAPHIC_PROJECTIONS ? 1.0f : 1.0f / (plane.width * plane.height));
 }
 
 float pah::PlaneInfluenceArea::getProjectedArea(const Aabb& aabb) const {
-	return projection::orthographic::computeProjectedArea(aabb, viewProjectionMatrix);
+	return projection::orthographic::computeProjectedAreaClosedForm(aabb, facesWeights);
+}
+
+void pah::PlaneInfluenceArea::getProjectedAreas(std::span<const Aabb> aabbs, std::span<float> areas) const {
+	projection::orthographic::computeProjectedAreasClosedForm(aabbs, facesWeights, areas);
 }
 
 std::vector<Vector2> pah::PlaneInfluenceArea::getProjectedHull(const Aabb& aabb) const {
@@ -31,6 +107,21 @@ std::vector<Vector2> pah::PlaneInfluenceArea::getProjectedHull(const Aabb& aabb)
 	return projection::orthographic::projectPoints(contourPoints, plane);
 }
 
+float pah::PlaneInfluenceArea::getCulledProjectedArea(const Aabb& aabb) const {
+	return getCulledProjectedHull(aabb).computeArea();
+}
+
+pah::FixedConvexHull2d<10> pah::PlaneInfluenceArea::getCulledProjectedHull(const Aabb& aabb) const {
+	if constexpr (!FAST_ORTHOGRAPHIC_PROJECTIONS) return projection::orthographic::projectContour(aabb, plane.getNormal(), viewProjectionMatrix).clipToRectangle({ -1.0f, -1.0f }, { 1.0f, 1.0f });
+	else {
+		projection::ProjectedContour contour{};
+		for (int index : projection::hullTable[projection::orthographic::findHullTableIndex(plane.getNormal())]) {
+			contour.push_back(projection::orthographic::projectPoint(aabb.getPoint(index), plane));
+		}
+		return contour.clipToRectangle({ -plane.width, -plane.height }, { plane.width, plane.height });
+	}
+}
+
 float pah::PlaneInfluenceArea::getInfluence(const Aabb& aabb) const {
 	return density;
 }
@@ -53,6 +144,31 @@ bool pah::PlaneInfluenceArea::isDirectionAffine(const Ray& ray, float tolerance)
 	return collisionDetection::almostParallel(ray.getDirection(), plane.getNormal(), tolerance);
 }
 
+Vector2 pah::PlaneInfluenceArea::projectRay(const Ray& ray) const {
+	//rays are parallel to the normal of the plane, so the origin is enough
+	if constexpr (!FAST_ORTHOGRAPHIC_PROJECTIONS) return projection::orthographic::projectPoint(ray.getOrigin(), viewProjectionMatrix);
+	else return projection::orthographic::projectPoint(ray.getOrigin(), plane);
+}
+
+std::optional<pah::Matrix3> pah::PlaneInfluenceArea::getRaySpaceBasis() const {
+	//the rotational part of the view matrix: its rows are the right, up and forward axes of the plane
+	return Matrix3{ projection::computeViewMatrix(plane.getPoint(), plane.getNormal()) };
+}
+
+std::unique_ptr<pah::InfluenceArea> pah::PlaneInfluenceArea::createRaySpaceInfluenceArea() const {
+	Matrix3 basis = *getRaySpaceBasis();
+	auto raySpaceInfluenceArea = make_unique<PlaneInfluenceArea>(Plane{ basis * plane.getPoint(), basis * plane.getNormal(), plane.width, plane.height }, farPlane, density);
+	//the right and up axes of the transformed plane are the same, therefore rays project to the same points, and the density map is still valid
+	raySpaceInfluenceArea->densityMap = densityMap;
+	raySpaceInfluenceArea->offDistributionFraction = offDistributionFraction;
+	if (sampleRays) {
+		vector<Ray> rays;
+		for (int i = 0; i < sampleRays->size(); ++i) rays.emplace_back(basis * sampleRays->origins[i], basis * (1.0f / sampleRays->inverseDirections[i]));
+		raySpaceInfluenceArea->sampleRays.emplace(rays);
+	}
+	return raySpaceInfluenceArea;
+}
+
 std::vector<std::tuple<pah::Axis, std::function<bool(float bestCostSoFar)>>> pah::PlaneInfluenceArea::bestSplittingPlanes() const {
 	throw logic_error("Function not implemented yet!");
 }
@@ -78,7 +194,10 @@ float pah::PlaneInfluenceArea::getDensity() const {
 
 // Look at the comment of PointInfluenceArea::planePatch to understand how we built it. The order of the point is such that it creates a counterclockwise rectangle.
 pah::PointInfluenceArea::PointInfluenceArea(Pov pov, float far, float near, float density)
-	: InfluenceArea{ make_unique<Frustum>(pov, far, near) }, pov{ pov }, density{ density }, nearPlane{ near }, farPlane{ far } {
+	: InfluenceArea{ make_unique<Frustum>(pov, far, near) }, pov{ pov }, density{ density }, nearPlane{ near }, farPlane{ far },
+	viewProjectionMatrix{ projection::computePerspectiveMatrix(far, near, { pov.fovX, pov.fovY }) * projection::computeViewMatrix(pov.position, pov.getDirection()) },
+	viewMatrix{ projection::computeViewMatrix(pov.position, pov.getDirection()) },
+	tanHalfFovs{ glm::tan(glm::radians(pov.fovX) / 2.0f), glm::tan(glm::radians(pov.fovY) / 2.0f) } {
 }
 
 float pah::PointInfluenceArea::getProjectedArea(const Aabb& aabb) const
@@ -87,12 +206,22 @@ float pah::PointInfluenceArea::getProjectedArea(const Aabb& aabb) const
 	//indeed the projected area should approximate the number of rays that hit the AABB, but by projecting it to the near plane, objects far from the z axis tend to get distorted.
 	//basically we want the solid angle.
 	//Pov centeredPov{ pov.position, aabb.center() - pov.position, pov.fovX, pov.fovY };
-	return projection::perspective::computeProjectedArea(aabb, pov);
+	const auto& contour = projection::perspective::projectContour(aabb, pov.position, viewProjectionMatrix);
+	return contour.size() == 0 ? 1000.0f : contour.computeArea(); //same convention of projection::perspective::computeProjectedArea when the pov is inside the aabb
 }
 
 std::vector<Vector2> pah::PointInfluenceArea::getProjectedHull(const Aabb& aabb) const {
 	const auto& contourPoints = projection::perspective::findContourPoints(aabb, pov.position);
-	return projection::perspective::projectPoints(contourPoints, pov);
+	return projection::perspective::projectPoints(contourPoints, viewProjectionMatrix);
+}
+
+float pah::PointInfluenceArea::getCulledProjectedArea(const Aabb& aabb) const {
+	//if the pov is inside the aabb the contour is empty, same as intersecting an empty hull
+	return getCulledProjectedHull(aabb).computeArea();
+}
+
+pah::FixedConvexHull2d<10> pah::PointInfluenceArea::getCulledProjectedHull(const Aabb& aabb) const {
+	return projection::perspective::projectContour(aabb, pov.position, viewProjectionMatrix).clipToRectangle({ -1.0f, -1.0f }, { 1.0f, 1.0f });
 }
 
 float pah::PointInfluenceArea::getInfluence(const Aabb& aabb) const{
@@ -119,10 +248,23 @@ bool pah::PointInfluenceArea::isDirectionAffine(const Ray& ray, float tolerance)
 	return collisionDetection::almostParallel(ray.getDirection(), povOriginDirection, tolerance);
 }
 
+Vector2 pah::PointInfluenceArea::projectRay(const Ray& ray) const {
+	//rays leave the pov, so the direction is enough
+	return projection::perspective::projectPoint(pov.position + ray.getDirection(), viewProjectionMatrix);
+}
+
 std::vector<std::tuple<Axis, std::function<bool(float bestCostSoFar)>>> pah::PointInfluenceArea::bestSplittingPlanes() const{
 	throw logic_error("Function not implemented yet!");
 }
 
+float pah::PointInfluenceArea::getCulledSolidAngle(const Aabb& aabb) const {
+	return projection::perspective::computeCulledSolidAngle(aabb, pov.position, viewMatrix, tanHalfFovs);
+}
+
+float pah::PointInfluenceArea::getFrustumSolidAngle() const {
+	return projection::perspective::computeFrustumSolidAngle(tanHalfFovs);
+}
+
 const pah::Pov& pah::PointInfluenceArea::getPov() const {
 	return pov;
 }
@@ -134,3 +276,116 @@ const std::pair<float, float> pah::PointInfluenceArea::getNearFar() const {
 float pah::PointInfluenceArea::getDensity() const {
 	return density;
 }
+
+
+// ======| MultiInfluenceArea |======
+//returns the Aabb enclosing the regions of all the influence areas
+static unique_ptr<Region> enclosingRegion(const vector<MultiInfluenceArea::WeightedInfluenceArea>& influenceAreas) {
+	if (influenceAreas.empty()) throw invalid_argument{ "A MultiInfluenceArea needs at least one influence area" };
+	Aabb enclosingAabb = influenceAreas[0].influenceArea->getBvhRegion().enclosingAabb();
+	for (const auto& [influenceArea, weight] : influenceAreas) {
+		enclosingAabb += influenceArea->getBvhRegion().enclosingAabb();
+	}
+	return make_unique<Aabb>(enclosingAabb);
+}
+
+pah::MultiInfluenceArea::MultiInfluenceArea(std::vector<WeightedInfluenceArea> influenceAreas)
+	: InfluenceArea{ enclosingRegion(influenceAreas) }, influenceAreas{ std::move(influenceAreas) } {
+	float totalWeight = 0;
+	for (const auto& [influenceArea, weight] : this->influenceAreas) {
+		if (weight < 0) throw invalid_argument{ "The weights of a MultiInfluenceArea must be >= 0" };
+		totalWeight += weight;
+	}
+	if (totalWeight <= 0) throw invalid_argument{ "The weights of a MultiInfluenceArea cannot be all 0" };
+	for (auto& weightedInfluenceArea : this->influenceAreas) {
+		weightedInfluenceArea.weight /= totalWeight;
+	}
+	dominantInfluenceArea = ranges::max(this->influenceAreas, {}, &WeightedInfluenceArea::weight).influenceArea;
+}
+
+float pah::MultiInfluenceArea::getProjectedArea(const Aabb& aabb) const {
+	float area = 0;
+	for (const auto& [influenceArea, weight] : influenceAreas) {
+		area += weight * influenceArea->getProjectedArea(aabb) / influenceArea->getProjectionPlaneArea();
+	}
+	return area;
+}
+
+void pah::MultiInfluenceArea::getProjectedAreas(std::span<const Aabb> aabbs, std::span<float> areas) const {
+	//we use the batched versions of each area, since they may be much faster than the single ones
+	vector<float> partialAreas(aabbs.size());
+	ranges::fill(areas, 0.0f);
+	for (const auto& [influenceArea, weight] : influenceAreas) {
+		influenceArea->getProjectedAreas(aabbs, partialAreas);
+		float scale = weight / influenceArea->getProjectionPlaneArea();
+		for (int i = 0; i < aabbs.size(); ++i) areas[i] += scale * partialAreas[i];
+	}
+}
+
+std::vector<Vector2> pah::MultiInfluenceArea::getProjectedHull(const Aabb& aabb) const {
+	return dominantInfluenceArea->getProjectedHull(aabb);
+}
+
+float pah::MultiInfluenceArea::getCulledProjectedArea(const Aabb& aabb) const {
+	float area = 0;
+	for (const auto& [influenceArea, weight] : influenceAreas) {
+		area += weight * influenceArea->getCulledProjectedArea(aabb) / influenceArea->getProjectionPlaneArea();
+	}
+	return area;
+}
+
+pah::FixedConvexHull2d<10> pah::MultiInfluenceArea::getCulledProjectedHull(const Aabb& aabb) const {
+	return dominantInfluenceArea->getCulledProjectedHull(aabb);
+}
+
+void pah::MultiInfluenceArea::getCulledProjectedAreas(std::span<const Aabb> aabbs, std::span<float> areas) const {
+	vector<float> partialAreas(aabbs.size());
+	ranges::fill(areas, 0.0f);
+	for (const auto& [influenceArea, weight] : influenceAreas) {
+		influenceArea->getCulledProjectedAreas(aabbs, partialAreas);
+		float scale = weight / influenceArea->getProjectionPlaneArea();
+		for (int i = 0; i < aabbs.size(); ++i) areas[i] += scale * partialAreas[i];
+	}
+}
+
+float pah::MultiInfluenceArea::getInfluence(const Aabb& aabb) const {
+	float influence = 0;
+	for (const auto& [influenceArea, weight] : influenceAreas) {
+		influence += weight * influenceArea->getInfluence(aabb);
+	}
+	return influence;
+}
+
+Vector3 pah::MultiInfluenceArea::getRayDirection(const Aabb& aabb) const {
+	//each direction is weighted by the fraction of the rays of its area that hit the Aabb. Since we only care about the axes the rays are aligned to (not their orientation), we sum absolute values
+	Vector3 direction{ 0.0f };
+	for (const auto& [influenceArea, weight] : influenceAreas) {
+		float hitFraction = influenceArea->getCulledProjectedArea(aabb) / influenceArea->getProjectionPlaneArea();
+		direction += weight * hitFraction * glm::abs(glm::normalize(influenceArea->getRayDirection(aabb)));
+	}
+	return direction == Vector3{ 0.0f } ? dominantInfluenceArea->getRayDirection(aabb) : direction;
+}
+
+float pah::MultiInfluenceArea::getProjectionPlaneArea() const {
+	return 1; //each area contributes with the fraction of its projection plane, and weights sum up to 1
+}
+
+std::vector<Vector2> pah::MultiInfluenceArea::getProjectionPlaneHull() const {
+	return dominantInfluenceArea->getProjectionPlaneHull();
+}
+
+bool pah::MultiInfluenceArea::isDirectionAffine(const Ray& ray, float tolerance) const {
+	return ranges::any_of(influenceAreas, [&](const auto& weightedInfluenceArea) { return weightedInfluenceArea.influenceArea->isDirectionAffine(ray, tolerance); });
+}
+
+Vector2 pah::MultiInfluenceArea::projectRay(const Ray& ray) const {
+	return dominantInfluenceArea->projectRay(ray);
+}
+
+std::vector<std::tuple<Axis, std::function<bool(float bestCostSoFar)>>> pah::MultiInfluenceArea::bestSplittingPlanes() const {
+	throw logic_error("Function not implemented yet!");
+}
+
+const std::vector<pah::MultiInfluenceArea::WeightedInfluenceArea>& pah::MultiInfluenceArea::getInfluenceAreas() const {
+	return influenceAreas;
+}
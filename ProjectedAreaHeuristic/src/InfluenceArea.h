@@ -4,6 +4,8 @@
 #include <memory>
 #include <tuple>
 #include <functional>
+#include <span>
+#include <optional>
 
 #include "Utilities.h"
 #include "Regions.h"
@@ -23,11 +25,32 @@ namespace pah {
 		 */
 		virtual float getProjectedArea(const Aabb& aabb) const = 0;
 
+		/**
+		 * @brief Same as @p getProjectedArea, but for many @p Aabb s at once. @p areas must have the same size of @p aabbs.
+		 */
+		virtual void getProjectedAreas(std::span<const Aabb> aabbs, std::span<float> areas) const;
+
 		/**
 		 * @brief Returns the convex hull formed by the projected points of the specified Aabb.
 		 */
 		virtual std::vector<Vector2> getProjectedHull(const Aabb& aabb) const = 0;
 
+		/**
+		 * @brief Returns the area of the projection of the @p Aabb that falls inside the projection plane.
+		 * It is equivalent to intersecting @p getProjectedHull with @p getProjectionPlaneHull, but it doesn't allocate.
+		 */
+		virtual float getCulledProjectedArea(const Aabb& aabb) const = 0;
+
+		/**
+		 * @brief Returns the hull of @p getProjectedHull clipped to @p getProjectionPlaneHull, without allocating.
+		 */
+		virtual FixedConvexHull2d<10> getCulledProjectedHull(const Aabb& aabb) const = 0;
+
+		/**
+		 * @brief Same as @p getCulledProjectedArea, but for many @p Aabb s at once. @p areas must have the same size of @p aabbs.
+		 */
+		virtual void getCulledProjectedAreas(std::span<const Aabb> aabbs, std::span<float> areas) const;
+
 		/**
 		 * @brief Given an @p Aabb, returns the influence that this @p InfluenceArea has on it.
 		 * This may depend on many factors, such as the amount of rays in the area or the distance.
@@ -57,6 +80,76 @@ namespace pah {
 		// TODO probably this will be removed. It should return the best way to split the AABB
 		virtual std::vector<std::tuple<Axis, std::function<bool(float bestCostSoFar)>>> bestSplittingPlanes() const = 0;
 
+		/**
+		 * @brief Returns the point of the projection plane the @p Ray passes through.
+		 */
+		virtual Vector2 projectRay(const Ray& ray) const = 0;
+
+		/**
+		 * @brief Returns the rotation from world space to the space of the rays of this area, if it has one: Z is the direction of the rays, X and Y span the projection plane.
+		 * By default there is none.
+		 */
+		virtual std::optional<Matrix3> getRaySpaceBasis() const;
+
+		/**
+		 * @brief Returns a copy of this area transformed to its own ray space (see @p getRaySpaceBasis), or nullptr if it has no ray space.
+		 * Density maps, sample rays and off-distribution fraction are preserved.
+		 */
+		virtual std::unique_ptr<InfluenceArea> createRaySpaceInfluenceArea() const;
+
+		/**
+		 * @brief Builds the ray density map of this @p InfluenceArea from a set of rays (e.g. the ones of a @p RayCaster, or recorded from a renderer).
+		 * The map covers the projection plane with a grid of @p columns x @p rows cells.
+		 */
+		void setDensityMap(std::span<const Ray> rays, int columns, int rows);
+
+		/**
+		 * @brief Returns the ray density map, if any.
+		 */
+		const std::optional<DensityMap>& getDensityMap() const;
+
+		/**
+		 * @brief Returns the integral of the ray density over the culled projected hull of the @p Aabb.
+		 * If there is no density map, rays are uniformly distributed, and it is the same as @p getCulledProjectedArea.
+		 */
+		float getCulledProjectedDensity(const Aabb& aabb) const;
+
+		/**
+		 * @brief Returns the integral of the ray density over the whole projection plane (or its area if there is no density map).
+		 */
+		float getProjectionPlaneDensity() const;
+
+		/**
+		 * @brief Sets the rays that represent this @p InfluenceArea for the Monte Carlo cost strategies (e.g. the ones of a @p RayCaster, or recorded from a renderer).
+		 * At most @p maxSamples rays are kept, which bounds the cost of evaluating a split.
+		 */
+		void setSampleRays(std::span<const Ray> rays, int maxSamples = std::numeric_limits<int>::max());
+
+		/**
+		 * @brief Returns the sample rays, if any.
+		 */
+		const std::optional<SampleRays>& getSampleRays() const;
+
+		/**
+		 * @brief @p hitsCounts[i] is the number of sample rays hitting @p aabbs[i]. The sample rays must have been set.
+		 */
+		void countSampleRaysHits(std::span<const Aabb> aabbs, std::span<int> hitsCounts) const;
+
+		/**
+		 * @brief Sets the fraction of the rays traversing the @p Bvh of this area that do not follow its distribution (e.g. secondary rays), which blended cost strategies hedge against.
+		 */
+		void setOffDistributionFraction(float offDistributionFraction);
+
+		/**
+		 * @brief Estimates the off-distribution fraction from a set of rays (e.g. recorded from a renderer): it is the fraction of rays that start outside the @p Region or are not affine to this area.
+		 */
+		void setOffDistributionFraction(std::span<const Ray> rays, float tolerance = TOLERANCE);
+
+		/**
+		 * @brief Returns the fraction of rays that do not follow the distribution of this area (0 by default).
+		 */
+		float getOffDistributionFraction() const;
+
 		/**
 		 * @brief Returns the associated @p Region.
 		 */
@@ -64,6 +157,9 @@ namespace pah {
 
 	protected:
 		std::unique_ptr<Region> bvhRegion;
+		std::optional<DensityMap> densityMap;
+		std::optional<SampleRays> sampleRays;
+		float offDistributionFraction = 0.0f;
 	};
 
 
@@ -75,12 +171,18 @@ namespace pah {
 		PlaneInfluenceArea(Plane plane, float forwardSize, float density);
 
 		float getProjectedArea(const Aabb& aabb) const override;
+		void getProjectedAreas(std::span<const Aabb> aabbs, std::span<float> areas) const override;
 		std::vector<Vector2> getProjectedHull(const Aabb& aabb) const override;
+		float getCulledProjectedArea(const Aabb& aabb) const override;
+		FixedConvexHull2d<10> getCulledProjectedHull(const Aabb& aabb) const override;
 		float getInfluence(const Aabb& aabb) const override;
 		Vector3 getRayDirection(const Aabb& aabb) const override;
 		float getProjectionPlaneArea() const override;
 		std::vector<Vector2> getProjectionPlaneHull() const override;
 		bool isDirectionAffine(const Ray& ray, float tolerance) const override;
+		Vector2 projectRay(const Ray& ray) const override;
+		std::optional<Matrix3> getRaySpaceBasis() const override;
+		std::unique_ptr<InfluenceArea> createRaySpaceInfluenceArea() const override;
 		std::vector<std::tuple<Axis, std::function<bool(float bestCostSoFar)>>> bestSplittingPlanes() const override;
 
 		const Plane& getPlane() const;
@@ -94,6 +196,7 @@ namespace pah {
 		float farPlane;
 		float density;
 		Matrix4 viewProjectionMatrix; //stores the view matrix for this plane, so that we can avoid calculating it each time
+		Vector3 facesWeights; //weights of the closed form projected area (see projection::orthographic::computeProjectedAreaClosedForm)
 	};
 
 
@@ -103,13 +206,27 @@ namespace pah {
 
 		float getProjectedArea(const Aabb& aabb) const override;
 		std::vector<Vector2> getProjectedHull(const Aabb& aabb) const override;
+		float getCulledProjectedArea(const Aabb& aabb) const override;
+		FixedConvexHull2d<10> getCulledProjectedHull(const Aabb& aabb) const override;
 		float getInfluence(const Aabb& aabb) const override;
 		Vector3 getRayDirection(const Aabb& aabb) const override;
 		float getProjectionPlaneArea() const override;
 		std::vector<Vector2> getProjectionPlaneHull() const override;
 		bool isDirectionAffine(const Ray& ray, float tolerance) const override;
+		Vector2 projectRay(const Ray& ray) const override;
 		std::vector<std::tuple<Axis, std::function<bool(float bestCostSoFar)>>> bestSplittingPlanes() const override;
 
+		/**
+		 * @brief Returns the solid angle subtended by the part of the @p Aabb inside the frustum, as seen from the pov.
+		 * Rays leave the pov with (roughly) uniformly distributed directions, so this is a better measure than the projected area on the near plane, which distorts @p Aabb s far from the axis.
+		 */
+		float getCulledSolidAngle(const Aabb& aabb) const;
+
+		/**
+		 * @brief Returns the solid angle of the whole frustum.
+		 */
+		float getFrustumSolidAngle() const;
+
 		const Pov& getPov() const;
 		const std::pair<float, float> getNearFar() const;
 		float getDensity() const;
@@ -118,5 +235,48 @@ namespace pah {
 		float density;
 		Pov pov;
 		float nearPlane, farPlane;
+		Matrix4 viewProjectionMatrix; //stores the view projection matrix for this pov, so that we can avoid calculating it each time
+		Matrix4 viewMatrix;
+		Vector2 tanHalfFovs; //tangents of half the horizontal and vertical FoVs
+	};
+
+
+	/**
+	 * @brief A weighted mix of many @p InfluenceArea s, so that a single @p Bvh can be optimized for all of them (e.g. a camera and a key light).
+	 * The projected areas are the weighted sums of the fractions of the projection planes covered by the @p Aabb, therefore PAH minimizes the weighted sum of the hit probabilities of the areas.
+	 * Queries that need a single projection plane (hulls, ray projection) are forwarded to the area with the biggest weight.
+	 * The @p InfluenceArea s are not owned, and must outlive this object.
+	 */
+	class MultiInfluenceArea : public InfluenceArea {
+	public:
+		struct WeightedInfluenceArea {
+			const InfluenceArea* influenceArea;
+			float weight;
+		};
+
+		/**
+		 * @brief Builds the mix. Weights are normalized so that they sum up to 1. The @p Region is the @p Aabb enclosing the regions of all the areas.
+		 */
+		MultiInfluenceArea(std::vector<WeightedInfluenceArea> influenceAreas);
+
+		float getProjectedArea(const Aabb& aabb) const override;
+		void getProjectedAreas(std::span<const Aabb> aabbs, std::span<float> areas) const override;
+		std::vector<Vector2> getProjectedHull(const Aabb& aabb) const override;
+		float getCulledProjectedArea(const Aabb& aabb) const override;
+		FixedConvexHull2d<10> getCulledProjectedHull(const Aabb& aabb) const override;
+		void getCulledProjectedAreas(std::span<const Aabb> aabbs, std::span<float> areas) const override;
+		float getInfluence(const Aabb& aabb) const override;
+		Vector3 getRayDirection(const Aabb& aabb) const override;
+		float getProjectionPlaneArea() const override;
+		std::vector<Vector2> getProjectionPlaneHull() const override;
+		bool isDirectionAffine(const Ray& ray, float tolerance) const override;
+		Vector2 projectRay(const Ray& ray) const override;
+		std::vector<std::tuple<Axis, std::function<bool(float bestCostSoFar)>>> bestSplittingPlanes() const override;
+
+		const std::vector<WeightedInfluenceArea>& getInfluenceAreas() const;
+
+	private:
+		std::vector<WeightedInfluenceArea> influenceAreas;
+		const InfluenceArea* dominantInfluenceArea; //the area with the biggest weight
 	};
 }
@@ -2,6 +2,8 @@
 
 #include "Utilities.h"
 #include <ranges>
+#include <span>
+#include <immintrin.h>
 
 /**
  * @brief Function and utilities to project points and @Aabb s to a plane.
@@ -13,10 +15,16 @@ namespace pah::projection {
 	 * See hull table for more info.
 	 */
 	struct HullInfo {
-		std::vector<int> vertices; //index of the indices creating the hull
+		std::array<int, 6> vertices; //index of the indices creating the hull (a contour has at most 6 vertices)
+		int size; //how many elements of vertices are used
 
-		HullInfo() {}
-		HullInfo(std::vector<int> vertices) : vertices{ vertices } {}
+		constexpr HullInfo() : vertices{}, size{ 0 } {}
+		constexpr HullInfo(std::initializer_list<int> vertices) : vertices{}, size{ 0 } {
+			for (int vertex : vertices) this->vertices[size++] = vertex;
+		}
+
+		constexpr const int* begin() const { return vertices.data(); }
+		constexpr const int* end() const { return vertices.data() + size; }
 
 		/**
 		 * @brief The indexing follows this scheme:
@@ -43,7 +51,7 @@ namespace pah::projection {
 	 * Of course some indexes will be empty, since you cannot see the AABB from bottom and top at the same time, therefore xx11xxb = 13 is empty.
 	 * To get more info about how we index the vertices of an @p Aabb look at the function @p pah::Aabb::getPoints
 	 */
-	static std::array<HullInfo, 43> hullTable =
+	static constexpr std::array<HullInfo, 43> hullTable =
 	{
 		HullInfo{},
 		HullInfo{{ 1, 0, 2, 3 }},
@@ -95,14 +103,19 @@ namespace pah::projection {
 	 */
 	static std::vector<Vector3> findContourPoints(const Aabb& aabb, int i) {
 		using namespace std;
-		const vector<int>& verticesIndexes = hullTable[i].vertices; //get the array of indexes of the contour vertices
-		vector<Vector3> contourVertices(verticesIndexes.size());
-		for (int j = 0; j < verticesIndexes.size(); j++) {
-			contourVertices[j] = aabb.getPoint(verticesIndexes[j]);
+		const HullInfo& verticesIndexes = hullTable[i]; //get the array of indexes of the contour vertices
+		vector<Vector3> contourVertices(verticesIndexes.size);
+		for (int j = 0; j < verticesIndexes.size; j++) {
+			contourVertices[j] = aabb.getPoint(verticesIndexes.vertices[j]);
 		}
 		return contourVertices;
 	}
 
+	/**
+	 * @brief Projected contour of an @p Aabb. It has room for the 6 vertices of the contour, plus the 4 that may be added by clipping it against the projection plane.
+	 */
+	using ProjectedContour = FixedConvexHull2d<10>;
+
 
 	/**
 	 * @brief Returns the view matrix, to go from world space to camera space.
@@ -316,6 +329,17 @@ namespace pah::projection {
 			return projection::findContourPoints(aabb, findHullTableIndex(viewDirection));
 		}
 
+		/**
+		 * @brief Finds the contour points of the @p Aabb seen from @p viewDirection and projects them, without allocating.
+		 */
+		static ProjectedContour projectContour(const Aabb& aabb, Vector3 viewDirection, const Matrix4& viewProjectionMatrix) {
+			ProjectedContour contour{};
+			for (int index : hullTable[findHullTableIndex(viewDirection)]) {
+				contour.push_back(projectPoint(aabb.getPoint(index), viewProjectionMatrix));
+			}
+			return contour;
+		}
+
 		static float computeProjectedArea(const Aabb& aabb, const Matrix4& viewProjectionMatrix) {
 			auto points = aabb.getPoints();
 			std::vector<Vector3> keyPoints = { points[3], points[1], points[2], points[7] };
@@ -340,6 +364,45 @@ namespace pah::projection {
 			return area1 + area2 + area3;
 		}
 		
+		/**
+		 * @brief Returns the weights to pass to @p computeProjectedAreaClosedForm to project along @p direction (normalized).
+		 * @param scale Factor to apply to the areas (e.g. to go to the canonical view volume).
+		 */
+		static Vector3 computeFacesWeights(Vector3 direction, float scale = 1.0f) {
+			return glm::abs(direction) * scale;
+		}
+
+		/**
+		 * @brief Closed form of the area of an @p Aabb projected along a direction.
+		 * Only 3 faces of the box are visible at once, and each one projects to its area times the cosine between its normal and the direction: 
+		 * the result is a linear function of the areas of the faces, whose coefficients are @p facesWeights (see @p computeFacesWeights).
+		 */
+		static float computeProjectedAreaClosedForm(const Aabb& aabb, Vector3 facesWeights) {
+			Vector3 size = aabb.max - aabb.min;
+			return facesWeights.x * (size.y * size.z) + facesWeights.y * (size.x * size.z) + facesWeights.z * (size.x * size.y);
+		}
+
+		/**
+		 * @brief Same as @p computeProjectedAreaClosedForm, but for many @p Aabb s at once (4 at a time with SSE).
+		 */
+		static void computeProjectedAreasClosedForm(std::span<const Aabb> aabbs, Vector3 facesWeights, std::span<float> areas) {
+			const __m128 weightX = _mm_set1_ps(facesWeights.x), weightY = _mm_set1_ps(facesWeights.y), weightZ = _mm_set1_ps(facesWeights.z);
+			std::size_t i = 0;
+			for (; i + 4 <= aabbs.size(); i += 4) {
+				const Aabb& a0 = aabbs[i]; const Aabb& a1 = aabbs[i + 1]; const Aabb& a2 = aabbs[i + 2]; const Aabb& a3 = aabbs[i + 3];
+				__m128 sizeX = _mm_sub_ps(_mm_setr_ps(a0.max.x, a1.max.x, a2.max.x, a3.max.x), _mm_setr_ps(a0.min.x, a1.min.x, a2.min.x, a3.min.x));
+				__m128 sizeY = _mm_sub_ps(_mm_setr_ps(a0.max.y, a1.max.y, a2.max.y, a3.max.y), _mm_setr_ps(a0.min.y, a1.min.y, a2.min.y, a3.min.y));
+				__m128 sizeZ = _mm_sub_ps(_mm_setr_ps(a0.max.z, a1.max.z, a2.max.z, a3.max.z), _mm_setr_ps(a0.min.z, a1.min.z, a2.min.z, a3.min.z));
+				__m128 area = _mm_mul_ps(weightX, _mm_mul_ps(sizeY, sizeZ));
+				area = _mm_add_ps(area, _mm_mul_ps(weightY, _mm_mul_ps(sizeX, sizeZ)));
+				area = _mm_add_ps(area, _mm_mul_ps(weightZ, _mm_mul_ps(sizeX, sizeY)));
+				_mm_storeu_ps(&areas[i], area);
+			}
+			for (; i < aabbs.size(); ++i) {
+				areas[i] = computeProjectedAreaClosedForm(aabbs[i], facesWeights);
+			}
+		}
+
 		/**
 		 * @brief Given an @p Aabb and a plane, it returns the area the @p Aabb projects on the plane.
 		 */
@@ -451,6 +514,84 @@ namespace pah::projection {
 			return projection::findContourPoints(aabb, findHullTableIndex(aabb, pov));
 		}
 
+		/**
+		 * @brief Finds the contour points of the @p Aabb seen from @p pov and projects them, without allocating.
+		 * The contour is empty if the PoV is inside the @p Aabb.
+		 */
+		static ProjectedContour projectContour(const Aabb& aabb, Vector3 pov, const Matrix4& viewProjectionMatrix) {
+			ProjectedContour contour{};
+			for (int index : hullTable[findHullTableIndex(aabb, pov)]) {
+				contour.push_back(projectPoint(aabb.getPoint(index), viewProjectionMatrix));
+			}
+			return contour;
+		}
+
+		/**
+		 * @brief Returns the solid angle of the cone with apex in the origin passing through the convex polygon @p vertices.
+		 * The polygon is split in a fan of triangles, and the solid angle of each one is computed with the formula of Van Oosterom and Strackee.
+		 */
+		static float computeSolidAngle(std::span<const Vector3> vertices) {
+			if (vertices.size() < 3) return 0;
+			const Vector3& a = vertices[0];
+			float lengthA = glm::length(a);
+			float solidAngle = 0.0f;
+			for (std::size_t i = 1; i + 1 < vertices.size(); ++i) {
+				const Vector3& b = vertices[i], c = vertices[i + 1];
+				float lengthB = glm::length(b), lengthC = glm::length(c);
+				float numerator = glm::abs(glm::dot(a, glm::cross(b, c)));
+				float denominator = lengthA * lengthB * lengthC + glm::dot(a, b) * lengthC + glm::dot(a, c) * lengthB + glm::dot(b, c) * lengthA;
+				solidAngle += 2.0f * std::atan2(numerator, denominator);
+			}
+			return solidAngle;
+		}
+
+		/**
+		 * @brief Returns the solid angle of a frustum with the specified tangents of the half FoVs.
+		 */
+		static float computeFrustumSolidAngle(Vector2 tanHalfFovs) {
+			//the solid angle of a rectangular pyramid is 4 * asin(sin(a) * sin(b)), where a and b are the half FoVs
+			float sinHalfFovX = tanHalfFovs.x / glm::sqrt(1.0f + tanHalfFovs.x * tanHalfFovs.x);
+			float sinHalfFovY = tanHalfFovs.y / glm::sqrt(1.0f + tanHalfFovs.y * tanHalfFovs.y);
+			return 4.0f * std::asin(sinHalfFovX * sinHalfFovY);
+		}
+
+		/**
+		 * @brief Returns the solid angle of the part of the @p Aabb, seen from @p pov, that is inside the frustum.
+		 * The contour of the @p Aabb is brought to view space and clipped against the 4 side planes of the frustum (which pass through the pov), so there is no distortion for @p Aabb s far from the axis, nor for points behind the pov.
+		 * If the pov is inside the @p Aabb, the whole frustum is covered.
+		 */
+		static float computeCulledSolidAngle(const Aabb& aabb, Vector3 pov, const Matrix4& viewMatrix, Vector2 tanHalfFovs) {
+			const HullInfo& hull = hullTable[findHullTableIndex(aabb, pov)];
+			if (hull.size == 0) return computeFrustumSolidAngle(tanHalfFovs);
+
+			std::array<Vector3, 10> polygon{}; //the contour has at most 6 vertices, each clipping plane adds at most 1 more
+			std::size_t count = 0;
+			for (int index : hull) {
+				polygon[count++] = viewMatrix * Vector4{ aabb.getPoint(index), 1.0f };
+			}
+
+			//in view space the pov looks towards -z, and a point is inside the frustum iff dot(normal, point) <= 0 for each normal
+			std::array<Vector3, 4> sidePlanesNormals{ Vector3{ 1, 0, tanHalfFovs.x }, Vector3{ -1, 0, tanHalfFovs.x }, Vector3{ 0, 1, tanHalfFovs.y }, Vector3{ 0, -1, tanHalfFovs.y } };
+			for (const auto& normal : sidePlanesNormals) {
+				std::array<Vector3, 10> input = polygon;
+				std::size_t inputCount = count;
+				count = 0;
+				Vector3 previous = input[inputCount - 1];
+				float previousDistance = glm::dot(normal, previous);
+				for (std::size_t i = 0; i < inputCount; ++i) {
+					Vector3 current = input[i];
+					float currentDistance = glm::dot(normal, current);
+					if ((currentDistance <= 0) != (previousDistance <= 0)) polygon[count++] = previous + (previousDistance / (previousDistance - currentDistance)) * (current - previous); //the edge crosses the plane
+					if (currentDistance <= 0) polygon[count++] = current;
+					previous = current;
+					previousDistance = currentDistance;
+				}
+				if (count == 0) return 0;
+			}
+
+			return computeSolidAngle(std::span{ polygon.data(), count });
+		}
+
 		/**
 		 * @brief Given the contour points of a convex 2D hull, it calculates its area.
 		 * It uses a technique called shoelace formula.
@@ -1,5 +1,7 @@
 #include "Regions.h"
 
+#include <immintrin.h>
+
 #include "Projections.h"
 
 using namespace std;
@@ -7,6 +9,20 @@ using namespace glm;
 using namespace pah;
 
 
+// ======| Region |======
+void pah::Region::contains(std::span<const Vector3> points, std::span<bool> results) const {
+	for (int i = 0; i < points.size(); ++i) {
+		results[i] = contains(points[i]);
+	}
+}
+
+void pah::Region::isCollidingWith(std::span<const Aabb> aabbs, std::span<bool> results) const {
+	for (int i = 0; i < aabbs.size(); ++i) {
+		results[i] = isCollidingWith(aabbs[i]);
+	}
+}
+
+
 // ======| Aabb |======
 pah::Aabb::Aabb(const vector<const Triangle*>&triangles) : min{ numeric_limits<float>::max() }, max{ -numeric_limits<float>::max() } {
 	for (auto t : triangles) {
@@ -67,6 +83,17 @@ bool pah::Aabb::fullyContains(const Aabb & aabb) const {
 		max.z >= aabb.max.z;
 }
 
+array<Plane, 6> pah::Aabb::getFaces() const {
+	return {
+		Plane{ min, Vector3{ -1,0,0 } },
+		Plane{ max, Vector3{ 1,0,0 } },
+		Plane{ min, Vector3{ 0,-1,0 } },
+		Plane{ max, Vector3{ 0,1,0 } },
+		Plane{ min, Vector3{ 0,0,-1 } },
+		Plane{ max, Vector3{ 0,0,1 } }
+	};
+}
+
 Vector3 pah::Aabb::center() const {
 	return (min + max) / 2.0f;
 }
@@ -122,6 +149,42 @@ pah::Aabb& pah::operator+(Aabb lhs, const Aabb & rhs) {
 	return lhs += rhs;
 }
 
+pah::Aabb pah::Aabb::intersection(const Aabb& aabb) const {
+	return Aabb{ glm::max(min, aabb.min), glm::min(max, aabb.max) };
+}
+
+pah::Aabb pah::Aabb::clip(const Triangle& triangle) const {
+	//Sutherland-Hodgman: clip the triangle against the 6 planes of the Aabb, each plane adds at most one vertex to the polygon
+	array<Vector3, 9> polygon{ triangle[0], triangle[1], triangle[2] }, clipped{};
+	int size = 3;
+	for (int axis = 0; axis < 3; ++axis) {
+		for (int side = 0; side < 2; ++side) {
+			bool lower = side == 0;
+			float bound = lower ? min[axis] : max[axis];
+			auto inside = [&](const Vector3& point) { return lower ? point[axis] >= bound : point[axis] <= bound; };
+			int clippedSize = 0;
+			for (int i = 0; i < size; ++i) {
+				const Vector3& current = polygon[i], & next = polygon[(i + 1) % size];
+				if (inside(current)) clipped[clippedSize++] = current;
+				if (inside(current) != inside(next)) {
+					Vector3 point = current + (next - current) * ((bound - current[axis]) / (next[axis] - current[axis]));
+					point[axis] = bound; //avoid rounding errors
+					clipped[clippedSize++] = point;
+				}
+			}
+			polygon = clipped;
+			size = clippedSize;
+		}
+	}
+
+	Aabb result = minAabb();
+	for (int i = 0; i < size; ++i) {
+		result.min = glm::min(result.min, polygon[i]);
+		result.max = glm::max(result.max, polygon[i]);
+	}
+	return result;
+}
+
 
 // ======| Obb |======
 pah::Obb::Obb(const Vector3 & center, const Vector3 & halfSize, const Vector3 & forward) : center{ center }, halfSize{ halfSize } {
@@ -129,6 +192,7 @@ pah::Obb::Obb(const Vector3 & center, const Vector3 & halfSize, const Vector3 &
 	this->forward = forwardDir;
 	this->up = up;
 	this->right = right;
+	fillSeparatingAxes();
 }
 
 bool pah::Obb::contains(const Vector3 & point) const {
@@ -167,6 +231,17 @@ bool pah::Obb::fullyContains(const Aabb & aabb) const {
 	return true;
 }
 
+array<Plane, 6> pah::Obb::getFaces() const {
+	return {
+		Plane{ center - right * halfSize.x, -right },
+		Plane{ center + right * halfSize.x, right },
+		Plane{ center - up * halfSize.y, -up },
+		Plane{ center + up * halfSize.y, up },
+		Plane{ center - forward * halfSize.z, -forward },
+		Plane{ center + forward * halfSize.z, forward }
+	};
+}
+
 array<Vector3, 8> pah::Obb::getPoints() const {
 	array<Vector3, 8> points{};
 	//loop through each vertex of the OBB
@@ -182,6 +257,33 @@ array<Vector3, 8> pah::Obb::getPoints() const {
 }
 
 
+const array<collisionDetection::SeparatingAxis, 12>& pah::Obb::getSeparatingAxes() const {
+	return separatingAxes;
+}
+
+bool pah::Obb::isAlmostAabb() const {
+	return almostAabbObj;
+}
+
+void pah::Obb::fillSeparatingAxes() {
+	almostAabbObj = collisionDetection::almostAabb(*this);
+
+	array<Vector3, 12> axes{
+		right, up, forward,
+		cross(Vector3{1,0,0}, right), cross(Vector3{1,0,0}, up), cross(Vector3{1,0,0}, forward),
+		cross(Vector3{0,1,0}, right), cross(Vector3{0,1,0}, up), cross(Vector3{0,1,0}, forward),
+		cross(Vector3{0,0,1}, right), cross(Vector3{0,0,1}, up), cross(Vector3{0,0,1}, forward)
+	};
+
+	for (int i = 0; i < axes.size(); ++i) {
+		//the projection of the OBB is centered on the projection of its center, and its radius is the sum of the projections of the 3 half sizes
+		float projectedCenter = dot(center, axes[i]);
+		float projectedRadius = abs(dot(right, axes[i])) * halfSize.x + abs(dot(up, axes[i])) * halfSize.y + abs(dot(forward, axes[i])) * halfSize.z;
+		separatingAxes[i] = { axes[i], projectedCenter - projectedRadius, projectedCenter + projectedRadius };
+	}
+}
+
+
 // ======| AabbForObb |======
 pah::AabbForObb::AabbForObb(const Vector3 & center, const Vector3 & halfSize, const Vector3 & forward) : obb{ center, halfSize, forward }, aabb{ obb.enclosingAabb() } {}
 
@@ -201,11 +303,19 @@ bool pah::AabbForObb::isCollidingWith(const Aabb & aabb) const {
 	return collisionDetection::areColliding(*this, aabb);
 }
 
+void pah::AabbForObb::isCollidingWith(std::span<const Aabb> aabbs, std::span<bool> results) const {
+	collisionDetection::areColliding(*this, aabbs, results);
+}
+
 bool pah::AabbForObb::fullyContains(const Aabb & aabb) const {
 	if (!this->aabb.fullyContains(aabb)) return false;
 	return this->obb.fullyContains(aabb);
 }
 
+array<Plane, 6> pah::AabbForObb::getFaces() const {
+	return obb.getFaces();
+}
+
 
 // ======| Frustum |======
 pah::Frustum::Frustum(const Matrix4 & viewProjectionMatrix) : viewProjectionMatrix{ viewProjectionMatrix } {
@@ -213,6 +323,8 @@ pah::Frustum::Frustum(const Matrix4 & viewProjectionMatrix) : viewProjectionMatr
 	fillEdgesDirection();
 	fillFacesNormals();
 	fillEnclosingAabb();
+	fillSeparatingAxes();
+	fillPlanes();
 }
 
 pah::Frustum::Frustum(const Pov & pov, float far, float near)
@@ -221,12 +333,36 @@ pah::Frustum::Frustum(const Pov & pov, float far, float near)
 bool pah::Frustum::contains(const Vector3 & point) const {
 	if (!enclosingAabbObj.contains(point)) return false;
 
-	//look at "Fast Extraction of Viewing Frustum Planes from the WorldView-Projection Matrix" section 2 and the GeoGebra file "2dFrustum"
-	//basically p' = M*p --> p inside frustum iff -w' < x' < w' AND -w' < y' < w' AND -w' < z' < w'
-	auto p = viewProjectionMatrix * Vector4{ point, 1.0f }; //projected point
-	return -p.w < p.x && p.x < p.w &&
-		-p.w < p.y && p.y < p.w &&
-		-p.w < p.z && p.z < p.w;
+	//this is equivalent to projecting the point and checking that -w' < x' < w' AND -w' < y' < w' AND -w' < z' < w' (look at the GeoGebra file "2dFrustum"), but it only needs 6 dot products
+	for (const auto& plane : planes) {
+		if (dot(Vector3{ plane }, point) + plane.w > 0.0f) return false;
+	}
+	return true;
+}
+
+void pah::Frustum::contains(std::span<const Vector3> points, std::span<bool> results) const {
+	int i = 0;
+	for (; i + 4 <= points.size(); i += 4) {
+		//structure of arrays layout: each register holds the same coordinate of the 4 points
+		__m128 x = _mm_set_ps(points[i + 3].x, points[i + 2].x, points[i + 1].x, points[i].x);
+		__m128 y = _mm_set_ps(points[i + 3].y, points[i + 2].y, points[i + 1].y, points[i].y);
+		__m128 z = _mm_set_ps(points[i + 3].z, points[i + 2].z, points[i + 1].z, points[i].z);
+
+		__m128 outside = _mm_setzero_ps();
+		for (const auto& plane : planes) {
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(x, _mm_set1_ps(plane.x)),
+				_mm_mul_ps(y, _mm_set1_ps(plane.y))),
+				_mm_mul_ps(z, _mm_set1_ps(plane.z))),
+				_mm_set1_ps(plane.w));
+			outside = _mm_or_ps(outside, _mm_cmpgt_ps(distance, _mm_setzero_ps()));
+		}
+
+		int outsideMask = _mm_movemask_ps(outside);
+		for (int j = 0; j < 4; ++j) results[i + j] = !((outsideMask >> j) & 1);
+	}
+	//remaining points
+	for (; i < points.size(); ++i) results[i] = contains(points[i]);
 }
 
 pah::Aabb pah::Frustum::enclosingAabb() const {
@@ -237,13 +373,25 @@ bool pah::Frustum::isCollidingWith(const Aabb & aabb) const {
 	return collisionDetection::areColliding(*this, aabb);
 }
 
+void pah::Frustum::isCollidingWith(std::span<const Aabb> aabbs, std::span<bool> results) const {
+	collisionDetection::areColliding(*this, aabbs, results);
+}
+
 bool pah::Frustum::fullyContains(const Aabb & aabb) const {
 	if (!enclosingAabbObj.fullyContains(aabb)) return false;
-
-	for (const auto& vertex : vertices) {
-		if (!contains(vertex)) return false;
-	}
-	return true;
+	return collisionDetection::classify(*this, aabb) == collisionDetection::Containment::Inside;
+}
+
+array<Plane, 6> pah::Frustum::getFaces() const {
+	//vertex 0 (left-bottom-near) lies on the left, bottom and near faces, vertex 7 (right-top-far) on the others (look at fillVertices for the order of the vertices)
+	return {
+		Plane{ vertices[0], facesNormals[0] },
+		Plane{ vertices[7], facesNormals[1] },
+		Plane{ vertices[0], facesNormals[2] },
+		Plane{ vertices[7], facesNormals[3] },
+		Plane{ vertices[0], facesNormals[4] },
+		Plane{ vertices[7], facesNormals[5] }
+	};
 }
 
 array<Vector3, 8> pah::Frustum::getPoints() const {
@@ -258,6 +406,14 @@ array<Vector3, 6> pah::Frustum::getFacesNormals() const {
 	return facesNormals;
 }
 
+const array<collisionDetection::SeparatingAxis, 24>& pah::Frustum::getSeparatingAxes() const {
+	return separatingAxes;
+}
+
+const array<Vector4, 6>& pah::Frustum::getPlanes() const {
+	return planes;
+}
+
 pah::Matrix4 pah::Frustum::getViewProjectionMatrix() const {
 	return viewProjectionMatrix;
 }
@@ -379,6 +535,25 @@ void pah::Frustum::fillEnclosingAabb() {
 	}
 }
 
+void pah::Frustum::fillSeparatingAxes() {
+	int count = 0;
+	auto addAxis = [this, &count](const Vector3& axis) {
+		auto [min, max] = collisionDetection::projectedFrustumExtremes(axis, *this);
+		separatingAxes[count++] = { axis, min, max };
+	};
+
+	for (const auto& normal : facesNormals) addAxis(normal);
+	for (const auto& worldAxis : { Vector3{1,0,0}, Vector3{0,1,0}, Vector3{0,0,1} })
+		for (const auto& edgeDirection : edgesDirections) addAxis(cross(worldAxis, edgeDirection));
+}
+
+void pah::Frustum::fillPlanes() {
+	auto faces = getFaces();
+	for (int i = 0; i < 6; ++i) {
+		planes[i] = Vector4{ faces[i].getNormal(), -dot(faces[i].getNormal(), faces[i].getPoint()) };
+	}
+}
+
 
 // ======| namesapce collisionDetection |======
 bool collisionDetection::areColliding(const Aabb & aabb1, const Aabb & aabb2) {
@@ -391,50 +566,92 @@ bool collisionDetection::areColliding(const Aabb & aabb1, const Aabb & aabb2) {
 		aabb1.max.z >= aabb2.min.z;
 }
 
+//returns whether the Aabb is separated from a region on at least one of its precomputed axes
+template<std::size_t N>
+static bool separatedOnAnyAxis(const array<collisionDetection::SeparatingAxis, N>& separatingAxes, const Aabb& aabb) {
+	Vector3 center = aabb.center(), halfSize = aabb.size() / 2.0f;
+	for (const auto& [axis, min, max] : separatingAxes) {
+		//the projection of the AABB is centered on the projection of its center, and its radius is the sum of the projections of the 3 half sizes
+		float projectedCenter = dot(center, axis);
+		float projectedRadius = abs(axis.x) * halfSize.x + abs(axis.y) * halfSize.y + abs(axis.z) * halfSize.z;
+
+		// |--------------------|MA     MB    overlap iff mB <= MA && MB >= mA (not overlap iff mB > MA || MB < mA)
+		// mA             mB|-----------|
+		if (projectedCenter - projectedRadius > max || projectedCenter + projectedRadius < min) return true;
+	}
+	return false;
+}
+
+//SSE version of separatedOnAnyAxis, it works on 4 Aabbs at a time and returns a 4 bits mask where the i-th bit is set if the i-th Aabb is separated from the region
+//the enclosing Aabb of the region is tested too (it is equivalent to using the world axes as separating axes)
+template<std::size_t N>
+static int separatedOnAnyAxis4(const array<collisionDetection::SeparatingAxis, N>& separatingAxes, const Aabb& enclosingAabb, bool testAxes, const Aabb* aabbs) {
+	//structure of arrays layout: each register holds the same coordinate of the 4 AABBs
+	__m128 minX = _mm_set_ps(aabbs[3].min.x, aabbs[2].min.x, aabbs[1].min.x, aabbs[0].min.x);
+	__m128 minY = _mm_set_ps(aabbs[3].min.y, aabbs[2].min.y, aabbs[1].min.y, aabbs[0].min.y);
+	__m128 minZ = _mm_set_ps(aabbs[3].min.z, aabbs[2].min.z, aabbs[1].min.z, aabbs[0].min.z);
+	__m128 maxX = _mm_set_ps(aabbs[3].max.x, aabbs[2].max.x, aabbs[1].max.x, aabbs[0].max.x);
+	__m128 maxY = _mm_set_ps(aabbs[3].max.y, aabbs[2].max.y, aabbs[1].max.y, aabbs[0].max.y);
+	__m128 maxZ = _mm_set_ps(aabbs[3].max.z, aabbs[2].max.z, aabbs[1].max.z, aabbs[0].max.z);
+
+	__m128 separated = _mm_or_ps(
+		_mm_or_ps(
+			_mm_or_ps(_mm_cmpgt_ps(minX, _mm_set1_ps(enclosingAabb.max.x)), _mm_cmplt_ps(maxX, _mm_set1_ps(enclosingAabb.min.x))),
+			_mm_or_ps(_mm_cmpgt_ps(minY, _mm_set1_ps(enclosingAabb.max.y)), _mm_cmplt_ps(maxY, _mm_set1_ps(enclosingAabb.min.y)))),
+		_mm_or_ps(_mm_cmpgt_ps(minZ, _mm_set1_ps(enclosingAabb.max.z)), _mm_cmplt_ps(maxZ, _mm_set1_ps(enclosingAabb.min.z))));
+	if (!testAxes) return _mm_movemask_ps(separated);
+
+	__m128 half = _mm_set1_ps(0.5f);
+	__m128 centerX = _mm_mul_ps(_mm_add_ps(minX, maxX), half), halfSizeX = _mm_mul_ps(_mm_sub_ps(maxX, minX), half);
+	__m128 centerY = _mm_mul_ps(_mm_add_ps(minY, maxY), half), halfSizeY = _mm_mul_ps(_mm_sub_ps(maxY, minY), half);
+	__m128 centerZ = _mm_mul_ps(_mm_add_ps(minZ, maxZ), half), halfSizeZ = _mm_mul_ps(_mm_sub_ps(maxZ, minZ), half);
+
+	for (const auto& [axis, min, max] : separatingAxes) {
+		if (_mm_movemask_ps(separated) == 0b1111) break; //all the AABBs are already separated
+		__m128 projectedCenter = _mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(centerX, _mm_set1_ps(axis.x)),
+			_mm_mul_ps(centerY, _mm_set1_ps(axis.y))),
+			_mm_mul_ps(centerZ, _mm_set1_ps(axis.z)));
+		__m128 projectedRadius = _mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(halfSizeX, _mm_set1_ps(abs(axis.x))),
+			_mm_mul_ps(halfSizeY, _mm_set1_ps(abs(axis.y)))),
+			_mm_mul_ps(halfSizeZ, _mm_set1_ps(abs(axis.z))));
+		separated = _mm_or_ps(separated, _mm_or_ps(
+			_mm_cmpgt_ps(_mm_sub_ps(projectedCenter, projectedRadius), _mm_set1_ps(max)),
+			_mm_cmplt_ps(_mm_add_ps(projectedCenter, projectedRadius), _mm_set1_ps(min))));
+	}
+	return _mm_movemask_ps(separated);
+}
+
+//shared implementation of the batch SAT for all the regions with precomputed separating axes
+template<std::size_t N, typename RegionType>
+static void areCollidingBatch(const RegionType& region, const array<collisionDetection::SeparatingAxis, N>& separatingAxes, bool testAxes, std::span<const Aabb> aabbs, std::span<bool> results) {
+	Aabb enclosingAabb = region.enclosingAabb();
+	int i = 0;
+	for (; i + 4 <= aabbs.size(); i += 4) {
+		int separated = separatedOnAnyAxis4(separatingAxes, enclosingAabb, testAxes, &aabbs[i]);
+		for (int j = 0; j < 4; ++j) results[i + j] = !((separated >> j) & 1);
+	}
+	//remaining AABBs
+	for (; i < aabbs.size(); ++i) results[i] = collisionDetection::areColliding(region, aabbs[i]);
+}
+
 bool collisionDetection::areColliding(const AabbForObb & aabbForObb, const Aabb & aabb) {
 	//first, we check if the enclosing AABB of the OBB overlaps with the AABB (it can save a lot of time)
+	//this is also equivalent to using the world axes as separating axes, since the enclosing AABB has the same projection of the OBB on them
 	bool aabbsColliding = areColliding(aabb, aabbForObb.enclosingAabb());
 	if (!aabbsColliding) return false;
 
 	//then we check whether the OBB is "almost" an AABB (in this case we can approximate the collision to the AABB v AABB case)
 	const Obb& obb = aabbForObb.obb;
-	if (almostAabb(obb)) return aabbsColliding;
-
-	//else, we have to use SAT
-	auto obbVertices = obb.getPoints();
-	auto aabbVertices = aabb.getPoints();
-
-	//these are the potential separating axes; we use lambdas in order to evaluate them lazily (important to avoid useless cross products in case of early outs)
-	auto axes = vector<function<Vector3()>>{
-		[]() { return Vector3{1,0,0}; },
-		[]() { return Vector3{0,1,0}; },
-		[]() { return Vector3{0,0,1}; },
-		[&obb]() { return obb.right; },
-		[&obb]() { return obb.up; },
-		[&obb]() { return obb.forward; },
-		[&obb]() { return cross(Vector3{1,0,0}, obb.right); },
-		[&obb]() { return cross(Vector3{1,0,0}, obb.up); },
-		[&obb]() { return cross(Vector3{1,0,0}, obb.forward); },
-		[&obb]() { return cross(Vector3{0,1,0}, obb.right); },
-		[&obb]() { return cross(Vector3{0,1,0}, obb.up); },
-		[&obb]() { return cross(Vector3{0,1,0}, obb.forward); },
-		[&obb]() { return cross(Vector3{0,0,1}, obb.right); },
-		[&obb]() { return cross(Vector3{0,0,1}, obb.up); },
-		[&obb]() { return cross(Vector3{0,0,1}, obb.forward); }
-	};
+	if (obb.isAlmostAabb()) return aabbsColliding;
 
-	for (auto& getAxis : axes) {
-		auto axis = getAxis();
-		//get the points that, after the projection, will be the outermost (both for the OBB and the AABB)
-		auto obbExtremesIndexes = projectedObbExtremes(axis, obb);
-		auto aabbExtremesIndexes = projectedAabbExtremes(axis);
+	//else, we have to use SAT on the remaining axes, which are precomputed by the OBB
+	return !separatedOnAnyAxis(obb.getSeparatingAxes(), aabb);
+}
 
-		// |--------------------|MA     MB    overlap iff mB <= MA && MB >= mA (not overlap iff mB > MA || MB < mA)
-			// mA             mB|-----------|
-		if (dot(aabbVertices[aabbExtremesIndexes.first], axis) > dot(obbVertices[obbExtremesIndexes.second], axis) ||
-			dot(aabbVertices[aabbExtremesIndexes.second], axis) < dot(obbVertices[obbExtremesIndexes.first], axis)) return false;
-	}
-	return true; //if we havent't found any axis where there is no overlap, boxes are colliding
+void collisionDetection::areColliding(const AabbForObb& aabbForObb, std::span<const Aabb> aabbs, std::span<bool> results) {
+	areCollidingBatch(aabbForObb, aabbForObb.obb.getSeparatingAxes(), !aabbForObb.obb.isAlmostAabb(), aabbs, results);
 }
 
 bool collisionDetection::areColliding(const Obb & obb, const Aabb & aabb) {
@@ -442,60 +659,35 @@ bool collisionDetection::areColliding(const Obb & obb, const Aabb & aabb) {
 }
 
 bool collisionDetection::areColliding(const Frustum & frustum, const Aabb & aabb) {
-	using namespace std;
-		using namespace glm;
+	//first, we test the AABB against the planes of the frustum, which solves the most common cases in one pass
+	auto containment = classify(frustum, aabb);
+	if (containment != Containment::Intersecting) return containment == Containment::Inside;
 
-	//first, we check if the enclosing AABB of the frustum overlaps with the AABB (it can save a lot of time)
+	//then, we check if the enclosing AABB of the frustum overlaps with the AABB
+	//this is also equivalent to using the world axes as separating axes, since the enclosing AABB has the same projection of the frustum on them
 	bool aabbsColliding = areColliding(aabb, frustum.enclosingAabb());
 	if (!aabbsColliding) return false;
 
-	//else, we have to use SAT
-	auto frustumVertices = frustum.getPoints();
-	auto aabbVertices = aabb.getPoints();
-
-	//these are the potential separating axes; we use lambdas in order to evaluate them lazily (important to avoid useless cross products in case of early outs)
-	auto axes = vector<function<Vector3()>>{
-		[]() { return Vector3{1,0,0}; },
-		[]() { return Vector3{0,1,0}; },
-		[]() { return Vector3{0,0,1}; },
-		[&frustum]() { return frustum.getFacesNormals()[0]; },
-		[&frustum]() { return frustum.getFacesNormals()[1]; },
-		[&frustum]() { return frustum.getFacesNormals()[2]; },
-		[&frustum]() { return frustum.getFacesNormals()[3]; },
-		[&frustum]() { return frustum.getFacesNormals()[4]; },
-		[&frustum]() { return frustum.getFacesNormals()[5]; },
-		[&frustum]() { return cross(Vector3{1,0,0}, frustum.getEdgesDirections()[0]); },
-		[&frustum]() { return cross(Vector3{1,0,0}, frustum.getEdgesDirections()[1]); },
-		[&frustum]() { return cross(Vector3{1,0,0}, frustum.getEdgesDirections()[2]); },
-		[&frustum]() { return cross(Vector3{1,0,0}, frustum.getEdgesDirections()[3]); },
-		[&frustum]() { return cross(Vector3{1,0,0}, frustum.getEdgesDirections()[4]); },
-		[&frustum]() { return cross(Vector3{1,0,0}, frustum.getEdgesDirections()[5]); },
-		[&frustum]() { return cross(Vector3{0,1,0}, frustum.getEdgesDirections()[0]); },
-		[&frustum]() { return cross(Vector3{0,1,0}, frustum.getEdgesDirections()[1]); },
-		[&frustum]() { return cross(Vector3{0,1,0}, frustum.getEdgesDirections()[2]); },
-		[&frustum]() { return cross(Vector3{0,1,0}, frustum.getEdgesDirections()[3]); },
-		[&frustum]() { return cross(Vector3{0,1,0}, frustum.getEdgesDirections()[4]); },
-		[&frustum]() { return cross(Vector3{0,1,0}, frustum.getEdgesDirections()[5]); },
-		[&frustum]() { return cross(Vector3{0,0,1}, frustum.getEdgesDirections()[0]); },
-		[&frustum]() { return cross(Vector3{0,0,1}, frustum.getEdgesDirections()[1]); },
-		[&frustum]() { return cross(Vector3{0,0,1}, frustum.getEdgesDirections()[2]); },
-		[&frustum]() { return cross(Vector3{0,0,1}, frustum.getEdgesDirections()[3]); },
-		[&frustum]() { return cross(Vector3{0,0,1}, frustum.getEdgesDirections()[4]); },
-		[&frustum]() { return cross(Vector3{0,0,1}, frustum.getEdgesDirections()[5]); }
-	};
+	//else, we have to use SAT on the remaining axes, which are precomputed by the frustum
+	return !separatedOnAnyAxis(frustum.getSeparatingAxes(), aabb);
+}
 
-	for (auto& getAxis : axes) {
-		auto axis = getAxis();
-		//get the points that, after the projection, will be the outermost (for the AABB we get the indexes, for the frustum the points themselves)
-		auto aabbExtremesIndexes = projectedAabbExtremes(axis);
-		auto frustumExtremes = projectedFrustumExtremes(axis, frustum);
+void collisionDetection::areColliding(const Frustum& frustum, std::span<const Aabb> aabbs, std::span<bool> results) {
+	areCollidingBatch(frustum, frustum.getSeparatingAxes(), true, aabbs, results);
+}
 
-		// |--------------------|MA     MB    overlap iff mB <= MA && MB >= mA (not overlap iff mB > MA || MB < mA)
-		// mA             mB|-----------|
-		if (dot(aabbVertices[aabbExtremesIndexes.first], axis) > frustumExtremes.second ||
-			dot(aabbVertices[aabbExtremesIndexes.second], axis) < frustumExtremes.first) return false;
+collisionDetection::Containment collisionDetection::classify(const Frustum& frustum, const Aabb& aabb) {
+	Vector3 center = aabb.center(), halfSize = aabb.size() / 2.0f;
+	bool intersecting = false;
+	for (const auto& plane : frustum.getPlanes()) {
+		Vector3 normal{ plane };
+		//the signed distances of the n-vertex and of the p-vertex are the signed distance of the center -/+ the projection of the half size on the normal
+		float centerDistance = dot(normal, center) + plane.w;
+		float projectedRadius = abs(normal.x) * halfSize.x + abs(normal.y) * halfSize.y + abs(normal.z) * halfSize.z;
+		if (centerDistance - projectedRadius > 0.0f) return Containment::Outside; //n-vertex outside
+		if (centerDistance + projectedRadius > 0.0f) intersecting = true; //p-vertex outside
 	}
-	return true; //if we havent't found any axis where there is no overlap, boxes are colliding
+	return intersecting ? Containment::Intersecting : Containment::Inside;
 }
 
 collisionDetection::RayCollisionInfo pah::collisionDetection::areColliding(const Ray& ray, const Aabb& aabb) {
@@ -532,6 +724,72 @@ collisionDetection::RayCollisionInfo pah::collisionDetection::areColliding(const
 	return { tMax >= tMin && tMax >= 0, tMin >= 0 ? tMin : tMax };
 }
 
+//same as areColliding(Ray, Aabb), but with the inverse of the direction already computed
+static bool isSlabHit(const Vector3& origin, const Vector3& inverseDirection, const Aabb& aabb) {
+	Vector3 t1 = (aabb.min - origin) * inverseDirection;
+	Vector3 t2 = (aabb.max - origin) * inverseDirection;
+	Vector3 tMins = glm::min(t1, t2), tMaxs = glm::max(t1, t2);
+	float tMin = glm::max(tMins.x, glm::max(tMins.y, tMins.z));
+	float tMax = glm::min(tMaxs.x, glm::min(tMaxs.y, tMaxs.z));
+	return tMax >= tMin && tMax >= 0;
+}
+
+//SSE version of the slab test, it works on 4 Aabbs at a time and stores in hitsCounts[i] the number of the rays (among raysIndices) that hit aabbs[i]
+static void countCollisions4(const SampleRays& rays, std::span<const int> raysIndices, const Aabb* aabbs, int* hitsCounts) {
+	//structure of arrays layout: each register holds the same coordinate of the 4 AABBs
+	__m128 minX = _mm_set_ps(aabbs[3].min.x, aabbs[2].min.x, aabbs[1].min.x, aabbs[0].min.x);
+	__m128 minY = _mm_set_ps(aabbs[3].min.y, aabbs[2].min.y, aabbs[1].min.y, aabbs[0].min.y);
+	__m128 minZ = _mm_set_ps(aabbs[3].min.z, aabbs[2].min.z, aabbs[1].min.z, aabbs[0].min.z);
+	__m128 maxX = _mm_set_ps(aabbs[3].max.x, aabbs[2].max.x, aabbs[1].max.x, aabbs[0].max.x);
+	__m128 maxY = _mm_set_ps(aabbs[3].max.y, aabbs[2].max.y, aabbs[1].max.y, aabbs[0].max.y);
+	__m128 maxZ = _mm_set_ps(aabbs[3].max.z, aabbs[2].max.z, aabbs[1].max.z, aabbs[0].max.z);
+
+	__m128i counts = _mm_setzero_si128();
+	for (int r : raysIndices) {
+		const Vector3& origin = rays.origins[r];
+		const Vector3& inverseDirection = rays.inverseDirections[r];
+		__m128 originX = _mm_set1_ps(origin.x), inverseDirectionX = _mm_set1_ps(inverseDirection.x);
+		__m128 originY = _mm_set1_ps(origin.y), inverseDirectionY = _mm_set1_ps(inverseDirection.y);
+		__m128 originZ = _mm_set1_ps(origin.z), inverseDirectionZ = _mm_set1_ps(inverseDirection.z);
+
+		__m128 tX1 = _mm_mul_ps(_mm_sub_ps(minX, originX), inverseDirectionX), tX2 = _mm_mul_ps(_mm_sub_ps(maxX, originX), inverseDirectionX);
+		__m128 tY1 = _mm_mul_ps(_mm_sub_ps(minY, originY), inverseDirectionY), tY2 = _mm_mul_ps(_mm_sub_ps(maxY, originY), inverseDirectionY);
+		__m128 tZ1 = _mm_mul_ps(_mm_sub_ps(minZ, originZ), inverseDirectionZ), tZ2 = _mm_mul_ps(_mm_sub_ps(maxZ, originZ), inverseDirectionZ);
+
+		__m128 tMin = _mm_max_ps(_mm_max_ps(_mm_min_ps(tX1, tX2), _mm_min_ps(tY1, tY2)), _mm_min_ps(tZ1, tZ2));
+		__m128 tMax = _mm_min_ps(_mm_min_ps(_mm_max_ps(tX1, tX2), _mm_max_ps(tY1, tY2)), _mm_max_ps(tZ1, tZ2));
+		__m128 hit = _mm_and_ps(_mm_cmpge_ps(tMax, tMin), _mm_cmpge_ps(tMax, _mm_setzero_ps()));
+		counts = _mm_sub_epi32(counts, _mm_castps_si128(hit)); //the lanes of a hit are all 1s, that is -1
+	}
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(hitsCounts), counts);
+}
+
+void pah::collisionDetection::countCollisions(const SampleRays& rays, std::span<const Aabb> aabbs, std::span<int> hitsCounts) {
+	if (aabbs.empty()) return;
+
+	//a ray that misses the enclosing AABB cannot hit any of the AABBs, so we test each ray only once against it
+	Aabb enclosingAabb = aabbs[0];
+	for (const auto& aabb : aabbs) {
+		enclosingAabb.min = glm::min(enclosingAabb.min, aabb.min);
+		enclosingAabb.max = glm::max(enclosingAabb.max, aabb.max);
+	}
+	vector<int> raysIndices{};
+	for (int r = 0; r < rays.size(); ++r) {
+		if (isSlabHit(rays.origins[r], rays.inverseDirections[r], enclosingAabb)) raysIndices.push_back(r);
+	}
+
+	int i = 0;
+	for (; i + 4 <= aabbs.size(); i += 4) countCollisions4(rays, raysIndices, &aabbs[i], &hitsCounts[i]);
+	//remaining AABBs: we pad the last group with copies of the last AABB and discard their counts
+	if (i < aabbs.size()) {
+		array<Aabb, 4> lastAabbs;
+		array<int, 4> lastHitsCounts;
+		for (int j = 0; j < 4; ++j) lastAabbs[j] = aabbs[glm::min(i + j, (int)aabbs.size() - 1)];
+		countCollisions4(rays, raysIndices, lastAabbs.data(), lastHitsCounts.data());
+		for (int j = 0; i + j < aabbs.size(); ++j) hitsCounts[i + j] = lastHitsCounts[j];
+	}
+}
+
 collisionDetection::RayCollisionInfo pah::collisionDetection::areColliding(const Ray& ray, const Plane& plane) {
 	const auto& R = ray.getDirection(); //direction of the ray
 	const auto& O = ray.getOrigin(); //origin
@@ -602,8 +860,8 @@ pair<int, int> collisionDetection::projectedAabbExtremes(const Vector3 & axis) {
 }
 
 pair<int, int> collisionDetection::projectedObbExtremes(const Vector3 & axis, const Obb & obb) {
-	Matrix3 newBasis{ obb.right, obb.up, obb.forward };
-	Vector3 newAxis = inverse(newBasis) * axis;
+	//the basis is orthonormal, therefore its inverse is its transpose, and the change of basis is just a dot product with each of the OBB directions
+	Vector3 newAxis{ dot(axis, obb.right), dot(axis, obb.up), dot(axis, obb.forward) };
 	return projectedAabbExtremes(newAxis);
 }
 
@@ -2,6 +2,8 @@
 
 #include <functional>
 #include <limits>
+#include <array>
+#include <span>
 #include "glm/glm.hpp"
 
 #include "Utilities.h"
@@ -26,6 +28,23 @@ namespace pah {
 			float distance;
 		};
 
+		/**
+		 * @brief A potential separating axis of a convex @p Region, together with the extremes of the projection of the @p Region on it.
+		 * Regions precompute them at construction, so that the separating axis theorem doesn't have to build the axes at each test.
+		 */
+		struct SeparatingAxis {
+			Vector3 axis;
+			float min;
+			float max;
+		};
+
+		/**
+		 * @brief The position of an @p Aabb relative to a @p Region.
+		 */
+		enum class Containment {
+			Outside, Intersecting, Inside
+		};
+
 		/**
 		 * @brief Returns whether 2 @p Aabb s are colliding.
 		 */
@@ -36,6 +55,12 @@ namespace pah {
 		 */
 		bool areColliding(const AabbForObb& aabbForObb, const Aabb& aabb);
 
+		/**
+		 * @brief Tests an @p AabbForObb against a batch of @p Aabb s: @p results[i] is whether @p aabbs[i] is colliding with the region.
+		 * The separating axis theorem is evaluated on 4 @p Aabb s at a time with SSE instructions.
+		 */
+		void areColliding(const AabbForObb& aabbForObb, std::span<const Aabb> aabbs, std::span<bool> results);
+
 		/**
 		 * @brief Implementation of the separating axis theorem between an @p Obb and an @p Aabb.
 		 */
@@ -46,6 +71,20 @@ namespace pah {
 		 */
 		bool areColliding(const Frustum& frustum, const Aabb& aabb);
 
+		/**
+		 * @brief Tests a @p Frustum against a batch of @p Aabb s: @p results[i] is whether @p aabbs[i] is colliding with the frustum.
+		 * The separating axis theorem is evaluated on 4 @p Aabb s at a time with SSE instructions.
+		 */
+		void areColliding(const Frustum& frustum, std::span<const Aabb> aabbs, std::span<bool> results);
+
+		/**
+		 * @brief Classifies an @p Aabb against the 6 planes of a @p Frustum in one pass, with the p-vertex/n-vertex test.
+		 * For each plane, if the vertex of the @p Aabb that is most inside the plane (n-vertex) is outside, the whole @p Aabb is outside; 
+		 * if the vertex that is most outside (p-vertex) is inside for all the planes, the whole @p Aabb is inside.
+		 * @p Containment::Intersecting is conservative: near the edges of the frustum an @p Aabb can be outside without being fully behind a single plane.
+		 */
+		Containment classify(const Frustum& frustum, const Aabb& aabb);
+
 		/**
 		 * @brief Returns whether a @p Ray is colliding with an @p Aabb, and the distance of the hit (if present).
 		 * Implementation of the branchless slab ray-box intersection algorithm (https://tavianator.com/2011/ray_box.html).
@@ -53,6 +92,12 @@ namespace pah {
 		 */
 		RayCollisionInfo areColliding(const Ray& ray, const Aabb& aabb);
 
+		/**
+		 * @brief Counts how many of the @p SampleRays hit each @p Aabb: @p hitsCounts[i] is the number of rays colliding with @p aabbs[i].
+		 * The rays that miss the @p Aabb enclosing all the @p aabbs are discarded first, then the slab test is evaluated on 4 @p Aabb s at a time with SSE instructions.
+		 */
+		void countCollisions(const SampleRays& rays, std::span<const Aabb> aabbs, std::span<int> hitsCounts);
+
 		/** 
 		 * @brief Returns whether a @p Ray is colliding with an @p Aabb, and the distance of the hit (if present).
 		 */
@@ -95,6 +140,7 @@ namespace pah {
 		/**
 		 * @brief Given an axis and an @p Obb, it returns the indexes of the vertices (min and max) that are most far apart (the extremes) on the projection of an AABB to the specified axis.
 		 * What happens is that the function transforms the axis into the OBB coordinate system, and then treats it like an AABB.
+		 * Since the basis of the OBB is orthonormal, the transformation is just 3 dot products (no need to invert the basis matrix).
 		 */
 		std::pair<int, int> projectedObbExtremes(const Vector3& axis, const Obb& obb);
 
@@ -119,6 +165,12 @@ namespace pah {
 		 */
 		virtual bool contains(const Vector3& point) const = 0;
 
+		/**
+		 * @brief Tests a batch of points: @p results[i] is whether @p points[i] is inside the region.
+		 * The default implementation calls the single point version for each element, regions with a vectorized test override it.
+		 */
+		virtual void contains(std::span<const Vector3> points, std::span<bool> results) const;
+
 		/**
 		 * @brief Returns the enclosing @p Aabb.
 		 */
@@ -130,11 +182,22 @@ namespace pah {
 		 */
 		virtual bool isCollidingWith(const Aabb& aabb) const = 0;
 
+		/**
+		 * @brief Tests this @p Region against a batch of @p Aabb s: @p results[i] is whether @p aabbs[i] is colliding with this @p Region.
+		 * The default implementation calls the single @p Aabb version for each element, regions with a vectorized test override it.
+		 */
+		virtual void isCollidingWith(std::span<const Aabb> aabbs, std::span<bool> results) const;
+
 		/**
 		 * @brief Returns whether this @p Region fully contains the specified @p Aabb.
 		 * We make this a method in order to make use of the runtime polymorphism features of C++.
 		 */
 		virtual bool fullyContains(const Aabb& aabb) const = 0;
+
+		/**
+		 * @brief Returns the 6 planes the faces of this @p Region lie on. The normals always point outside of the @p Region.
+		 */
+		virtual std::array<Plane, 6> getFaces() const = 0;
 	};
 
 	/**
@@ -151,14 +214,21 @@ namespace pah {
 		Aabb(const std::vector<const Triangle*>& triangles);
 		Aabb(const Vector3& min, const Vector3& max);
 
+		using Region::contains;
 		bool contains(const Vector3& point) const override;
 
 		Aabb enclosingAabb() const override;
 		
+		using Region::isCollidingWith;
 		bool isCollidingWith(const Aabb& aabb) const override;
 
 		bool fullyContains(const Aabb& aabb) const override;
 
+		/**
+		 * @brief Returns the faces in this order: left, right, bottom, top, back, front.
+		 */
+		std::array<Plane, 6> getFaces() const override;
+
 		/**
 		 * @brief Returns the center of the AABB.
 		 */
@@ -224,6 +294,16 @@ namespace pah {
 		 * @brief Adds toghether 2 @p Aabb s.
 		 */
 		friend Aabb& operator+(Aabb lhs, const Aabb& rhs);
+
+		/**
+		 * @brief Returns the @p Aabb shared by this and @p aabb. If they don't overlap, it is empty (@p min is greater than @p max along some axis).
+		 */
+		Aabb intersection(const Aabb& aabb) const;
+
+		/**
+		 * @brief Returns the tightest @p Aabb enclosing the part of @p triangle inside this @p Aabb (the same as @p minAabb if there is none).
+		 */
+		Aabb clip(const Triangle& triangle) const;
 	};
 
 	/**
@@ -239,14 +319,21 @@ namespace pah {
 
 		Obb(const Vector3& center, const Vector3& halfSize, const Vector3& forward);
 
+		using Region::contains;
 		bool contains(const Vector3& point) const override;
 
 		Aabb enclosingAabb() const override;
 
+		using Region::isCollidingWith;
 		bool isCollidingWith(const Aabb& aabb) const override;
 
 		bool fullyContains(const Aabb& aabb) const override;
 
+		/**
+		 * @brief Returns the faces in this order: left, right, bottom, top, back, front (in the OBB coordinate system).
+		 */
+		std::array<Plane, 6> getFaces() const override;
+
 
 		/**
 		 * @brief Given an OBB returns the array of its 8 vertices with this layout:
@@ -260,6 +347,26 @@ namespace pah {
 		 * See pah::Aabb::getPoint for more info about the logic of this layout.
 		 */
 		std::array<Vector3, 8> getPoints() const;
+
+		/**
+		 * @brief Returns the potential separating axes between this @p Obb and any @p Aabb (computed at construction).
+		 * The world axes are not included, since testing them is equivalent to testing the enclosing @p Aabb.
+		 */
+		const std::array<collisionDetection::SeparatingAxis, 12>& getSeparatingAxes() const;
+
+		/**
+		 * @brief Returns whether this @p Obb is "almost" an @p Aabb (look at @p collisionDetection::almostAabb). Computed at construction.
+		 */
+		bool isAlmostAabb() const;
+
+	private:
+		/**
+		 * @brief Fills the array of the separating axes, by projecting the @p Obb on its 3 directions and on their cross products with the world axes.
+		 */
+		void fillSeparatingAxes();
+
+		std::array<collisionDetection::SeparatingAxis, 12> separatingAxes; //useful for the SAT algorithm for collision detection
+		bool almostAabbObj; //if true, the collision detection can treat this OBB as its enclosing AABB
 	};
 
 	/**
@@ -272,13 +379,21 @@ namespace pah {
 		AabbForObb(const Vector3& center, const Vector3& halfSize, const Vector3& forward);
 		AabbForObb(const Obb& obb);
 
+		using Region::contains;
 		bool contains(const Vector3& point) const override;
 
 		Aabb enclosingAabb() const override;
 
 		bool isCollidingWith(const Aabb& aabb) const override;
 
+		void isCollidingWith(std::span<const Aabb> aabbs, std::span<bool> results) const override;
+
 		bool fullyContains(const Aabb& aabb) const override;
+
+		/**
+		 * @brief Returns the faces of the OBB (the enclosing AABB is only an acceleration structure).
+		 */
+		std::array<Plane, 6> getFaces() const override;
 	};
 
 	/**
@@ -315,22 +430,49 @@ namespace pah {
 		}*/
 
 		/**
-		 * @brief 2D visualization: https://www.geogebra.org/m/zmbraqmp
+		 * @brief Tests the point against the 6 planes of the frustum.
 		 */
 		bool contains(const Vector3& point) const override;
 
+		/**
+		 * @brief Tests 4 points at a time against the 6 planes of the frustum with SSE instructions.
+		 */
+		void contains(std::span<const Vector3> points, std::span<bool> results) const override;
+
 		Aabb enclosingAabb() const override;
 
+		/**
+		 * @brief The planes test (@p collisionDetection::classify) solves most cases, the separating axis theorem is used only when the result is ambiguous.
+		 */
 		bool isCollidingWith(const Aabb& aabb) const override;
 
+		void isCollidingWith(std::span<const Aabb> aabbs, std::span<bool> results) const override;
+
 		bool fullyContains(const Aabb& aabb) const override;
 
+		/**
+		 * @brief Returns the faces in the same order of @p getFacesNormals: left, right, bottom, top, near, far.
+		 */
+		std::array<Plane, 6> getFaces() const override;
+
 		std::array<Vector3, 8> getPoints() const;
 
 		std::array<Vector3, 6> getEdgesDirections() const;
 
 		std::array<Vector3, 6> getFacesNormals() const;
 
+		/**
+		 * @brief Returns the potential separating axes between this @p Frustum and any @p Aabb (computed at construction).
+		 * The world axes are not included, since testing them is equivalent to testing the enclosing @p Aabb.
+		 */
+		const std::array<collisionDetection::SeparatingAxis, 24>& getSeparatingAxes() const;
+
+		/**
+		 * @brief Returns the 6 planes of the frustum (same order of @p getFacesNormals) in the form <a,b,c,d>, where <a,b,c> is the outward normal.
+		 * A point p is inside the plane iff a*p.x + b*p.y + c*p.z + d <= 0.
+		 */
+		const std::array<Vector4, 6>& getPlanes() const;
+
 		/**
 		 * @brief Returns the stored view projection matrix..
 		 */
@@ -377,10 +519,24 @@ namespace pah {
 		 */
 		void fillEnclosingAabb();
 
+		/**
+		 * @brief Fills the array of the separating axes: the normals to the faces and the cross products between the edges directions and the world axes.
+		 * @pre This function should only be called after @p fillVertices, @p fillEdgesDirection and @p fillFacesNormals.
+		 */
+		void fillSeparatingAxes();
+
+		/**
+		 * @brief Fills the array of the 6 planes of the frustum.
+		 * @pre This function should only be called after @p fillVertices and @p fillFacesNormals.
+		 */
+		void fillPlanes();
+
 		Matrix4 viewProjectionMatrix; //a frustum can be represented as a projection matrix (to define its shape) and a view matrix (to set its position)
 		std::array<Vector3, 6> facesNormals; //useful for the SAT algorithm for collision detection
 		std::array<Vector3, 6> edgesDirections; //useful for the SAT algorithm for collision detection
 		std::array<Vector3, 8> vertices; //useful for the SAT algorithm for collision detection
 		Aabb enclosingAabbObj; //the smallest Aabb that encloses the Frustum
+		std::array<collisionDetection::SeparatingAxis, 24> separatingAxes; //useful for the SAT algorithm for collision detection
+		std::array<Vector4, 6> planes; //useful for containment tests
 	};
 }
@@ -82,6 +82,38 @@ namespace pah {
 			return { analysis, traversal.first, traversal.second };
 		}
 
+		/**
+		 * @brief Follows a scripted path of the influence areas (e.g. a camera path): the TopLevel is built once, then at each frame @p moveInfluenceAreas moves them (and regenerates the rays of the RayCasters), and the TopLevel is updated instead of being rebuilt (see @p TopLevel::update).
+		 * For each frame, it collects the update time, how much the cost of each Bvh drifted since it was built (before its degraded subtrees were rebuilt, see @p Bvh::refit), and the traversal cost. Returns the results.
+		 */
+		json followPath(int frames, const std::function<void(int frame)>& moveInfluenceAreas) {
+			std::string name{}; for (int i = outputFolderPath.length() - 1; i >= 0 && outputFolderPath[i] != '/'; --i) name = outputFolderPath[i] + name;
+
+			std::cout << "- Started following the path of " + name + " ..." << std::endl;
+			topLevel->build(triangles);
+			json results = json::array();
+			for (int frame = 0; frame < frames; ++frame) {
+				moveInfluenceAreas(frame);
+				topLevel->update();
+
+				json frameResults{};
+				frameResults["frame"] = frame;
+				INFO(frameResults["updateTime"] = topLevel->getLastUpdateTime().count(););
+				for (const auto& bvh : topLevel->getBvhs()) {
+					frameResults["bvhs"].push_back(json{ { "name", bvh.name }, { "refit", bvh.getLastRefitResults() } });
+				}
+				auto traversal = std::ranges::fold_left(rayCasters, CumulativeRayCasterResults{}, [this](auto res, auto rayCaster) { return res + rayCaster->castRays(*topLevel); });
+				frameResults["traversalCostAveragePerRay"] = traversal.traversalCostAveragePerRay();
+				results.push_back(frameResults);
+			}
+
+			std::ofstream pathResultsFile{ outputFolderPath + "/PathResults.json" };
+			pathResultsFile << std::setw(2) << results;
+			pathResultsFile.close();
+			std::cout << "+ " + name + " path followed" << std::endl << std::endl;
+			return results;
+		}
+
 	private:
 		const std::vector<Triangle> triangles;
 		VectorOfRayCasters rayCasters;
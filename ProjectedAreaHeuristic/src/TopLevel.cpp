@@ -1,6 +1,7 @@
 #include "TopLevel.h"
 
 #include <ranges>
+#include <algorithm>
 #include <unordered_set>
 #include <unordered_map>
 #include <exception>
@@ -15,8 +16,50 @@ using namespace pah::utilities;
 // ======| TopLevel |======
 void pah::TopLevel::build(const std::vector<Triangle>& triangles) {
 	lastBuildTriangles = &triangles; //save a pointer to the triangles for this build
+	saveRegions();
 	fallbackBvh.build(triangles); //build the fallback BVH with all the triangles
 
+	auto bvhsTriangles = classifyTriangles(triangles); //maps the BVH and the triangles it contains
+
+	//build the BVHs with the corresponding triangles
+	for (auto& bvh : bvhs) {
+		bvh.build(bvhsTriangles[&bvh]);
+	}
+}
+
+void pah::TopLevel::update() {
+	INFO(TimeLogger timeLogger{ [this](DurationMs duration) { lastUpdateTime = duration; } });
+	fallbackBvh.refit(); //the fallback BVH contains every triangle, so only its nodes change
+
+	auto bvhsTriangles = classifyTriangles(*lastBuildTriangles); //the triangles may have moved to other regions
+	for (auto& bvh : bvhs) {
+		bvh.update(bvhsTriangles[&bvh]);
+	}
+}
+
+void pah::TopLevel::saveRegions() {
+	lastRegions.clear();
+	for (const auto& bvh : bvhs) {
+		const auto& region = bvh.getInfluenceArea()->getBvhRegion();
+		lastRegions.emplace_back(region.getFaces(), region.enclosingAabb());
+	}
+}
+
+vector<Aabb> pah::TopLevel::movedRegions() const {
+	auto samePlane = [](const Plane& p1, const Plane& p2) { return p1.getPoint() == p2.getPoint() && p1.getNormal() == p2.getNormal(); };
+
+	vector<Aabb> changedAabbs;
+	for (int i = 0; i < bvhs.size(); ++i) {
+		const auto& region = bvhs[i].getInfluenceArea()->getBvhRegion();
+		auto faces = region.getFaces();
+		if (std::ranges::equal(faces, lastRegions[i].first, samePlane)) continue;
+		changedAabbs.push_back(lastRegions[i].second);
+		changedAabbs.push_back(region.enclosingAabb());
+	}
+	return changedAabbs;
+}
+
+unordered_map<const pah::Bvh*, vector<const Triangle*>> pah::TopLevel::classifyTriangles(const std::vector<Triangle>& triangles) const {
 	unordered_map<const pah::Bvh*, vector<const Triangle*>> bvhsTriangles; //maps the BVH and the triangles it contains
 	//understand the BVHs each triangle is contained into
 	for (const auto& t : triangles) {
@@ -30,11 +73,7 @@ void pah::TopLevel::build(const std::vector<Triangle>& triangles) {
 		//add the triangle to each BVH where it is contained into (at least one vertex)
 		for (const auto& bvh : containedInto) bvhsTriangles[bvh].push_back(&t);
 	}
-
-	//build the BVHs with the corresponding triangles
-	for (auto& bvh : bvhs) {
-		bvh.build(bvhsTriangles[&bvh]);
-	}
+	return bvhsTriangles;
 }
 
 TopLevel::TraversalResults pah::TopLevel::traverse(const Ray& ray) const {
@@ -83,13 +122,37 @@ const std::vector<Triangle>& pah::TopLevel::getLastBuildTriangles() const {
 	return *lastBuildTriangles;
 }
 
+INFO(const DurationMs pah::TopLevel::getLastUpdateTime() const {
+	return lastUpdateTime;
+})
+
 // ======| TopLevelAabbs |======
 void pah::TopLevelAabbs::build(const std::vector<Triangle>& triangles) {
 	TopLevel::build(triangles);
 }
 
-void pah::TopLevelAabbs::update() {
-	
+unordered_map<const pah::Bvh*, vector<const Triangle*>> pah::TopLevelAabbs::classifyTriangles(const std::vector<Triangle>& triangles) const {
+	//flatten the vertices of all the triangles, so that each region can test them in one batch
+	vector<Vector3> vertices;
+	vertices.reserve(triangles.size() * 3);
+	for (const auto& t : triangles) {
+		vertices.push_back(t[0]);
+		vertices.push_back(t[1]);
+		vertices.push_back(t[2]);
+	}
+
+	unordered_map<const pah::Bvh*, vector<const Triangle*>> bvhsTriangles; //maps the BVH and the triangles it contains
+	auto inside = make_unique<bool[]>(vertices.size()); //reused by all the regions
+	for (const auto& bvh : bvhs) {
+		bvh.getInfluenceArea()->getBvhRegion().contains(vertices, std::span{ inside.get(), vertices.size() });
+
+		//add the triangle to the BVH if it is contained into it (at least one vertex)
+		auto& bvhTriangles = bvhsTriangles[&bvh];
+		for (int i = 0; i < triangles.size(); ++i) {
+			if (inside[i * 3] || inside[i * 3 + 1] || inside[i * 3 + 2]) bvhTriangles.push_back(&triangles[i]);
+		}
+	}
+	return bvhsTriangles;
 }
 
 vector<const pah::Bvh*> pah::TopLevelAabbs::containedIn(const Vector3& point) const {
@@ -108,6 +171,7 @@ void pah::TopLevelOctree::build(const std::vector<Triangle>& triangles) {
 	INFO(TimeLogger timeLoggerTotalBuild{ [this](DurationMs duration) { totalBuildTime = duration; } });
 
 	//build the octree
+	//all the regions collide with the root, since its AABB encloses all of them
 	auto bvhsPointers = bvhs | std::views::transform([](Bvh& bvh) { return &bvh; }) | std::ranges::to<vector>(); //make vector of pointers
 	buildOctreeRecursive(root, bvhsPointers, {});
 
@@ -116,7 +180,27 @@ void pah::TopLevelOctree::build(const std::vector<Triangle>& triangles) {
 }
 
 void pah::TopLevelOctree::update() {
-	throw exception{ "TopLevelOctree::update function not implemented yet." };
+	INFO(TimeLogger timeLogger{ [this](DurationMs duration) { lastUpdateTime = duration; } });
+
+	auto changedAabbs = movedRegions();
+	if (!changedAabbs.empty()) {
+		auto bvhsPointers = bvhs | std::views::transform([](Bvh& bvh) { return &bvh; }) | std::ranges::to<vector>(); //make vector of pointers
+		Aabb sceneAabb = Aabb::minAabb();
+		for (const auto& bvh : bvhs) {
+			sceneAabb += bvh.getInfluenceArea()->getBvhRegion().enclosingAabb();
+		}
+
+		if (root.aabb.fullyContains(sceneAabb)) updateOctreeRecursive(root, bvhsPointers, {}, changedAabbs);
+		else { //the cells are fractions of the root, so they all change with it
+			sceneAabb += root.aabb;
+			root = Node{ sceneAabb };
+			buildOctreeRecursive(root, bvhsPointers, {});
+		}
+		saveRegions();
+	}
+
+	//update the BVHs
+	TopLevel::update();
 }
 
 vector<const pah::Bvh*> pah::TopLevelOctree::containedIn(const Vector3& point) const {
@@ -144,23 +228,21 @@ TopLevelOctree::OctreeProperties pah::TopLevelOctree::getOctreeProperties() cons
 	return octreeProperties;
 }
 
-void pah::TopLevelOctree::buildOctreeRecursive(Node& node, const vector<Bvh*>& fatherCollidingRegions, const vector<Bvh*>& fatherFullyContainedRegions, int currentLevel) {
+void pah::TopLevelOctree::buildOctreeRecursive(Node& node, const vector<Bvh*>& collidingRegions, const vector<Bvh*>& fatherFullyContainedRegions, int currentLevel) {
 	TIME(TimeLogger timeLoggerTotal{ [&timingInfo = node.timingInfo](DurationMs duration) { timingInfo.logTotal(duration); } };);
 
-	vector<Bvh*> collidingRegions;
+	vector<Bvh*> partiallyCollidingRegions;
 	node.bvhs = fatherFullyContainedRegions; //if the father node was fully contained in some region, for sure the child will also be
 	bool leafNode = true; //this will become false if there is a region that intersects the node, but doesn't fully contain it
 
-	//for each region that collided with the father, but didn't fully contained it, we have to check what happens with the child
-	for (const auto& bvh : fatherCollidingRegions) {
-		if (bvh->getInfluenceArea()->getBvhRegion().isCollidingWith(node.aabb)) {
-			if (bvh->getInfluenceArea()->getBvhRegion().fullyContains(node.aabb)) {
-				node.bvhs.push_back(bvh);
-			}
-			else {
-				collidingRegions.push_back(bvh);
-				leafNode = false;
-			}
+	//the father already checked which regions collide with this node, we only have to check whether they fully contain it
+	for (const auto& bvh : collidingRegions) {
+		if (bvh->getInfluenceArea()->getBvhRegion().fullyContains(node.aabb)) {
+			node.bvhs.push_back(bvh);
+		}
+		else {
+			partiallyCollidingRegions.push_back(bvh);
+			leafNode = false;
 		}
 	}
 
@@ -168,17 +250,31 @@ void pah::TopLevelOctree::buildOctreeRecursive(Node& node, const vector<Bvh*>& f
 	node.setLeaf(leafNode || currentLevel >= octreeProperties.maxLevel);
 	if (!node.isLeaf()) {
 		currentLevel++;
+		array<Aabb, 8> childrenAabbs;
 		for (int i = 0; i < 8; ++i) {
-			auto& child = node.children[i];
 			Vector3 halfExtents = (node.aabb.max - node.aabb.min) / 2.0f;
 			Vector3 position = indexToPosition(i); //the bottommost, downmost, backwardmost octant is represented by <0,0,0>, the opposite by <1,1,1>, and everything in between
-			Aabb childAabb{
+			childrenAabbs[i] = Aabb{
 				node.aabb.min + halfExtents * position,
 				node.aabb.max - halfExtents * (Vector3{1.0f, 1.0f, 1.0f} - position)
 			};
-			child = make_unique<Node>(childAabb); //create empty child
+		}
+
+		//each region is tested against the 8 children at once (regions can do it with a vectorized test)
+		array<vector<Bvh*>, 8> childrenCollidingRegions;
+		for (const auto& bvh : partiallyCollidingRegions) {
+			array<bool, 8> colliding;
+			bvh->getInfluenceArea()->getBvhRegion().isCollidingWith(childrenAabbs, colliding);
+			for (int i = 0; i < 8; ++i) {
+				if (colliding[i]) childrenCollidingRegions[i].push_back(bvh);
+			}
+		}
+
+		for (int i = 0; i < 8; ++i) {
+			auto& child = node.children[i];
+			child = make_unique<Node>(childrenAabbs[i]); //create empty child
 			TIME(timeLoggerTotal.pause();); //in the time for this node, we don't want to include the time used to build all its descendents
-			buildOctreeRecursive(*child, collidingRegions, node.bvhs, currentLevel); //build child
+			buildOctreeRecursive(*child, childrenCollidingRegions[i], node.bvhs, currentLevel); //build child
 			TIME(timeLoggerTotal.resume(););
 		}
 	}
@@ -186,7 +282,46 @@ void pah::TopLevelOctree::buildOctreeRecursive(Node& node, const vector<Bvh*>& f
 	//If conservativeApproach is true, the node only contains the regions that fully contain it.
 	//In this way we have slightly smaller regions than the original, since it is likely that, at the border of the region, it wouldn't be useful to look in the local BVH first.
 	//On the other hand, this can give rise to not fully connected regions.
-	if(!octreeProperties.conservativeApproach) node.bvhs.append_range(collidingRegions);
+	if(!octreeProperties.conservativeApproach) node.bvhs.append_range(partiallyCollidingRegions);
+}
+
+void pah::TopLevelOctree::updateOctreeRecursive(Node& node, const vector<Bvh*>& collidingRegions, const vector<Bvh*>& fatherFullyContainedRegions, const vector<Aabb>& changedAabbs, int currentLevel) {
+	//the regions of the nodes far from the moved regions didn't change
+	if (std::ranges::none_of(changedAabbs, [&node](const Aabb& aabb) { return aabb.isCollidingWith(node.aabb); })) return;
+
+	//look at the analogue code in TopLevelOctree::buildOctreeRecursive
+	vector<Bvh*> fullyContainingRegions, partiallyCollidingRegions;
+	for (const auto& bvh : collidingRegions) {
+		if (bvh->getInfluenceArea()->getBvhRegion().fullyContains(node.aabb)) fullyContainingRegions.push_back(bvh);
+		else partiallyCollidingRegions.push_back(bvh);
+	}
+
+	//if node is (or becomes) a leaf, its subtree is built again
+	if (node.isLeaf() || partiallyCollidingRegions.empty() || currentLevel >= octreeProperties.maxLevel) {
+		for (auto& child : node.children) child.reset();
+		node.resetLeaf();
+		buildOctreeRecursive(node, collidingRegions, fatherFullyContainedRegions, currentLevel);
+		return;
+	}
+
+	node.bvhs = fatherFullyContainedRegions;
+	node.bvhs.append_range(fullyContainingRegions);
+	currentLevel++;
+	array<Aabb, 8> childrenAabbs;
+	for (int i = 0; i < 8; ++i) childrenAabbs[i] = node.children[i]->aabb;
+	array<vector<Bvh*>, 8> childrenCollidingRegions;
+	for (const auto& bvh : partiallyCollidingRegions) {
+		array<bool, 8> colliding;
+		bvh->getInfluenceArea()->getBvhRegion().isCollidingWith(childrenAabbs, colliding);
+		for (int i = 0; i < 8; ++i) {
+			if (colliding[i]) childrenCollidingRegions[i].push_back(bvh);
+		}
+	}
+	for (int i = 0; i < 8; ++i) {
+		updateOctreeRecursive(*node.children[i], childrenCollidingRegions[i], node.bvhs, changedAabbs, currentLevel);
+	}
+
+	if (!octreeProperties.conservativeApproach) node.bvhs.append_range(partiallyCollidingRegions);
 }
 
 const Bvh& pah::TopLevel::getFallbackBvh() const {
@@ -206,3 +341,163 @@ Vector3 pah::TopLevelOctree::indexToPosition(int i) {
 	return Vector3{ rightward, upward, forward };
 }
 
+
+// ======| TopLevelBsp |======
+void pah::TopLevelBsp::build(const std::vector<Triangle>& triangles) {
+	INFO(TimeLogger timeLoggerTotalBuild{ [this](DurationMs duration) { totalBuildTime = duration; } });
+
+	buildBsp();
+
+	//build the BVHs
+	TopLevel::build(triangles);
+}
+
+void pah::TopLevelBsp::update() {
+	INFO(TimeLogger timeLogger{ [this](DurationMs duration) { lastUpdateTime = duration; } });
+
+	if (!movedRegions().empty()) {
+		Aabb sceneAabb = Aabb::minAabb();
+		for (const auto& bvh : bvhs) {
+			sceneAabb += bvh.getInfluenceArea()->getBvhRegion().enclosingAabb();
+		}
+		root = Node{ sceneAabb };
+		buildBsp();
+		saveRegions();
+	}
+
+	//update the BVHs
+	TopLevel::update();
+}
+
+void pah::TopLevelBsp::buildBsp() {
+	//the vertices of the regions never change during the build, so we compute them once
+	unordered_map<const Bvh*, vector<Vector3>> regionsVertices;
+	for (const auto& bvh : bvhs) {
+		regionsVertices[&bvh] = computeConvexPolyhedronVertices(bvh.getInfluenceArea()->getBvhRegion().getFaces() | std::ranges::to<vector>());
+	}
+
+	//build the tree, starting from the cell delimited by the faces of the root AABB
+	auto bvhsPointers = bvhs | std::views::transform([](Bvh& bvh) { return &bvh; }) | std::ranges::to<vector>(); //make vector of pointers
+	buildBspRecursive(root, root.aabb.getFaces() | std::ranges::to<vector>(), regionsVertices, bvhsPointers, {});
+}
+
+vector<const pah::Bvh*> pah::TopLevelBsp::containedIn(const Vector3& point) const {
+	//if the point is outside the region covered by the tree, it is useless to continue the search
+	if (!root.aabb.contains(point)) return {};
+
+	const Node* current = &root;
+	while (!current->isLeaf()) {
+		const auto& plane = current->splittingPlane;
+		bool inFront = dot(point - plane.getPoint(), plane.getNormal()) > 0.0f;
+		current = &*current->children[inFront];
+	}
+	return vector<const Bvh*>{ current->bvhs.begin(), current->bvhs.end() };
+}
+
+const TopLevelBsp::Node& pah::TopLevelBsp::getRoot() const {
+	return root;
+}
+
+INFO(const DurationMs pah::TopLevelBsp::getTotalBuildTime() const {
+	return totalBuildTime;
+})
+
+TopLevelBsp::BspProperties pah::TopLevelBsp::getBspProperties() const {
+	return bspProperties;
+}
+
+void pah::TopLevelBsp::buildBspRecursive(Node& node, const vector<Plane>& cellFaces, const unordered_map<const Bvh*, vector<Vector3>>& regionsVertices,
+	const vector<Bvh*>& fatherCollidingRegions, const vector<Bvh*>& fatherFullyContainedRegions, int currentLevel) {
+	TIME(TimeLogger timeLoggerTotal{ [&timingInfo = node.timingInfo](DurationMs duration) { timingInfo.logTotal(duration); } };);
+
+	//returns the minimum and maximum signed distance of a set of points from a plane
+	auto signedDistanceExtremes = [](const vector<Vector3>& points, const Plane& plane) {
+		float min = numeric_limits<float>::max(), max = -numeric_limits<float>::max();
+		for (const auto& p : points) {
+			float distance = dot(p - plane.getPoint(), plane.getNormal());
+			min = glm::min(min, distance);
+			max = glm::max(max, distance);
+		}
+		return pair{ min, max };
+	};
+
+	auto cellVertices = computeConvexPolyhedronVertices(cellFaces);
+	node.aabb = Aabb::minAabb();
+	for (const auto& v : cellVertices) node.aabb += Aabb{ v, v };
+
+	vector<Bvh*> collidingRegions;
+	vector<Plane> candidatePlanes; //faces of the colliding regions that cut the cell in 2 parts
+	node.bvhs = fatherFullyContainedRegions; //if the father node was fully contained in some region, for sure the child will also be
+
+	for (const auto& bvh : fatherCollidingRegions) {
+		//both the cell and the region are convex, so the region doesn't collide with the cell if a face of one of them separates the 2 (we don't check edge-edge axes, therefore we are conservative)
+		const auto& regionVertices = regionsVertices.at(bvh);
+		bool separated = std::ranges::any_of(cellFaces, [&](const Plane& face) { return signedDistanceExtremes(regionVertices, face).first >= -TOLERANCE; });
+		bool fullyContained = true;
+		vector<Plane> cuttingFaces;
+		for (const auto& face : bvh->getInfluenceArea()->getBvhRegion().getFaces()) {
+			if (separated) break;
+			auto [min, max] = signedDistanceExtremes(cellVertices, face);
+			if (min >= -TOLERANCE) separated = true; //the whole cell is outside this face
+			else if (max > TOLERANCE) { fullyContained = false; cuttingFaces.push_back(face); } //the face cuts the cell
+		}
+
+		if (separated) continue;
+		if (fullyContained) node.bvhs.push_back(bvh);
+		else {
+			collidingRegions.push_back(bvh);
+			candidatePlanes.append_range(cuttingFaces);
+		}
+	}
+
+	//the node is a leaf if there are no colliding but not fully contained regions, or if we reached the max level
+	if (!collidingRegions.empty() && currentLevel < bspProperties.maxLevel) {
+		//we choose the face that cuts the lowest number of other colliding regions, since each of them will end up in both children
+		int minCuts = numeric_limits<int>::max();
+		for (const auto& plane : candidatePlanes) {
+			int cuts = std::ranges::count_if(collidingRegions, [&](const Bvh* bvh) {
+				auto [min, max] = signedDistanceExtremes(regionsVertices.at(bvh), plane);
+				return min < -TOLERANCE && max > TOLERANCE;
+				});
+			if (cuts < minCuts) {
+				minCuts = cuts;
+				node.splittingPlane = plane;
+			}
+		}
+
+		//the back child is inside the splitting plane, the front child is outside (therefore for it the face is flipped)
+		vector<Plane> backCellFaces = cellFaces, frontCellFaces = cellFaces;
+		backCellFaces.push_back(node.splittingPlane);
+		frontCellFaces.emplace_back(node.splittingPlane.getPoint(), -node.splittingPlane.getNormal());
+
+		node.children[0] = make_unique<Node>();
+		node.children[1] = make_unique<Node>();
+		TIME(timeLoggerTotal.pause();); //in the time for this node, we don't want to include the time used to build all its descendents
+		buildBspRecursive(*node.children[0], backCellFaces, regionsVertices, collidingRegions, node.bvhs, currentLevel + 1);
+		buildBspRecursive(*node.children[1], frontCellFaces, regionsVertices, collidingRegions, node.bvhs, currentLevel + 1);
+		TIME(timeLoggerTotal.resume(););
+	}
+
+	//look at the analogue comment in TopLevelOctree::buildOctreeRecursive
+	if (!bspProperties.conservativeApproach) node.bvhs.append_range(collidingRegions);
+}
+
+vector<Vector3> pah::TopLevelBsp::computeConvexPolyhedronVertices(const vector<Plane>& faces) {
+	vector<Vector3> vertices;
+	for (int i = 0; i < faces.size(); ++i)
+		for (int j = i + 1; j < faces.size(); ++j)
+			for (int k = j + 1; k < faces.size(); ++k) {
+				const auto& n1 = faces[i].getNormal(), & n2 = faces[j].getNormal(), & n3 = faces[k].getNormal();
+				float det = dot(n1, cross(n2, n3));
+				if (abs(det) < numeric_limits<float>::epsilon()) continue; //at least 2 of the planes are parallel
+
+				//intersection of 3 planes in the form dot(n, x) = d
+				float d1 = dot(n1, faces[i].getPoint()), d2 = dot(n2, faces[j].getPoint()), d3 = dot(n3, faces[k].getPoint());
+				Vector3 vertex = (d1 * cross(n2, n3) + d2 * cross(n3, n1) + d3 * cross(n1, n2)) / det;
+
+				//the intersection is a vertex only if it is not outside any other face
+				bool inside = std::ranges::all_of(faces, [&vertex](const Plane& face) { return dot(vertex - face.getPoint(), face.getNormal()) <= TOLERANCE; });
+				if (inside) vertices.push_back(vertex);
+			}
+	return vertices;
+}
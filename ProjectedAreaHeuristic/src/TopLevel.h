@@ -3,6 +3,7 @@
 #include <vector>
 #include <optional>
 #include <utility>
+#include <unordered_map>
 
 #include "Bvh.h"
 
@@ -98,10 +99,12 @@ namespace pah {
 		virtual void build(const std::vector<Triangle>& triangles);
 
 		/**
-		 * @brief Updates the region where each triangle belongs to.
-		 * TODO implement it in concrete classes, it probably needs to know which parts to reconstruct
+		 * @brief Updates the structure after the vertices of the triangles of the last build moved (e.g. animated geometry), without rebuilding it.
+		 * The fallback @p Bvh is refitted, and the triangles are classified again: each @p Bvh is refitted, and the triangles that left or entered its region are removed or inserted (see @p Bvh::update).
+		 * Each @p Bvh rebuilds its subtrees whose cost grew too much (see @p Bvh::Properties::maxRefitCostGrowth).
+		 * The influence areas can move too (e.g. by assigning a new @p PlaneInfluenceArea to the one of a @p Bvh): this is enough for this class, but subclasses with a spatial structure must update it first.
 		 */
-		virtual void update() = 0;
+		virtual void update();
 
 		/**
 		 * @brief Given a point, returns the @p Region s it belongs to.
@@ -125,10 +128,30 @@ namespace pah {
 		 */
 		const std::vector<Triangle>& getLastBuildTriangles() const;
 
+		INFO(const DurationMs getLastUpdateTime() const;); /**< @brief Returns the time it took to run the last @p update. */
+
 	protected:
+		/**
+		 * @brief Returns, for each @p Bvh, the triangles it should contain: a triangle belongs to a @p Bvh if at least one of its vertices is inside its region.
+		 * The default implementation calls @p containedIn for each vertex, so it works with any @p TopLevel structure.
+		 */
+		virtual std::unordered_map<const Bvh*, std::vector<const Triangle*>> classifyTriangles(const std::vector<Triangle>& triangles) const;
+
+		/**
+		 * @brief Saves the current regions of the @p Bvh s, so that @p movedRegions can find the ones that moved.
+		 */
+		void saveRegions();
+
+		/**
+		 * @brief Returns, for each region that moved since the last @p saveRegions, the @p Aabb s enclosing its old and new position. Only the space inside them is affected by the movement.
+		 */
+		std::vector<Aabb> movedRegions() const;
+
 		std::vector<Bvh> bvhs;
 		Bvh fallbackBvh; //if none of the other BVHs is hit, this one is used; it will contain every triangle in the scene
 		const std::vector<Triangle>* lastBuildTriangles; //triangle array used for last build
+		std::vector<std::pair<std::array<Plane, 6>, Aabb>> lastRegions; //the faces and the enclosing Aabb of the region of each BVH, when they were last saved
+		INFO(DurationMs lastUpdateTime;);
 	};
 
 
@@ -139,8 +162,13 @@ namespace pah {
 		TopLevelAabbs(BvhType&& fallbackBvh, Bvhs&&... bvhs) : TopLevel { std::forward<BvhType>(fallbackBvh), std::forward<Bvhs>(bvhs)... } {}
 
 		void build(const std::vector<Triangle>& triangles) override;
-		void update() override;
 		std::vector<const Bvh*> containedIn(const Vector3&) const override;
+
+	protected:
+		/**
+		 * @brief Since there is no spatial structure to traverse, each region tests all the vertices of the scene at once (regions can do it with a vectorized test).
+		 */
+		std::unordered_map<const Bvh*, std::vector<const Triangle*>> classifyTriangles(const std::vector<Triangle>& triangles) const override;
 	};
 
 
@@ -234,6 +262,10 @@ namespace pah {
 		}
 
 		void build(const std::vector<Triangle>& triangles) override;
+		/**
+		 * @brief Like @p TopLevel::update, but if some regions moved, only the cells of the octree overlapping their old or new position are rebuilt first.
+		 * The whole octree is rebuilt only if a region moved outside of the root.
+		 */
 		void update() override;
 		std::vector<const Bvh*> containedIn(const Vector3&) const override;
 
@@ -244,8 +276,15 @@ namespace pah {
 	private:
 		/**
 		 * @brief Recursively creates the nodes of the octree.
+		 * @param collidingRegions The regions that collide with the node, but don't fully contain its father. The father tests them against all its children at once.
 		 */
-		void buildOctreeRecursive(Node& node, const std::vector<Bvh*>& fatherCollidingRegions, const std::vector<Bvh*>& fatherFullyContainedRegions, int currentLevel = 0);
+		void buildOctreeRecursive(Node& node, const std::vector<Bvh*>& collidingRegions, const std::vector<Bvh*>& fatherFullyContainedRegions, int currentLevel = 0);
+
+		/**
+		 * @brief Updates the nodes of the octree after some regions moved: the subtrees that don't overlap @p changedAabbs (see @p TopLevel::movedRegions) are kept, the others are visited like in @p buildOctreeRecursive.
+		 * The leaves are rebuilt, and so are the internal nodes that become leaves.
+		 */
+		void updateOctreeRecursive(Node& node, const std::vector<Bvh*>& collidingRegions, const std::vector<Bvh*>& fatherFullyContainedRegions, const std::vector<Aabb>& changedAabbs, int currentLevel = 0);
 
 		/**
 		 * @brief Given the relative position of a point to the center of the @p Aabb, returns the index of the @p Node.
@@ -274,4 +313,99 @@ namespace pah {
 		OctreeProperties octreeProperties;
 		INFO(DurationMs totalBuildTime;);
 	};
+
+
+	/**
+	 * @brief Top level structure based on a binary space partitioning tree.
+	 * Differently from the @p TopLevelOctree, the splitting planes are not fixed, but they are chosen among the faces of the regions of the @p Bvh s.
+	 * In this way the boundaries of the leaves match the boundaries of the regions, and the tree reaches an exact subdivision with far fewer levels.
+	 */
+	class TopLevelBsp : public TopLevel {
+	public:
+		//related classes
+		using NodeTimingInfo = TopLevelOctree::NodeTimingInfo;
+
+		struct Node {
+			Aabb aabb; /**< @brief The @p Aabb enclosing the convex cell of this node. */
+			Plane splittingPlane; /**< @brief Points behind the plane (on the opposite side of the normal) belong to the first child, the others to the second one. */
+			std::vector<Bvh*> bvhs;
+			std::array<std::unique_ptr<Node>, 2> children;
+			TIME(NodeTimingInfo timingInfo;)
+
+			Node() {
+				TIME(timingInfo = NodeTimingInfo{};);
+			}
+			Node(const Aabb& aabb) : aabb{ aabb } {
+				TIME(timingInfo = NodeTimingInfo{};);
+			}
+
+			bool isLeaf() const {
+				return children[0] == nullptr;
+			}
+		};
+
+		struct BspProperties {
+			int maxLevel;
+			/**
+			 * @brief If true, the leaves will only contain the regions that fully contain them.
+			 * Since the splitting planes are the faces of the regions, this can only happen if @p maxLevel is reached.
+			 */
+			bool conservativeApproach;
+		};
+
+
+		//COMPILER_BUG C++ allows this, but MSVC makes it so that constrained template parameters cannot be universal references: template<std::same_as<Bvh> BvhType, std::same_as<Bvh>... Bvhs>
+		template<typename BvhType, typename... Bvhs>
+		TopLevelBsp(const BspProperties& bspProperties, BvhType&& fallbackBvh, Bvhs&&... bvhs)
+			: TopLevel{ std::forward<BvhType>(fallbackBvh), std::forward<Bvhs>(bvhs)... }, bspProperties{ bspProperties }, root{} {
+			Aabb sceneAabb = Aabb::minAabb();
+
+			//the Aabb of the root, must contain all the influence areas in the scene
+			for (const auto& bvh : this->bvhs) {
+				sceneAabb += bvh.getInfluenceArea()->getBvhRegion().enclosingAabb();
+			}
+
+			root.aabb = sceneAabb;
+		}
+
+		void addBvh(Bvh&& bvh) override {
+			root.aabb += bvh.getInfluenceArea()->getBvhRegion().enclosingAabb();
+			TopLevel::addBvh(std::move(bvh));
+		}
+
+		void build(const std::vector<Triangle>& triangles) override;
+		/**
+		 * @brief Like @p TopLevel::update, but if some regions moved, the tree is rebuilt first, since its splitting planes are the faces of the regions.
+		 */
+		void update() override;
+		std::vector<const Bvh*> containedIn(const Vector3&) const override;
+
+		const Node& getRoot() const;
+		INFO(const DurationMs getTotalBuildTime() const;); /**< @brief Returns the time it took to build this @p TopLevelBsp. */
+		BspProperties getBspProperties() const; /**< @brief Returns the properties of this @p TopLevelBsp. */
+
+	private:
+		/**
+		 * @brief Creates the tree from the current regions of the @p Bvh s.
+		 */
+		void buildBsp();
+
+		/**
+		 * @brief Recursively creates the nodes of the tree.
+		 * @param cellFaces The planes delimiting the convex cell of the node (normals pointing outside of the cell).
+		 * @param regionsVertices The vertices of the region of each @p Bvh, used to choose the splitting plane.
+		 */
+		void buildBspRecursive(Node& node, const std::vector<Plane>& cellFaces, const std::unordered_map<const Bvh*, std::vector<Vector3>>& regionsVertices,
+			const std::vector<Bvh*>& fatherCollidingRegions, const std::vector<Bvh*>& fatherFullyContainedRegions, int currentLevel = 0);
+
+		/**
+		 * @brief Given the planes delimiting a convex polyhedron (normals pointing outside), returns its vertices.
+		 * Each vertex is the intersection of 3 planes, which is not behind any other plane.
+		 */
+		static std::vector<Vector3> computeConvexPolyhedronVertices(const std::vector<Plane>& faces);
+
+		Node root;
+		BspProperties bspProperties;
+		INFO(DurationMs totalBuildTime;);
+	};
 }
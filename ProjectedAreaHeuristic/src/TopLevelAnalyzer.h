@@ -12,6 +12,57 @@
 
 namespace pah {
 
+	/**
+	 * @brief Functions to collect data shared by the analyzers of the different @p TopLevel structures.
+	 */
+	namespace topLevelAnalysis {
+		struct LookupInfo {
+			DurationMs averageLatency; /**< @brief Average time of a @p TopLevel::containedIn query. */
+			float averageRegions; /**< @brief Average number of @p Bvh s returned by a query. */
+		};
+
+		/**
+		 * @brief Measures the @p TopLevel::containedIn queries on a regular grid of points covering the @p Aabb.
+		 */
+		static LookupInfo measureLookup(const TopLevel& topLevel, const Aabb& aabb, int samplesPerAxis = 16) {
+			LookupInfo info{};
+			int regionsTotal = 0;
+			Vector3 step = aabb.size() / (float)samplesPerAxis;
+
+			utilities::TimeLogger timeLogger{ [&info](DurationMs duration) { info.averageLatency = duration; } };
+			for (int i = 0; i < samplesPerAxis; ++i)
+				for (int j = 0; j < samplesPerAxis; ++j)
+					for (int k = 0; k < samplesPerAxis; ++k) {
+						Vector3 point = aabb.min + step * (Vector3{ i, j, k } + 0.5f); //center of the (i,j,k) cell of the grid
+						regionsTotal += topLevel.containedIn(point).size();
+					}
+			timeLogger.stop();
+
+			int samples = samplesPerAxis * samplesPerAxis * samplesPerAxis;
+			info.averageLatency /= (float)samples;
+			info.averageRegions = regionsTotal / (float)samples;
+			return info;
+		}
+
+		/**
+		 * @brief Returns the amount of bytes used by the nodes of a tree-like @p TopLevel structure (@p TopLevelOctree or @p TopLevelBsp).
+		 */
+		template<typename Node>
+		static std::size_t memoryFootprint(const Node& root) {
+			std::size_t bytes = 0;
+			std::queue<const Node*> toVisit;
+			toVisit.push(&root);
+			while (!toVisit.empty()) {
+				auto currentNode = toVisit.front();
+				toVisit.pop();
+				bytes += sizeof(Node) + currentNode->bvhs.capacity() * sizeof(Bvh*);
+				for (auto& childPtr : currentNode->children) if (childPtr != nullptr) toVisit.push(&*childPtr);
+			}
+			return bytes;
+		}
+	}
+
+
 	/**
 	 * @brief Class that can be used to analyze a @p TopLevel structure.
 	 */
@@ -86,6 +137,10 @@ namespace pah {
 			json analyses = topLevelAnalyzer.analyze(topLevel); //get the analyses of all the BVHs
 			INFO(analyses["octree"]["timing"] += topLevel.getTotalBuildTime().count();); //add info about build time
 			analyses["octree"]["properties"] = topLevel.getOctreeProperties();
+			analyses["octree"]["memory"] = topLevelAnalysis::memoryFootprint(topLevel.getRoot());
+			auto lookupInfo = topLevelAnalysis::measureLookup(topLevel, topLevel.getRoot().aabb);
+			analyses["octree"]["lookup"]["averageLatency"] = lookupInfo.averageLatency.count();
+			analyses["octree"]["lookup"]["averageRegions"] = lookupInfo.averageRegions;
 
 			//now analyze the octree
 			std::queue<const TopLevelOctree::Node*> toAnalyze;
@@ -118,4 +173,64 @@ namespace pah {
 	private:
 		TopLevelAnalyzer<GlobalObject...> topLevelAnalyzer;
 	};
+
+
+	/**
+	 * @brief Class that can be used to analyze a @TopLevelBsp. It analyzes the @p Bvh s just as a @TopLevelAnalyzer would, but then also gets data about the tree.
+	 * The JSON has the same layout of the one produced by @p TopLevelOctreeAnalyzer, so that the 2 structures can be easily compared.
+	 */
+	template<typename... GlobalObject>
+	class TopLevelBspAnalyzer {
+		using json = nlohmann::json;
+
+	public:
+		/**
+		 * @brief Constructs the @p TopLevelBspAnalyzer. Each @p BvhAnalyzer will have the actions passed as argument.
+		 */
+		TopLevelBspAnalyzer(std::pair<std::function<PerNodeActionType>, std::function<FinalActionType>>... actions) : topLevelAnalyzer{ actions... } {}
+
+		/**
+		 * @brief Given a @p TopLevelBsp structure, it analyzes it and returns a JSON.
+		 */
+		json analyze(const TopLevel& topLevelBase) {
+			const TopLevelBsp& topLevel = dynamic_cast<const TopLevelBsp&>(topLevelBase); // we do it like this because we want this function to be able to take base class polymorphic objects
+			json analyses = topLevelAnalyzer.analyze(topLevel); //get the analyses of all the BVHs
+			INFO(analyses["bsp"]["timing"] += topLevel.getTotalBuildTime().count();); //add info about build time
+			analyses["bsp"]["properties"] = topLevel.getBspProperties();
+			analyses["bsp"]["memory"] = topLevelAnalysis::memoryFootprint(topLevel.getRoot());
+			auto lookupInfo = topLevelAnalysis::measureLookup(topLevel, topLevel.getRoot().aabb);
+			analyses["bsp"]["lookup"]["averageLatency"] = lookupInfo.averageLatency.count();
+			analyses["bsp"]["lookup"]["averageRegions"] = lookupInfo.averageRegions;
+
+			//now analyze the tree
+			std::queue<const TopLevelBsp::Node*> toAnalyze;
+			toAnalyze.push(&topLevel.getRoot());
+			while (!toAnalyze.empty()) {
+				auto& currentNode = toAnalyze.front();
+				toAnalyze.pop(); //remove the element we got via front()
+				analyses["bsp"]["nodes"] += *currentNode;
+				if (currentNode->isLeaf()) continue;
+				for (auto& childPtr : currentNode->children) toAnalyze.push(&*childPtr); //add both children to the queue
+			}
+
+			return analyses;
+		}
+
+		/**
+		 * @brief Given a @p TopLevelBsp structure, it analyzes it and returns a JSON. Moreover it saves the JSON to a file.
+		 */
+		json analyze(const TopLevel& topLevelBase, std::string filePath) {
+			json json = analyze(topLevelBase);
+
+			std::ofstream file;
+			file.open(filePath);
+			file << std::setw(2) << json;
+			file.close();
+
+			return json;
+		}
+
+	private:
+		TopLevelAnalyzer<GlobalObject...> topLevelAnalyzer;
+	};
 }
@@ -11,6 +11,8 @@
 #include <concepts>
 #include <fstream>
 #include <ranges>
+#include <algorithm>
+#include <span>
 
 #include  "../libs/json.hpp"
 
@@ -218,6 +220,201 @@ namespace pah {
 	};
 
 
+	/**
+	 * @brief Convex polygon in 2 dimensions with at most @p Capacity vertices, stored on the stack.
+	 * It is the allocation-free counterpart of @p ConvexHull2d, used in the hot paths of the BVH construction.
+	 */
+	template<std::size_t Capacity>
+	struct FixedConvexHull2d {
+	public:
+		FixedConvexHull2d() : vertices{}, count{ 0 } {}
+
+		void push_back(const Vector2& vertex) {
+			vertices[count++] = vertex;
+		}
+
+		Vector2& operator[](std::size_t i) {
+			return vertices[i];
+		}
+
+		Vector2 operator[](std::size_t i) const {
+			return vertices[i];
+		}
+
+		std::size_t size() const {
+			return count;
+		}
+
+		/**
+		 * @brief Returns the area of the hull (shoelace formula).
+		 */
+		float computeArea() const {
+			if (count < 3) return 0;
+			float area = 0.0f;
+			for (std::size_t i = 0; i < count; ++i) {
+				std::size_t iNext = i + 1 == count ? 0 : i + 1;
+				area += vertices[i].x * vertices[iNext].y - vertices[i].y * vertices[iNext].x;
+			}
+			return glm::abs(area / 2.f);
+		}
+
+		/**
+		 * @brief Returns the intersection between this hull and the axis aligned rectangle [min, max] (Sutherland-Hodgman).
+		 * Clipping a convex polygon against a rectangle adds at most 4 vertices, therefore the hull must have at most @p Capacity - 4 vertices.
+		 */
+		FixedConvexHull2d clipToRectangle(const Vector2& min, const Vector2& max) const {
+			FixedConvexHull2d result = *this;
+			result.clipAgainst<0, false>(min.x);
+			result.clipAgainst<0, true>(max.x);
+			result.clipAgainst<1, false>(min.y);
+			result.clipAgainst<1, true>(max.y);
+			return result;
+		}
+
+	private:
+		/**
+		 * @brief Clips the hull against the axis aligned line coordinate[Coord] = @p limit, keeping the part where coordinate <= limit (if @p KeepBelow) or >= limit.
+		 */
+		template<int Coord, bool KeepBelow>
+		void clipAgainst(float limit) {
+			if (count == 0) return;
+			auto isInside = [limit](const Vector2& p) { return KeepBelow ? p[Coord] <= limit : p[Coord] >= limit; };
+
+			std::array<Vector2, Capacity> input = vertices;
+			std::size_t inputCount = count;
+			count = 0;
+			Vector2 previous = input[inputCount - 1];
+			bool previousInside = isInside(previous);
+			for (std::size_t i = 0; i < inputCount; ++i) {
+				Vector2 current = input[i];
+				bool currentInside = isInside(current);
+				if (currentInside != previousInside) {
+					float t = (limit - previous[Coord]) / (current[Coord] - previous[Coord]);
+					push_back(previous + t * (current - previous)); //the edge crosses the line
+				}
+				if (currentInside) push_back(current);
+				previous = current;
+				previousInside = currentInside;
+			}
+		}
+
+		std::array<Vector2, Capacity> vertices;
+		std::size_t count;
+	};
+
+
+	/**
+	 * @brief A grid of densities over a rectangle, queried through a summed-area table.
+	 * Each cell stores the amount of samples (e.g. rays) that fell inside it, so the integral of the density over a region is the (fractional) number of samples in that region.
+	 */
+	class DensityMap {
+	public:
+		DensityMap(int columns, int rows, Vector2 min, Vector2 max) : columns{ columns }, rows{ rows }, min{ min }, max{ max }, cellSize{ (max - min) / Vector2{ columns, rows } },
+			cells(columns * rows, 0.0f), summedAreaTable((columns + 1) * (rows + 1), 0.0f) {
+		}
+
+		/**
+		 * @brief Adds a sample to the cell containing @p point. Samples outside the map are ignored.
+		 * @p buildSummedAreaTable must be called after all the samples have been added.
+		 */
+		void addSample(Vector2 point, float weight = 1.0f) {
+			Vector2 gridPoint = (point - min) / cellSize;
+			if (gridPoint.x < 0 || gridPoint.y < 0 || gridPoint.x >= columns || gridPoint.y >= rows) return;
+			cells[static_cast<int>(gridPoint.y) * columns + static_cast<int>(gridPoint.x)] += weight;
+		}
+
+		/**
+		 * @brief Builds the summed-area table from the samples.
+		 */
+		void buildSummedAreaTable() {
+			for (int y = 0; y < rows; ++y) {
+				float rowSum = 0.0f;
+				for (int x = 0; x < columns; ++x) {
+					rowSum += cells[y * columns + x];
+					summedAreaTable[(y + 1) * (columns + 1) + x + 1] = summedAreaTable[y * (columns + 1) + x + 1] + rowSum;
+				}
+			}
+		}
+
+		/**
+		 * @brief Returns the integral of the density over the whole map.
+		 */
+		float total() const {
+			return summedAreaTable.back();
+		}
+
+		/**
+		 * @brief Returns the integral of the density over the rectangle [@p from, @p to].
+		 */
+		float integrate(Vector2 from, Vector2 to) const {
+			return summedArea(to) - summedArea({ from.x, to.y }) - summedArea({ to.x, from.y }) + summedArea(from);
+		}
+
+		/**
+		 * @brief Returns the integral of the density over the convex @p hull.
+		 * The hull is cut in horizontal strips at its vertices and at the rows of the grid; each strip is integrated as the rectangle as wide as the hull at the middle of the strip.
+		 * It is exact where the density is uniform, and the error is limited to the cells crossed by the slanted edges of the hull.
+		 */
+		template<std::size_t Capacity>
+		float integrate(const FixedConvexHull2d<Capacity>& hull) const {
+			const std::size_t n = hull.size();
+			if (n < 3) return 0.0f;
+
+			std::array<float, Capacity> verticesY{};
+			for (std::size_t i = 0; i < n; ++i) verticesY[i] = hull[i].y;
+			std::sort(verticesY.begin(), verticesY.begin() + n);
+
+			//integrates the strip between y0 and y1
+			auto integrateStrip = [&](float y0, float y1) {
+				float y = (y0 + y1) / 2.0f, left = std::numeric_limits<float>::max(), right = -std::numeric_limits<float>::max();
+				for (std::size_t i = 0; i < n; ++i) {
+					Vector2 a = hull[i], b = hull[i + 1 == n ? 0 : i + 1];
+					if ((a.y <= y) == (b.y <= y)) continue; //the edge doesn't cross the middle of the strip
+					float x = a.x + (y - a.y) / (b.y - a.y) * (b.x - a.x);
+					left = glm::min(left, x); right = glm::max(right, x);
+				}
+				return left < right ? integrate({ left, y0 }, { right, y1 }) : 0.0f;
+				};
+
+			float integral = 0.0f;
+			float previous = verticesY[0];
+			int row = glm::max(0, static_cast<int>(glm::floor((previous - min.y) / cellSize.y)) + 1); //first row boundary above the lowest vertex
+			for (std::size_t v = 1; v < n;) {
+				float next = verticesY[v];
+				float rowBoundary = min.y + cellSize.y * row;
+				if (row <= rows && rowBoundary < next) { next = rowBoundary; row++; }
+				else v++;
+				if (next > previous) integral += integrateStrip(previous, next);
+				previous = glm::max(previous, next);
+			}
+			return integral;
+		}
+
+		int getColumns() const { return columns; }
+		int getRows() const { return rows; }
+
+	private:
+		/**
+		 * @brief Returns the integral of the density over the rectangle [min, @p point].
+		 * The density is constant inside each cell, therefore the integral is exactly the bilinear interpolation of the summed-area table.
+		 */
+		float summedArea(Vector2 point) const {
+			Vector2 gridPoint = glm::clamp((point - min) / cellSize, Vector2{ 0.0f, 0.0f }, Vector2{ columns, rows });
+			int x = glm::min(static_cast<int>(gridPoint.x), columns - 1), y = glm::min(static_cast<int>(gridPoint.y), rows - 1);
+			float fx = gridPoint.x - x, fy = gridPoint.y - y;
+			auto at = [this](int x, int y) { return summedAreaTable[y * (columns + 1) + x]; };
+			float bottom = at(x, y) + (at(x + 1, y) - at(x, y)) * fx;
+			float top = at(x, y + 1) + (at(x + 1, y + 1) - at(x, y + 1)) * fx;
+			return bottom + (top - bottom) * fy;
+		}
+
+		int columns, rows;
+		Vector2 min, max, cellSize;
+		std::vector<float> cells; //amount of samples in each cell (row major)
+		std::vector<float> summedAreaTable; //(columns + 1) * (rows + 1), the first row and column are 0
+	};
+
+
 	/**
 	 * @brief Represents any polygonal convex shape.
 	 */
@@ -551,6 +748,32 @@ namespace pah {
 	};
 
 
+	/**
+	 * @brief A set of @p Ray s stored with the inverse of their directions, so that slab tests against them don't need any division.
+	 */
+	struct SampleRays {
+		/**
+		 * @brief Keeps at most @p maxSamples of the @p rays, evenly strided. @p maxSamples must be positive.
+		 */
+		SampleRays(std::span<const Ray> rays, int maxSamples = std::numeric_limits<int>::max()) {
+			if (maxSamples <= 0) throw std::invalid_argument{ "SampleRays needs a positive number of samples" };
+			size_t samples = std::min(rays.size(), static_cast<size_t>(maxSamples));
+			origins.reserve(samples);
+			inverseDirections.reserve(samples);
+			for (size_t k = 0; k < samples; ++k) {
+				const auto& ray = rays[k * rays.size() / samples];
+				origins.push_back(ray.getOrigin());
+				inverseDirections.push_back(1.0f / ray.getDirection());
+			}
+		}
+
+		int size() const { return origins.size(); }
+
+		std::vector<Vector3> origins;
+		std::vector<Vector3> inverseDirections;
+	};
+
+
 	namespace utilities {
 
 		/**
@@ -709,7 +932,7 @@ namespace pah {
 
 			std::chrono::time_point<std::chrono::high_resolution_clock> startTime;
 			std::chrono::time_point<std::chrono::high_resolution_clock> lastPauseTime;
-			std::chrono::duration<float, std::milli> pausedTime; //the time the timer has been paused
+			std::chrono::duration<float, std::milli> pausedTime{}; //the time the timer has been paused
 			std::vector<std::function<void(std::chrono::duration<float, std::milli> duration)>> finalActions;
 			bool stopped = false;
 			bool paused = false;
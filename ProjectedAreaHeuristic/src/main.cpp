@@ -27,6 +27,7 @@ int main() {
 	CsvExporter csvTraversal{
 		ACCESSOR("Estimated PAH cost",							AT::TOP_LEVEL,["bvhs"].at(0)["globalInfo"]["pahCost"]),
 		ACCESSOR("Estimated SAH cost",							AT::TOP_LEVEL,["bvhs"].at(0)["globalInfo"]["sahCost"]),
+		ACCESSOR("Estimated blended cost",						AT::TOP_LEVEL,["bvhs"].at(0)["globalInfo"]["blendedCost"]),
 		ACCESSOR("Real cost with fallback",						AT::PAH,["cost"]["traversalCostAveragePerRay"]),
 		ACCESSOR("Intersections with fallback",					AT::PAH,["total"]["intersectionTests"]["intersectionTestsAveragePerRay"]),
 		ACCESSOR("Real cost without fallback",					AT::PAH,["cost"]["traversalCostForBvhPerRay"].at(0).at(1)),
@@ -69,6 +70,7 @@ int main() {
 		MAKE_ACTIONS_PAIR(core),
 		MAKE_ACTIONS_PAIR(sah),
 		MAKE_ACTIONS_PAIR(pah),
+		MAKE_ACTIONS_PAIR(blend),
 		MAKE_ACTIONS_PAIR(levelCount),
 		MAKE_ACTIONS_PAIR(triangles),
 		MAKE_ACTIONS_PAIR(influenceArea),
@@ -102,7 +104,13 @@ int main() {
 
 	//fallback BVH used by most top level structures
 	Bvh fallbackBvh{ bvhProperties, bvhStrategies::computeCostSah, bvhStrategies::chooseSplittingPlanesLongest<0.f>, bvhStrategies::shouldStopThresholdOrLevel, "fallback" };
-	fallbackBvh.setFallbackComputeCostStrategy(bvhStrategies::computeCostSah);
+	fallbackBvh.setFallbackComputeCostStrategy(bvhStrategies::computeCostSah, bvhStrategies::computeCostSahBatch);
+#if LINEAR_FALLBACK_BVH
+	//the fallback BVH is rebuilt for every scene, so build speed may matter more than quality: a linear BVH with treelet restructuring is several times faster than a top-down one, and close in cost
+	fallbackBvh.setComputeCostBatchStrategy(bvhStrategies::computeCostSahBatch);
+	fallbackBvh.setBuildMode(Bvh::BuildMode::Linear);
+	fallbackBvh.setTreeletRestructuring(7);
+#endif
 
 #define BVH_TESTS 1
 #if BVH_TESTS
@@ -2920,6 +2928,52 @@ int main() {
 	csvTraversal.generateCsv(std::string(CSV_FILE));
 #endif //BVH_TESTS
 
+#define PATH_TESTS 0
+#if PATH_TESTS
+	// CAMERA PATH: the PAH BVH built for the first frame is updated along the path, and only its subtrees that got worse for the new pov are rebuilt
+	{
+		constexpr string_view RESULTS_DIRECTORY = "E:/Users/lapof/Documents/Development/ProjectedAreaHeuristic/Results/";
+		constexpr int FRAMES = 60;
+		auto povAt = [](int frame) { //the camera walks along the nave of Sponza, turning slowly
+			float t = frame / (float)FRAMES;
+			return Pov{ { -12 + 20 * t, 10, 7.2 - 4 * t }, { .84 - .5 * t, 0.26, -.48 + .3 * t }, 70, 50 };
+		};
+
+		Bvh::Properties pathBvhProperties = bvhProperties;
+		pathBvhProperties.maxRefitCostGrowth = 0.1f;
+		PointInfluenceArea influenceAreaPath{ povAt(0), 70, 1, 10000 };
+		PointRayCaster rayCasterPath{ influenceAreaPath }; rayCasterPath.generateRays(rng, 1000, true);
+		Bvh bvhPath{ pathBvhProperties, influenceAreaPath, PAH_STRATEGY, bvhStrategies::chooseSplittingPlanesLongest, bvhStrategies::shouldStopThresholdOrLevel, "point" };
+		TopLevelOctree topLevel{ octreeProperties, fallbackBvh, std::move(bvhPath) };
+		auto scene = TestScene{ string(RESULTS_DIRECTORY) + "Sponza_Point_Path", sponzaTriangles, vector{&rayCasterPath}, std::move(topLevel), topLevelAnalyzer };
+		scene.followPath(FRAMES, [&](int frame) {
+			influenceAreaPath = PointInfluenceArea{ povAt(frame), 70, 1, 10000 };
+			rayCasterPath = PointRayCaster{ influenceAreaPath }; rayCasterPath.generateRays(rng, 1000, true);
+		});
+	}
+#endif //PATH_TESTS
+
+#define BUDGET_TESTS 0
+#if BUDGET_TESTS
+	// TIME BUDGET: the PAH BVH is built breadth first until the budget is over, and the rest is built linearly, then it is refined a frame at a time
+	{
+		constexpr string_view RESULTS_DIRECTORY = "E:/Users/lapof/Documents/Development/ProjectedAreaHeuristic/Results/";
+		PointInfluenceArea influenceAreaBudget{ Pov{ { -12, 10, 7.2 }, { .84, 0.26, -.48 }, 70, 50 }, 70, 1, 10000 };
+		BvhAnalyzer budgetAnalyzer{ MAKE_ACTIONS_PAIR(core), MAKE_ACTIONS_PAIR(pah), MAKE_ACTIONS_PAIR(levelCount) };
+		json budgetResults;
+		for (float budget : { 0.f, 10.f, 50.f, 200.f, 1000.f, 5000.f }) {
+			Bvh bvhBudget{ bvhProperties, influenceAreaBudget, PAH_STRATEGY, bvhStrategies::chooseSplittingPlanesLongest, bvhStrategies::shouldStopThresholdOrLevel, "point" };
+			bvhBudget.setComputeCostBatchStrategy(PAH_BATCH_STRATEGY);
+			bvhBudget.build(sponzaTriangles, DurationMs{ budget });
+			json result = { { "budget", budget }, { "buildTime", bvhBudget.getTotalBuildTime().count() }, { "pahCost", budgetAnalyzer.analyze(bvhBudget)["globalInfo"]["pahCost"] } };
+			for (int frame = 0; frame < 100 && bvhBudget.refine(DurationMs{ 16 }) > 0; ++frame) {}
+			result["pahCostRefined"] = budgetAnalyzer.analyze(bvhBudget)["globalInfo"]["pahCost"];
+			budgetResults.push_back(result);
+		}
+		std::ofstream{ string(RESULTS_DIRECTORY) + "Sponza_Point_Budget.json" } << budgetResults.dump(4);
+	}
+#endif //BUDGET_TESTS
+
 #define OCTREE_TESTS 0
 #if OCTREE_TESTS
 	// OCTREE VS AABBS
@@ -2931,12 +2985,14 @@ int main() {
 		constexpr int MAX_INFLUENCE_AREAS = 10;
 		int octreeHits = 0; //how many influence areas are hit in the octree
 		int aabbsHits = 0; //how many influence areas are hit in the aabbs
+		int bspHits = 0; //how many influence areas are hit in the BSP
 
 		//create a vector of influence areas and the associated BVHs
 		list<PlaneInfluenceArea> planeInfluenceAreas{}; //do NOT use vector. We must store a reference to the elements of these lists inside Bvh, and vector can reallocate memory
 		list<PointInfluenceArea> pointInfluenceAreas{}; //do NOT use vector. We must store a reference to the elements of these lists inside Bvh, and vector can reallocate memory
 		vector<Bvh> bvhsOctree{};
 		vector<Bvh> bvhsAabbs{};
+		vector<Bvh> bvhsBsp{};
 		distributions::UniformBoxDistribution position{ 2,6, 2,6, 2,6 };
 		distributions::UniformBoxDistribution direction{ -1,1, -1,1, -1,1 };
 		distributions::UniformBoxDistribution size{ 1,5, 1,5, 2,10 };
@@ -2954,6 +3010,9 @@ int main() {
 			
 			bvhsAabbs.emplace_back(Bvh{bvhProperties, planeInfluenceAreas.back(), bvhStrategies::computeCostSah, bvhStrategies::chooseSplittingPlanesLongest, bvhStrategies::shouldStopThresholdOrLevel, "plane"});
 			bvhsAabbs.emplace_back(Bvh{bvhProperties, pointInfluenceAreas.back(), bvhStrategies::computeCostSah, bvhStrategies::chooseSplittingPlanesLongest, bvhStrategies::shouldStopThresholdOrLevel, "point"});
+
+			bvhsBsp.emplace_back(Bvh{bvhProperties, planeInfluenceAreas.back(), bvhStrategies::computeCostSah, bvhStrategies::chooseSplittingPlanesLongest, bvhStrategies::shouldStopThresholdOrLevel, "plane"});
+			bvhsBsp.emplace_back(Bvh{bvhProperties, pointInfluenceAreas.back(), bvhStrategies::computeCostSah, bvhStrategies::chooseSplittingPlanesLongest, bvhStrategies::shouldStopThresholdOrLevel, "point"});
 		}
 
 		octreeProperties.maxLevel = 4;
@@ -2983,7 +3042,21 @@ int main() {
 		}
 		aabbsTime.stop();
 
-		cout << endl << "Influence areas hit --> octree: " << octreeHits << "\taabbs: " << aabbsHits;
+		TopLevelBsp topLevelBsp{ TopLevelBsp::BspProperties{.maxLevel = 30, .conservativeApproach = false }, fallbackBvh };
+		for (auto& elem : bvhsBsp) {
+			topLevelBsp.addBvh(std::move(elem));
+		}
+		topLevelBsp.build(triangles);
+		utilities::TimeLogger bspTime{ [](DurationMs duration) { cout << endl << "Top level BSP duration in ms: " << duration.count(); } };
+		for (int i = 0; i < MAX_ITERATIONS; ++i) {
+			Vector3 point = mainDistribution3d(rng);
+			auto res = topLevelBsp.containedIn(point);
+			bspHits += res.size();
+		}
+		bspTime.stop();
+
+		INFO(cout << endl << "Build time in ms --> octree: " << topLevelOctree.getTotalBuildTime().count() << "\tbsp: " << topLevelBsp.getTotalBuildTime().count(););
+		cout << endl << "Influence areas hit --> octree: " << octreeHits << "\taabbs: " << aabbsHits << "\tbsp: " << bspHits;
 	}
 #endif //OCTREE_TESTS
 
@@ -22,9 +22,13 @@
 #define LEAF_COST 1.2f /**< The cost of a @p Ray intersecting a leaf @p Bvh::Node. */
 
 #define DEFAULT_BVH_FALLBACK_STRATEGY_COMPUTE_COST bvhStrategies::computeCostSah
+#define DEFAULT_BVH_FALLBACK_STRATEGY_COMPUTE_COST_BATCH bvhStrategies::computeCostSahBatch
 #define DEFAULT_BVH_FALLBACK_STRATEGY_SPLITTING_PLANE bvhStrategies::chooseSplittingPlanesLongest<0.f>
 #define DEFAULT_BVH_FALLBACK_STRATEGY_SHOULD_STOP bvhStrategies::shouldStopThresholdOrLevel
 
+#define LINEAR_FALLBACK_BVH 0 /**< If true, the fallback @p Bvh of the experiments is built with @p Bvh::BuildMode::Linear and treelet restructuring, which is several times faster than the default top-down build, but gives a higher cost. */
+
 #define FAST_ORTHOGRAPHIC_PROJECTIONS 0 /**< If true, the orthographic projections will project the points to the coordinate system of the projection plane, not to the canonical view volume (i.e. {[-1,-1], [1,1]}).  */
 
 #define PAH_STRATEGY bvhStrategies::computeCostPahWithCulling
+#define PAH_BATCH_STRATEGY bvhStrategies::computeCostPahWithCullingBatch
@@ -0,0 +1,412 @@
+#include "pch.h"
+
+#include <future>
+
+#include "../../ProjectedAreaHeuristic/src/Utilities.h"
+#include "../../ProjectedAreaHeuristic/src/Regions.h"
+#include "../../ProjectedAreaHeuristic/src/InfluenceArea.h"
+#include "../../ProjectedAreaHeuristic/src/Bvh.h"
+#include "../../ProjectedAreaHeuristic/src/Bvh.cpp"
+
+
+namespace bvh {
+	using namespace pah;
+
+	/**
+	 * @brief Returns @p count random triangles in a 20x20x20 box, whose vertices are at most @p size away from the first one along each axis.
+	 */
+	static std::vector<Triangle> randomTriangles(int count, unsigned int seed, float size = 1) {
+		std::mt19937 rng{ seed };
+		std::uniform_real_distribution<float> position{ -10, 10 };
+		std::uniform_real_distribution<float> offset{ -size, size };
+		std::vector<Triangle> triangles;
+		triangles.reserve(count); //the Bvh points to the triangles
+		for (int i = 0; i < count; ++i) {
+			Vector3 center{ position(rng), position(rng), position(rng) };
+			triangles.emplace_back(center, center + Vector3{ offset(rng), offset(rng), offset(rng) }, center + Vector3{ offset(rng), offset(rng), offset(rng) });
+		}
+		return triangles;
+	}
+
+	/**
+	 * @brief Returns pointers to the triangles in @p triangles.
+	 */
+	static std::vector<const Triangle*> pointers(const std::vector<Triangle>& triangles) {
+		return triangles | std::views::transform([](const auto& t) { return &t; }) | std::ranges::to<std::vector>();
+	}
+
+	static Bvh::Properties properties() {
+		return Bvh::Properties{
+			.maxLeafCost = 0.0f,
+			.maxLeafArea = 0.0f,
+			.maxLeafHitProbability = 0.0f,
+			.maxTrianglesPerLeaf = 2,
+			.maxLevels = 100,
+			.bins = 16,
+			.maxNonFallbackLevels = 100,
+			.splitPlaneQualityThreshold = 0.4f,
+			.acceptableChildrenFatherHitProbabilityRatio = 1.3f,
+			.excellentChildrenFatherHitProbabilityRatio = 0.9f
+		};
+	}
+
+	static const PlaneInfluenceArea influenceArea{ Plane{ { 0, 0, -15 }, { 0.2f, 0.1f, 1 }, 12, 12 }, 40, 100 };
+
+	static Bvh pahBvh(const Bvh::Properties& properties = bvh::properties()) {
+		Bvh bvh{ properties, influenceArea, bvhStrategies::computeCostPahWithCulling, bvhStrategies::chooseSplittingPlanesLongest<0.f>, bvhStrategies::shouldStopThresholdOrLevel, "pah" };
+		bvh.setComputeCostBatchStrategy(bvhStrategies::computeCostPahWithCullingBatch);
+		return bvh;
+	}
+
+	/**
+	 * @brief Returns @p count random rays crossing the scene of @p randomTriangles.
+	 */
+	static std::vector<Ray> randomRays(int count, unsigned int seed) {
+		std::mt19937 rng{ seed };
+		std::uniform_real_distribution<float> position{ -12, 12 };
+		std::vector<Ray> rays;
+		for (int i = 0; i < count; ++i) {
+			Vector3 origin{ position(rng), position(rng), -15 };
+			rays.emplace_back(origin, Vector3{ position(rng), position(rng), 10 } - origin);
+		}
+		return rays;
+	}
+
+	/**
+	 * @brief Checks that each node of the subtree of @p node encloses its triangles and its children, and that its triangles are the ones of its children.
+	 */
+	static void expectConsistent(const Bvh::Node& node) {
+		for (auto t : node.triangles) {
+			Aabb bounds{ glm::min((*t)[0], glm::min((*t)[1], (*t)[2])), glm::max((*t)[0], glm::max((*t)[1], (*t)[2])) };
+			ASSERT_TRUE(node.aabb.fullyContains(bounds)) << "A node should enclose its triangles.";
+		}
+		if (node.isLeaf()) return;
+
+		ASSERT_TRUE(node.leftChild != nullptr && node.rightChild != nullptr) << "An internal node should have 2 children.";
+		EXPECT_TRUE(node.aabb.fullyContains(node.leftChild->aabb) && node.aabb.fullyContains(node.rightChild->aabb)) << "A node should enclose its children.";
+		auto triangles = node.triangles, childrenTriangles = node.leftChild->triangles;
+		childrenTriangles.insert(childrenTriangles.end(), node.rightChild->triangles.begin(), node.rightChild->triangles.end());
+		std::ranges::sort(triangles);
+		std::ranges::sort(childrenTriangles);
+		EXPECT_EQ(triangles, childrenTriangles) << "The triangles of a node should be the union of the ones of its children.";
+		expectConsistent(*node.leftChild);
+		expectConsistent(*node.rightChild);
+	}
+
+	/**
+	 * @brief Adds the triangles of the leaves of the subtree of @p node to @p triangles.
+	 */
+	static void collectLeafTriangles(const Bvh::Node& node, std::vector<const Triangle*>& triangles) {
+		if (node.isLeaf()) triangles.insert(triangles.end(), node.triangles.begin(), node.triangles.end());
+		else {
+			collectLeafTriangles(*node.leftChild, triangles);
+			collectLeafTriangles(*node.rightChild, triangles);
+		}
+	}
+
+	/**
+	 * @brief Checks that the nodes of the subtree of @p node left unbuilt are the ones that no ray of @p rays reaches, and returns how many there are.
+	 */
+	static int expectUnbuiltUnreached(const Bvh::Node& node, const std::vector<Ray>& rays) {
+		if (node.lazySubtree) {
+			bool reached = std::ranges::any_of(rays, [&node](const Ray& ray) { return collisionDetection::areColliding(ray, node.aabb).hit; });
+			if (reached) return 0; //it may still be a leaf, if it couldn't be split
+			EXPECT_TRUE(node.isLeaf()) << "A lazy subtree that no traversal reached should not be built.";
+			return 1;
+		}
+		if (node.isLeaf()) return 0;
+		return expectUnbuiltUnreached(*node.leftChild, rays) + expectUnbuiltUnreached(*node.rightChild, rays);
+	}
+
+	/**
+	 * @brief Checks that the closest hits of @p bvh are the ones found by testing each ray against each triangle.
+	 */
+	static void expectSameHits(const Bvh& bvh, const std::vector<Ray>& rays, const std::vector<const Triangle*>& triangles) {
+		for (const auto& ray : rays) {
+			float closest = std::numeric_limits<float>::max();
+			for (auto t : triangles) {
+				auto hit = collisionDetection::areColliding(ray, **t);
+				if (hit.hit) closest = glm::min(closest, hit.distance);
+			}
+			auto res = bvh.traverse(ray);
+			ASSERT_EQ(res.hit(), closest != std::numeric_limits<float>::max()) << "The Bvh and the brute force test should agree on whether a ray hits.";
+			if (res.hit()) EXPECT_FLOAT_EQ(res.closestHitDistance, closest) << "The Bvh should find the closest hit.";
+		}
+	}
+
+	// Inserting and removing triangles keeps the Bvh consistent, down to an empty Bvh and back
+	TEST(Bvh, InsertRemove) {
+		auto triangles = randomTriangles(300, 7);
+		auto all = pointers(triangles);
+		auto rays = randomRays(500, 8);
+		Bvh bvh = pahBvh();
+		bvh.build(std::vector(all.begin(), all.begin() + 150), 1);
+
+		for (int i = 150; i < 300; ++i) bvh.insert(triangles[i]);
+		EXPECT_EQ(bvh.getRoot().triangles.size(), 300) << "The Bvh should contain the built and the inserted triangles.";
+		expectConsistent(bvh.getRoot());
+		expectSameHits(bvh, rays, all);
+
+		Triangle absent{ Vector3{ 0, 0, 0 }, Vector3{ 1, 0, 0 }, Vector3{ 0, 1, 0 } };
+		EXPECT_FALSE(bvh.remove(absent)) << "Removing a triangle that is not in the Bvh should fail.";
+		for (int i = 0; i < 300; i += 2) EXPECT_TRUE(bvh.remove(triangles[i])) << "Removing a triangle of the Bvh should succeed.";
+		EXPECT_FALSE(bvh.remove(triangles[0])) << "Removing a triangle twice should fail.";
+		std::vector<const Triangle*> odd;
+		for (int i = 1; i < 300; i += 2) odd.push_back(&triangles[i]);
+		EXPECT_EQ(bvh.getRoot().triangles.size(), odd.size());
+		expectConsistent(bvh.getRoot());
+		expectSameHits(bvh, rays, odd);
+
+		for (auto t : odd) EXPECT_TRUE(bvh.remove(*t));
+		EXPECT_TRUE(bvh.getRoot().triangles.empty()) << "Removing all the triangles should leave an empty Bvh.";
+		expectSameHits(bvh, rays, {});
+
+		for (int i = 0; i < 20; ++i) bvh.insert(triangles[i]);
+		expectConsistent(bvh.getRoot());
+		expectSameHits(bvh, rays, std::vector(all.begin(), all.begin() + 20));
+
+		//a Bvh that was never built, starting from a triangle outside the influence area (whose projected area is 0)
+		Bvh inserted = pahBvh();
+		Triangle culled{ Vector3{ 40, 0, 0 }, Vector3{ 41, 0, 0 }, Vector3{ 40, 1, 0 } };
+		inserted.insert(culled);
+		for (const auto& t : triangles) inserted.insert(t);
+		auto withCulled = all;
+		withCulled.push_back(&culled);
+		EXPECT_EQ(inserted.getRoot().triangles.size(), withCulled.size());
+		expectConsistent(inserted.getRoot());
+		expectSameHits(inserted, rays, withCulled);
+		inserted.refit(); //sets the costs of the inserted nodes
+		inserted.refit();
+		EXPECT_NEAR(inserted.getLastRefitResults().costGrowth, 0.0f, 1e-4f) << "The costs of a Bvh built by insertion should be finite, and not change without movements.";
+	}
+
+	// Refitting after the triangles moved keeps the Bvh consistent, and rebuilds the subtrees that got too expensive
+	TEST(Bvh, Refit) {
+		auto triangles = randomTriangles(300, 9);
+		auto all = pointers(triangles);
+		auto rays = randomRays(500, 10);
+		std::mt19937 rng{ 11 };
+		auto move = [&triangles, &rng](float distance) {
+			std::uniform_real_distribution<float> offset{ -distance, distance };
+			for (auto& t : triangles) {
+				Vector3 translation{ offset(rng), offset(rng), offset(rng) };
+				t = Triangle{ t[0] + translation, t[1] + translation, t[2] + translation };
+			}
+		};
+
+		Bvh refitOnly = pahBvh();
+		refitOnly.build(all, 1);
+		move(0.5f);
+		refitOnly.refit();
+		EXPECT_EQ(refitOnly.getLastRefitResults().rebuiltSubtrees, 0) << "With maxRefitCostGrowth = 0, refit should never rebuild.";
+		expectConsistent(refitOnly.getRoot());
+		expectSameHits(refitOnly, rays, all);
+
+		auto rebuildingProperties = properties();
+		rebuildingProperties.maxRefitCostGrowth = 0.05f;
+		Bvh rebuilding = pahBvh(rebuildingProperties);
+		rebuilding.build(all, 1);
+		move(8.0f);
+		rebuilding.refit();
+		EXPECT_GE(rebuilding.getLastRefitResults().rebuiltSubtrees, 1) << "A large deformation should rebuild some subtrees.";
+		EXPECT_GT(rebuilding.getLastRefitResults().costGrowth, 0.05f);
+		EXPECT_EQ(rebuilding.getRoot().triangles.size(), all.size());
+		expectConsistent(rebuilding.getRoot());
+		expectSameHits(rebuilding, rays, all);
+	}
+
+	// Updating with a few changed triangles inserts and removes them, with many it rebuilds the whole Bvh
+	TEST(Bvh, Update) {
+		auto triangles = randomTriangles(400, 12);
+		auto all = pointers(triangles);
+		auto rays = randomRays(500, 13);
+		Bvh bvh = pahBvh();
+		bvh.build(std::vector(all.begin(), all.begin() + 200), 1);
+
+		std::vector few(all.begin() + 10, all.begin() + 210); //10 removed, 10 added
+		bvh.update(few);
+		EXPECT_EQ(bvh.getLastRefitResults().rebuiltSubtrees, 0) << "A few changed triangles should not rebuild the Bvh.";
+		EXPECT_EQ(bvh.getRoot().triangles.size(), few.size());
+		expectConsistent(bvh.getRoot());
+		expectSameHits(bvh, rays, few);
+
+		std::vector many(all.begin() + 150, all.begin() + 400); //60 removed, 190 added
+		bvh.update(many);
+		EXPECT_EQ(bvh.getLastRefitResults().rebuiltSubtrees, 1) << "Many changed triangles should rebuild the whole Bvh.";
+		EXPECT_EQ(bvh.getLastRefitResults().rebuiltTriangles, many.size());
+		EXPECT_EQ(bvh.getRoot().triangles.size(), many.size());
+		expectConsistent(bvh.getRoot());
+		expectSameHits(bvh, rays, many);
+	}
+
+	// Traversing a lazily built Bvh from many threads builds only the subtrees that are reached, and finds the same hits as an eager build
+	TEST(Bvh, LazyBuild) {
+		auto triangles = randomTriangles(1000, 14);
+		auto all = pointers(triangles);
+		//the rays only cross a corner of the scene, so that some subtrees are never reached
+		std::mt19937 rng{ 15 };
+		std::uniform_real_distribution<float> corner{ -10, -6 };
+		std::vector<Ray> rays;
+		for (int i = 0; i < 300; ++i) rays.emplace_back(Vector3{ corner(rng), corner(rng), -15 }, Vector3{ 0, 0, 1 });
+
+		Bvh eager = pahBvh();
+		eager.build(all, 1);
+		auto lazyProperties = properties();
+		lazyProperties.lazyBuildLevels = 2;
+		Bvh lazy = pahBvh(lazyProperties);
+		lazy.build(all, 1);
+
+		std::vector<std::future<std::vector<Bvh::TraversalResults>>> traversals;
+		for (int i = 0; i < 4; ++i) {
+			traversals.push_back(std::async(std::launch::async, [&lazy, &rays]() {
+				return rays | std::views::transform([&lazy](const Ray& ray) { return lazy.traverse(ray); }) | std::ranges::to<std::vector>();
+			}));
+		}
+		for (auto& traversal : traversals) {
+			auto results = traversal.get();
+			for (int i = 0; i < rays.size(); ++i) {
+				auto expected = eager.traverse(rays[i]);
+				ASSERT_EQ(results[i].hit(), expected.hit()) << "The lazy and the eager Bvh should agree on whether a ray hits.";
+				if (expected.hit()) EXPECT_FLOAT_EQ(results[i].closestHitDistance, expected.closestHitDistance) << "The lazy and the eager Bvh should find the same closest hit.";
+			}
+		}
+
+		EXPECT_GT(expectUnbuiltUnreached(lazy.getRoot(), rays), 0) << "Some subtrees should never be reached, and stay unbuilt.";
+		expectSameHits(lazy, rays, all);
+		lazy.refit();
+		EXPECT_NEAR(lazy.getLastRefitResults().costGrowth, 0.0f, 1e-4f) << "The subtrees built by the traversals should update the costs of their ancestors, so that a refit without movements finds no growth.";
+	}
+
+	// A build without time left is still a complete Bvh, and refining it eventually leaves no linear subtrees
+	TEST(Bvh, TimeBudget) {
+		auto triangles = randomTriangles(1000, 16);
+		auto all = pointers(triangles);
+		auto rays = randomRays(500, 17);
+		Bvh full = pahBvh();
+		full.build(all, 1);
+		Bvh budgeted = pahBvh();
+		budgeted.build(all, DurationMs{ 0 });
+
+		std::vector<const Triangle*> reachable;
+		collectLeafTriangles(budgeted.getRoot(), reachable);
+		std::ranges::sort(reachable);
+		auto sortedAll = all;
+		std::ranges::sort(sortedAll);
+		EXPECT_EQ(reachable, sortedAll) << "Each triangle should be in exactly one leaf.";
+		expectConsistent(budgeted.getRoot());
+		for (const auto& ray : rays) {
+			auto res = budgeted.traverse(ray), expected = full.traverse(ray);
+			ASSERT_EQ(res.hit(), expected.hit()) << "The budgeted and the full Bvh should agree on whether a ray hits.";
+			if (expected.hit()) EXPECT_FLOAT_EQ(res.closestHitDistance, expected.closestHitDistance) << "The budgeted and the full Bvh should find the same closest hit.";
+		}
+
+		EXPECT_GT(budgeted.refine(DurationMs{ 0 }), 0) << "Without time left, the subtrees should be built linearly, and be refinable.";
+		int refinableLeft = budgeted.refine(DurationMs{ 5 });
+		for (int calls = 1; refinableLeft > 0 && calls < 1000; ++calls) refinableLeft = budgeted.refine(DurationMs{ 5 });
+		EXPECT_EQ(refinableLeft, 0) << "Refining repeatedly should rebuild all the linear subtrees.";
+		expectConsistent(budgeted.getRoot());
+		expectSameHits(budgeted, rays, all);
+	}
+
+	// Spatial splits on large triangles find the same hits, and add at most the allowed number of references
+	TEST(Bvh, SpatialSplits) {
+		auto triangles = randomTriangles(300, 18, 6);
+		auto all = pointers(triangles);
+		auto rays = randomRays(500, 19);
+		for (int lazyBuildLevels : { 0, 2 }) { //the lazy subtrees share the budget
+			auto spatialProperties = properties();
+			spatialProperties.maxSpatialSplitsDuplication = 0.3f;
+			spatialProperties.lazyBuildLevels = lazyBuildLevels;
+			Bvh bvh = pahBvh(spatialProperties);
+			bvh.build(all, 1);
+			expectSameHits(bvh, rays, all);
+
+			std::vector<const Triangle*> references;
+			collectLeafTriangles(bvh.getRoot(), references);
+			EXPECT_GT(references.size(), all.size()) << "Large overlapping triangles should be split spatially.";
+			EXPECT_LE(references.size(), all.size() + static_cast<size_t>(spatialProperties.maxSpatialSplitsDuplication * all.size())) << "Spatial splits should not add more references than allowed.";
+			std::ranges::sort(references);
+			auto [first, last] = std::ranges::unique(references);
+			references.erase(first, last);
+			auto sortedAll = all;
+			std::ranges::sort(sortedAll);
+			EXPECT_EQ(references, sortedAll) << "Each triangle should be in at least one leaf.";
+		}
+	}
+
+	// The radix sort of the linear build orders the triangles like a stable sort of their Morton codes
+	TEST(Bvh, RadixSort) {
+		auto triangles = randomTriangles(1000, 20);
+		auto sortedTriangles = pointers(triangles);
+		std::mt19937 rng{ 21 };
+		std::uniform_int_distribution<unsigned int> code{};
+		std::vector<unsigned int> codes(sortedTriangles.size());
+		for (int i = 0; i < codes.size(); ++i) codes[i] = i % 3 == 0 ? code(rng) % 16 : code(rng); //many equal codes, to check that the sort is stable
+
+		std::vector<std::pair<unsigned int, const Triangle*>> expected;
+		for (int i = 0; i < codes.size(); ++i) expected.emplace_back(codes[i], sortedTriangles[i]);
+		std::ranges::stable_sort(expected, {}, &std::pair<unsigned int, const Triangle*>::first);
+		radixSort(codes, sortedTriangles);
+		for (int i = 0; i < codes.size(); ++i) {
+			EXPECT_EQ(codes[i], expected[i].first) << "The codes should be sorted.";
+			EXPECT_EQ(sortedTriangles[i], expected[i].second) << "Each triangle should stay with its code, in the original order among equal codes.";
+		}
+
+		auto all = pointers(triangles);
+		auto [mortonCodes, mortonTriangles] = sortByMortonCode(all);
+		EXPECT_TRUE(std::ranges::is_sorted(mortonCodes)) << "The Morton codes should be sorted.";
+		std::ranges::sort(mortonTriangles);
+		std::ranges::sort(all);
+		EXPECT_EQ(mortonTriangles, all) << "Sorting by Morton code should keep all the triangles.";
+	}
+
+	// A linear Bvh, big enough to build its subtrees in parallel, is consistent and finds the closest hits
+	TEST(Bvh, LinearBuild) {
+		auto triangles = randomTriangles(5000, 22);
+		auto all = pointers(triangles);
+		auto rays = randomRays(500, 23);
+		Bvh bvh = pahBvh();
+		bvh.setBuildMode(Bvh::BuildMode::Linear);
+		bvh.build(all, 1);
+		EXPECT_EQ(bvh.getRoot().triangles.size(), all.size());
+		expectConsistent(bvh.getRoot());
+		expectSameHits(bvh, rays, all);
+	}
+
+	// An agglomerative Bvh is consistent and finds the closest hits, even when most merges have the same (culled) hit probability
+	TEST(Bvh, AgglomerativeBuild) {
+		auto triangles = randomTriangles(2000, 24);
+		//half of the triangles are far from the influence area, so all their merges are culled and only the tie breaks order them
+		for (int i = 0; i < triangles.size(); i += 2) triangles[i] = Triangle{ triangles[i][0] + Vector3{ 40, 0, 0 }, triangles[i][1] + Vector3{ 40, 0, 0 }, triangles[i][2] + Vector3{ 40, 0, 0 } };
+		auto all = pointers(triangles);
+		auto rays = randomRays(500, 25);
+		Bvh bvh = pahBvh();
+		bvh.setBuildMode(Bvh::BuildMode::Agglomerative);
+		bvh.build(all, 1);
+		EXPECT_EQ(bvh.getRoot().triangles.size(), all.size());
+		expectConsistent(bvh.getRoot());
+		expectSameHits(bvh, rays, all);
+	}
+
+	// Restructuring the treelets of a built Bvh keeps it consistent and its hits, and doesn't increase its cost
+	TEST(Bvh, RestructureTreelets) {
+		auto triangles = randomTriangles(1000, 26);
+		auto all = pointers(triangles);
+		auto rays = randomRays(500, 27);
+		Bvh bvh = pahBvh();
+		bvh.setBuildMode(Bvh::BuildMode::Linear); //a linear Bvh leaves room for improvement
+		bvh.build(all, 1);
+		float cost = bvh.getRoot().buildCost;
+
+		bvh.restructureTreelets(7);
+		EXPECT_LT(bvh.getRoot().buildCost, cost) << "Restructuring a linear Bvh should lower its cost.";
+		cost = bvh.getRoot().buildCost;
+		bvh.restructureTreelets(Bvh::MAX_TREELET_LEAVES, 2);
+		EXPECT_LE(bvh.getRoot().buildCost, cost * (1.0f + 1e-5f)) << "Restructuring should never increase the cost.";
+		EXPECT_EQ(bvh.getRoot().triangles.size(), all.size());
+		expectConsistent(bvh.getRoot());
+		expectSameHits(bvh, rays, all);
+
+		EXPECT_THROW(bvh.restructureTreelets(Bvh::MAX_TREELET_LEAVES + 1), std::invalid_argument) << "Treelets larger than MAX_TREELET_LEAVES should be rejected.";
+	}
+}
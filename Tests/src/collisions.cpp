@@ -2,6 +2,8 @@
 
 #include "../../ProjectedAreaHeuristic/src/Utilities.h"
 #include "../../ProjectedAreaHeuristic/src/Regions.h"
+#include "../../ProjectedAreaHeuristic/src/EarlySplit.h"
+#include "randomRegions.h"
 
 
 namespace collisions {
@@ -87,4 +89,121 @@ namespace collisions {
 		EXPECT_TRUE(res1.hit) << "Ray r1 should be colliding with Aabb aabb1.";
 		EXPECT_NEAR(res1.distance, 0.624f, TOLERANCE) << "Collision distance of Ray r1 and Aabb aabb1 should be 0.624.";
 	}
+
+	// The batch version of the SAT must give the same results of the single Aabb version (also for the Aabbs that don't fill a whole SSE register)
+	TEST(RegionAabb, BatchMatchesSingle) {
+		using namespace pah;
+		AabbForObb aabbForObb{ Vector3{0,0,0}, Vector3{1,2,3}, Vector3{1,1,0.5f} };
+		Frustum frustum{ Pov{ Vector3{0,0,0}, Vector3{1,0.2f,0}, 60, 45 }, 10, 1 };
+		std::array<Aabb, 7> aabbs{
+			Aabb{ Vector3{-0.5f,-0.5f,-0.5f}, Vector3{0.5f,0.5f,0.5f} },
+			Aabb{ Vector3{2.5f,2.5f,-3}, Vector3{3,3,-2.5f} },
+			Aabb{ Vector3{10,10,10}, Vector3{11,11,11} },
+			Aabb{ Vector3{4,-1,-1}, Vector3{5,1,1} },
+			Aabb{ Vector3{-3,-3,-3}, Vector3{-2,-2,-2} },
+			Aabb{ Vector3{1.5f,-0.2f,-3}, Vector3{1.7f,0.2f,-2.5f} },
+			Aabb{ Vector3{8,5,-0.5f}, Vector3{9,6,0.5f} }
+		};
+
+		std::array<bool, 7> obbResults, frustumResults;
+		aabbForObb.isCollidingWith(aabbs, obbResults);
+		frustum.isCollidingWith(aabbs, frustumResults);
+		for (int i = 0; i < aabbs.size(); ++i) {
+			EXPECT_EQ(obbResults[i], aabbForObb.isCollidingWith(aabbs[i])) << "Batch and single AabbForObb tests differ for Aabb " << i << ".";
+			EXPECT_EQ(frustumResults[i], frustum.isCollidingWith(aabbs[i])) << "Batch and single Frustum tests differ for Aabb " << i << ".";
+		}
+		EXPECT_TRUE(obbResults[0]) << "Aabb 0 is at the center of the AabbForObb.";
+		EXPECT_FALSE(obbResults[2]) << "Aabb 2 is far from the AabbForObb.";
+		EXPECT_TRUE(frustumResults[3]) << "Aabb 3 is in front of the Frustum.";
+		EXPECT_FALSE(frustumResults[4]) << "Aabb 4 is behind the Frustum.";
+	}
+
+	// Aabbs fully inside, fully outside (behind a plane) and across the boundary of a Frustum
+	TEST(FrustumAabb, Classify) {
+		using namespace pah;
+		Frustum frustum{ Pov{ Vector3{0,0,0}, Vector3{0,0,-1}, 90, 90 }, 10, 1 };
+		Aabb inside{ Vector3{-0.5f,-0.5f,-5}, Vector3{0.5f,0.5f,-4} };
+		Aabb outside{ Vector3{-0.5f,-0.5f,2}, Vector3{0.5f,0.5f,3} };
+		Aabb intersecting{ Vector3{-0.5f,-0.5f,-11}, Vector3{0.5f,0.5f,-9} };
+
+		EXPECT_EQ(collisionDetection::classify(frustum, inside), collisionDetection::Containment::Inside) << "Aabb inside should be inside the Frustum.";
+		EXPECT_EQ(collisionDetection::classify(frustum, outside), collisionDetection::Containment::Outside) << "Aabb outside is behind the near plane of the Frustum.";
+		EXPECT_EQ(collisionDetection::classify(frustum, intersecting), collisionDetection::Containment::Intersecting) << "Aabb intersecting crosses the far plane of the Frustum.";
+		EXPECT_TRUE(frustum.fullyContains(inside)) << "Frustum should fully contain Aabb inside.";
+		EXPECT_FALSE(frustum.fullyContains(intersecting)) << "Frustum should not fully contain Aabb intersecting.";
+		EXPECT_TRUE(frustum.isCollidingWith(intersecting)) << "Frustum should be colliding with Aabb intersecting.";
+		EXPECT_FALSE(frustum.isCollidingWith(outside)) << "Frustum should not be colliding with Aabb outside.";
+	}
+
+	// Counting the hits of many rays on a batch of Aabbs (not a multiple of 4) must be the same as the single Ray-Aabb tests
+	TEST(RayAabb, CountCollisionsMatchesSingle) {
+		using namespace pah;
+		std::mt19937 rng{ 42 };
+		std::uniform_real_distribution<float> coordinate{ -10, 10 };
+
+		std::vector<Ray> rays;
+		for (int i = 0; i < 1000; ++i) rays.push_back(Ray{ Vector3{ coordinate(rng), coordinate(rng), coordinate(rng) }, Vector3{ coordinate(rng), coordinate(rng), coordinate(rng) } });
+		auto aabbs = randomRegions::randomAabbs(11, 43, 10, 4);
+
+		std::vector<int> hitsCounts(aabbs.size());
+		collisionDetection::countCollisions(SampleRays{ rays }, aabbs, hitsCounts);
+		for (int i = 0; i < aabbs.size(); ++i) {
+			int expected = std::ranges::count_if(rays, [&aabb = aabbs[i]](const Ray& ray) { return collisionDetection::areColliding(ray, aabb).hit; });
+			EXPECT_EQ(hitsCounts[i], expected) << "Batch and single Ray-Aabb tests differ for Aabb " << i << ".";
+		}
+		EXPECT_EQ(SampleRays(rays, 100).size(), 100) << "SampleRays should keep at most maxSamples rays.";
+		EXPECT_EQ(SampleRays(rays, 5000).size(), rays.size()) << "SampleRays should keep all the rays if they are fewer than maxSamples.";
+		EXPECT_THROW(SampleRays(rays, 0), std::invalid_argument) << "SampleRays should reject a non positive number of samples.";
+	}
+
+	// Triangles inside, across and outside an Aabb
+	TEST(AabbTriangle, Clip) {
+		using namespace pah;
+		Aabb aabb{ Vector3{-1,-1,-1}, Vector3{1,1,1} };
+
+		Triangle inside{ Vector3{-0.5f,0,0}, Vector3{0.5f,0,0}, Vector3{0,0.5f,0.2f} };
+		Aabb insideClipped = aabb.clip(inside);
+		EXPECT_NEAR(glm::distance(insideClipped.min, Vector3(-0.5f, 0, 0)), 0, TOLERANCE) << "A triangle inside the Aabb should not be clipped.";
+		EXPECT_NEAR(glm::distance(insideClipped.max, Vector3(0.5f, 0.5f, 0.2f)), 0, TOLERANCE) << "A triangle inside the Aabb should not be clipped.";
+
+		Triangle across{ Vector3{-10,-10,0}, Vector3{10,-10,0}, Vector3{0,10,0} };
+		Aabb acrossClipped = aabb.clip(across);
+		EXPECT_NEAR(glm::distance(acrossClipped.min, Vector3(-1, -1, 0)), 0, TOLERANCE) << "A big triangle should be clipped to the faces of the Aabb.";
+		EXPECT_NEAR(glm::distance(acrossClipped.max, Vector3(1, 1, 0)), 0, TOLERANCE) << "A big triangle should be clipped to the faces of the Aabb.";
+
+		Triangle corner{ Vector3{0.5f,0.5f,0}, Vector3{3,0.5f,0}, Vector3{0.5f,3,0} };
+		Aabb cornerClipped = aabb.clip(corner);
+		EXPECT_NEAR(glm::distance(cornerClipped.min, Vector3(0.5f, 0.5f, 0)), 0, TOLERANCE);
+		EXPECT_NEAR(glm::distance(cornerClipped.max, Vector3(1, 1, 0)), 0, TOLERANCE);
+
+		Triangle outside{ Vector3{2,2,2}, Vector3{3,2,2}, Vector3{2,3,2} };
+		Aabb outsideClipped = aabb.clip(outside);
+		EXPECT_GT(outsideClipped.min.x, outsideClipped.max.x) << "A triangle outside the Aabb should give an empty Aabb.";
+	}
+
+	TEST(EarlySplit, Fragments) {
+		using namespace pah;
+		std::vector<Triangle> triangles{
+			Triangle{ Vector3{0,0,0}, Vector3{10,10,10}, Vector3{10,10.5f,10} }, //skinny diagonal triangle
+			Triangle{ Vector3{0,0,0}, Vector3{0.1f,0,0}, Vector3{0,0.1f,0} }
+		};
+		EarlySplit earlySplit{ triangles, EarlySplit::Properties{ .maxRelativeSize = 0.05f, .maxDuplication = 100.0f } };
+		const auto& fragments = earlySplit.getTriangles();
+
+		EXPECT_EQ(earlySplit.getSplitTrianglesCount(), 1) << "Only the big triangle should be split.";
+		EXPECT_GT(fragments.size(), triangles.size());
+		float area = 0.0f, sceneArea = Aabb{ Vector3{0,0,0}, Vector3{10,10.5f,10} }.surfaceArea();
+		for (const auto& f : fragments) {
+			const Triangle* original = earlySplit.getOriginal(&f);
+			ASSERT_TRUE(original == &triangles[0] || original == &triangles[1]);
+			if (original == &triangles[0]) area += f.computeArea();
+			else EXPECT_NEAR(glm::distance(f[0], triangles[1][0]) + glm::distance(f[1], triangles[1][1]) + glm::distance(f[2], triangles[1][2]), 0, TOLERANCE) << "Small triangles should be left untouched.";
+			Aabb aabb{ glm::min(f[0], glm::min(f[1], f[2])), glm::max(f[0], glm::max(f[1], f[2])) };
+			EXPECT_LE(aabb.surfaceArea() / sceneArea, 0.05f) << "All the fragments should be smaller than the limit.";
+		}
+		EXPECT_NEAR(area, triangles[0].computeArea(), TOLERANCE) << "The fragments should cover the same surface of the original triangle.";
+
+		EarlySplit noBudget{ triangles, EarlySplit::Properties{ .maxRelativeSize = 0.05f, .maxDuplication = 0.0f } };
+		EXPECT_EQ(noBudget.getTriangles().size(), triangles.size()) << "No fragments can be added without a duplication budget.";
+	}
 }
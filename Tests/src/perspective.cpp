@@ -5,9 +5,14 @@
 #include "../../ProjectedAreaHeuristic/src/InfluenceArea.h"
 #include "../../ProjectedAreaHeuristic/src/InfluenceArea.cpp"
 #include "../../ProjectedAreaHeuristic/src/Projections.h"
+#include "randomRegions.h"
 
 
 namespace perspective {
+	using randomRegions::randomAabbs;
+
+	static const pah::PlaneInfluenceArea obliquePlaneInfluenceArea{ pah::Plane{ {0,0,-10}, {0.3f,0.2f,1}, 5, 4 }, 40, 100 };
+
 	TEST(Projection, Aabbs) {
 		using namespace pah;
 
@@ -89,4 +94,167 @@ namespace perspective {
 
 		int a = 1;
 	}
+
+
+	TEST(CulledArea, MatchesOverlappingHull) {
+		using namespace pah;
+
+		PointInfluenceArea pointInfluenceArea{ Pov{ {0,0,-20}, {0.3f,0.2f,1}, 90, 60 }, 1000, 1, 100 };
+
+		for (const auto& aabb : randomAabbs(1000, 42)) {
+			for (const InfluenceArea* influenceArea : { (const InfluenceArea*)&obliquePlaneInfluenceArea, (const InfluenceArea*)&pointInfluenceArea }) {
+				float expected = overlappingArea(ConvexHull2d{ influenceArea->getProjectedHull(aabb) }, ConvexHull2d{ influenceArea->getProjectionPlaneHull() });
+				EXPECT_NEAR(influenceArea->getCulledProjectedArea(aabb), expected, TOLERANCE * glm::max(1.0f, expected));
+			}
+		}
+	}
+
+	TEST(ProjectedArea, CachedMatrixMatchesPov) {
+		using namespace pah;
+
+		Pov pov{ {0,0,-20}, {0.3f,0.2f,1}, 90, 60 };
+		PointInfluenceArea pointInfluenceArea{ pov, 1000, 1, 100 };
+
+		for (const auto& aabb : randomAabbs(1000, 42)) {
+			float expected = projection::perspective::computeProjectedArea(aabb, pov);
+			EXPECT_NEAR(pointInfluenceArea.getProjectedArea(aabb), expected, TOLERANCE * glm::max(1.0f, expected));
+		}
+		EXPECT_EQ(pointInfluenceArea.getProjectedArea(Aabb{ {-1,-1,-21}, {1,1,-19} }), 1000.0f); //pov inside the aabb
+	}
+
+	TEST(OrthographicArea, ClosedFormMatchesHull) {
+		using namespace pah;
+
+		auto aabbs = randomAabbs(1001, 42);
+
+		std::vector<float> areas(aabbs.size());
+		obliquePlaneInfluenceArea.getProjectedAreas(aabbs, areas);
+		for (int i = 0; i < aabbs.size(); ++i) {
+			float expected = ConvexHull2d{ obliquePlaneInfluenceArea.getProjectedHull(aabbs[i]) }.computeArea();
+			EXPECT_NEAR(obliquePlaneInfluenceArea.getProjectedArea(aabbs[i]), expected, TOLERANCE * glm::max(1.0f, expected));
+			EXPECT_EQ(areas[i], obliquePlaneInfluenceArea.getProjectedArea(aabbs[i]));
+		}
+	}
+
+	TEST(SolidAngle, KnownValues) {
+		using namespace pah;
+
+		PointInfluenceArea pointInfluenceArea{ Pov{ {0,0,0}, {0,0,1}, 170, 170 }, 1000, 0.1f, 100 };
+		constexpr float pi = 3.14159265f;
+
+		//a square of side 2 at distance 1 subtends 4 * asin(sin(45) * sin(45)) = 2/3 pi
+		EXPECT_NEAR(pointInfluenceArea.getCulledSolidAngle(Aabb{ {-1,-1,1}, {1,1,3} }), 2.0f / 3.0f * pi, 0.001f);
+		//half of the square subtends half of the solid angle
+		EXPECT_NEAR(pointInfluenceArea.getCulledSolidAngle(Aabb{ {0,-1,1}, {1,1,3} }), 1.0f / 3.0f * pi, 0.001f);
+		//with a 90x90 frustum, a bigger square at the same distance is culled to the whole frustum, whose solid angle is again 2/3 pi
+		PointInfluenceArea narrowInfluenceArea{ Pov{ {0,0,0}, {0,0,1}, 90, 90 }, 1000, 0.1f, 100 };
+		EXPECT_NEAR(narrowInfluenceArea.getCulledSolidAngle(Aabb{ {-2,-2,1}, {2,2,3} }), 2.0f / 3.0f * pi, 0.001f);
+		EXPECT_NEAR(narrowInfluenceArea.getFrustumSolidAngle(), 2.0f / 3.0f * pi, 0.001f);
+		//behind the pov
+		EXPECT_EQ(pointInfluenceArea.getCulledSolidAngle(Aabb{ {-1,-1,-3}, {1,1,-1} }), 0.0f);
+		//the pov is inside the aabb
+		EXPECT_EQ(pointInfluenceArea.getCulledSolidAngle(Aabb{ {-1,-1,-1}, {1,1,1} }), pointInfluenceArea.getFrustumSolidAngle());
+	}
+
+	TEST(DensityMap, UniformMatchesArea) {
+		using namespace pah;
+
+		//one sample per cell: the density is 1 / cellArea = 256 everywhere
+		DensityMap densityMap{ 32, 32, {-1,-1}, {1,1} };
+		for (int y = 0; y < 32; ++y) {
+			for (int x = 0; x < 32; ++x) densityMap.addSample({ -1 + (x + 0.5f) / 16, -1 + (y + 0.5f) / 16 });
+		}
+		densityMap.buildSummedAreaTable();
+		EXPECT_NEAR(densityMap.total(), 1024, TOLERANCE);
+		EXPECT_NEAR(densityMap.integrate({ -0.3f, -0.2f }, { 0.45f, 0.8f }), 0.75f * 1.0f * 256, 0.01f);
+
+		for (const auto& aabb : randomAabbs(1000, 42)) {
+			auto hull = obliquePlaneInfluenceArea.getCulledProjectedHull(aabb);
+			float expected = hull.computeArea() * 256;
+			EXPECT_NEAR(densityMap.integrate(hull), expected, TOLERANCE * glm::max(1.0f, expected));
+		}
+	}
+
+	TEST(MultiInfluenceArea, WeightedProjectedArea) {
+		using namespace pah;
+
+		PlaneInfluenceArea planeInfluenceArea{ Plane{ {0,0,-15}, {0,0,1}, 4, 4 }, 30, 100 };
+		PointInfluenceArea pointInfluenceArea{ Pov{ {20,5,3}, {-1,-0.2f,-0.1f}, 40, 40 }, 50, 0.1f, 100 };
+		MultiInfluenceArea multiInfluenceArea{ { { &planeInfluenceArea, 3 }, { &pointInfluenceArea, 1 } } };
+
+		EXPECT_NEAR(multiInfluenceArea.getProjectionPlaneArea(), 1, TOLERANCE);
+		EXPECT_EQ(multiInfluenceArea.getProjectionPlaneHull(), planeInfluenceArea.getProjectionPlaneHull()) << "Hull queries should be forwarded to the area with the biggest weight.";
+		EXPECT_TRUE(multiInfluenceArea.getBvhRegion().enclosingAabb().fullyContains(pointInfluenceArea.getBvhRegion().enclosingAabb()));
+
+		std::vector<Aabb> aabbs{ Aabb{ {-1,-1,-1}, {1,1,1} }, Aabb{ {3,-2,0}, {5,0,4} }, Aabb{ {-10,-10,-10}, {10,10,10} } };
+		std::vector<float> areas(aabbs.size());
+		multiInfluenceArea.getCulledProjectedAreas(aabbs, areas);
+		for (int i = 0; i < aabbs.size(); ++i) {
+			float expected = 0.75f * planeInfluenceArea.getCulledProjectedArea(aabbs[i]) / planeInfluenceArea.getProjectionPlaneArea() + 0.25f * pointInfluenceArea.getCulledProjectedArea(aabbs[i]) / pointInfluenceArea.getProjectionPlaneArea();
+			EXPECT_NEAR(multiInfluenceArea.getCulledProjectedArea(aabbs[i]), expected, TOLERANCE);
+			EXPECT_NEAR(areas[i], expected, TOLERANCE) << "Batch and single culled projected areas differ for Aabb " << i << ".";
+		}
+	}
+
+	TEST(OffDistributionFraction, Estimate) {
+		using namespace pah;
+
+		PlaneInfluenceArea planeInfluenceArea{ Plane{ {0,0,-15}, {0,0,1}, 10, 10 }, 30, 100 };
+		EXPECT_EQ(planeInfluenceArea.getOffDistributionFraction(), 0) << "By default all the rays follow the distribution.";
+
+		std::vector<Ray> rays{
+			Ray{ {0,0,-15}, {0,0,1} }, Ray{ {5,-3,-10}, {0,0,1} }, Ray{ {1,1,0}, {0,0,1} }, //affine
+			Ray{ {0,0,-15}, {1,0,0} }, //wrong direction
+			Ray{ {50,0,-15}, {0,0,1} } //outside the region
+		};
+		planeInfluenceArea.setOffDistributionFraction(rays);
+		EXPECT_NEAR(planeInfluenceArea.getOffDistributionFraction(), 0.4f, TOLERANCE);
+		EXPECT_THROW(planeInfluenceArea.setOffDistributionFraction(1.5f), std::invalid_argument);
+	}
+
+	TEST(RaySpaceBasis, PlaneAxes) {
+		using namespace pah;
+
+		PlaneInfluenceArea planeInfluenceArea{ Plane{ {0,-15,-15}, {0,1,1}, 10, 10 }, 40, 100 };
+		auto basis = planeInfluenceArea.getRaySpaceBasis();
+		ASSERT_TRUE(basis.has_value());
+		Matrix3 product = glm::transpose(*basis) * *basis;
+		for (int i = 0; i < 3; ++i) {
+			for (int j = 0; j < 3; ++j) EXPECT_NEAR(product[i][j], i == j ? 1 : 0, TOLERANCE) << "The ray space basis should be a rotation.";
+		}
+
+		//moving along a ray only changes the Z coordinate in ray space
+		Vector3 alongRay = *basis * glm::normalize(Vector3{ 0,1,1 });
+		EXPECT_NEAR(alongRay.x, 0, TOLERANCE);
+		EXPECT_NEAR(alongRay.y, 0, TOLERANCE);
+		EXPECT_NEAR(glm::abs(alongRay.z), 1, TOLERANCE);
+
+		PointInfluenceArea pointInfluenceArea{ Pov{ {20,5,3}, {-1,-0.2f,-0.1f}, 40, 40 }, 50, 0.1f, 100 };
+		EXPECT_FALSE(pointInfluenceArea.getRaySpaceBasis().has_value()) << "Perspective areas have no linear ray space.";
+	}
+
+	TEST(RaySpaceInfluenceArea, SameProjections) {
+		using namespace pah;
+
+		PlaneInfluenceArea planeInfluenceArea{ Plane{ {0,-15,-15}, {0,1,1}, 10, 10 }, 40, 100 };
+		Matrix3 basis = *planeInfluenceArea.getRaySpaceBasis();
+		auto raySpaceInfluenceArea = planeInfluenceArea.createRaySpaceInfluenceArea();
+		ASSERT_NE(raySpaceInfluenceArea, nullptr);
+		EXPECT_NEAR(raySpaceInfluenceArea->getProjectionPlaneArea(), planeInfluenceArea.getProjectionPlaneArea(), TOLERANCE);
+
+		std::mt19937 rng{ 1 };
+		std::uniform_real_distribution<float> position{ -10, 10 };
+		for (const auto& aabb : randomAabbs(100, 2, 10)) {
+			//rotating a ray doesn't change where it hits the projection plane
+			Ray ray{ Vector3{ position(rng), position(rng), position(rng) }, Vector3{ 0,1,1 } };
+			Vector2 projected = planeInfluenceArea.projectRay(ray), raySpaceProjected = raySpaceInfluenceArea->projectRay(Ray{ basis * ray.getOrigin(), basis * ray.getDirection() });
+			EXPECT_NEAR(projected.x, raySpaceProjected.x, TOLERANCE);
+			EXPECT_NEAR(projected.y, raySpaceProjected.y, TOLERANCE);
+
+			//the box enclosing a rotated Aabb in ray space projects at least to the same area
+			Aabb raySpaceAabb = Aabb::minAabb();
+			for (const auto& point : aabb.getPoints()) raySpaceAabb += Aabb{ basis * point, basis * point };
+			EXPECT_GE(raySpaceInfluenceArea->getCulledProjectedArea(raySpaceAabb) + TOLERANCE, planeInfluenceArea.getCulledProjectedArea(aabb));
+		}
+	}
 }
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <random>
+#include <vector>
+
+#include "../../ProjectedAreaHeuristic/src/Regions.h"
+
+
+namespace randomRegions {
+	/**
+	 * @brief Returns @p count random @p Aabb s, with the min corner in [-extent, extent]^3 and sides in [0.1, maxSize].
+	 */
+	inline std::vector<pah::Aabb> randomAabbs(int count, unsigned int seed, float extent = 8, float maxSize = 6) {
+		std::mt19937 rng{ seed };
+		std::uniform_real_distribution<float> position{ -extent, extent };
+		std::uniform_real_distribution<float> size{ 0.1f, maxSize };
+		std::vector<pah::Aabb> aabbs;
+		for (int i = 0; i < count; ++i) {
+			pah::Vector3 min{ position(rng), position(rng), position(rng) };
+			aabbs.emplace_back(min, min + pah::Vector3{ size(rng), size(rng), size(rng) });
+		}
+		return aabbs;
+	}
+}
@@ -0,0 +1,142 @@
+#include "pch.h"
+
+#include "../../ProjectedAreaHeuristic/src/Utilities.h"
+#include "../../ProjectedAreaHeuristic/src/Regions.h"
+#include "../../ProjectedAreaHeuristic/src/InfluenceArea.h"
+#include "../../ProjectedAreaHeuristic/src/Bvh.h"
+#include "../../ProjectedAreaHeuristic/src/TopLevel.h"
+#include "../../ProjectedAreaHeuristic/src/TopLevel.cpp"
+
+
+namespace topLevel {
+	using namespace pah;
+
+	static Bvh sahBvh(const InfluenceArea& influenceArea) {
+		Bvh::Properties properties{
+			.maxLeafCost = 0.0f,
+			.maxLeafArea = 0.0f,
+			.maxLeafHitProbability = 0.0f,
+			.maxTrianglesPerLeaf = 2,
+			.maxLevels = 100,
+			.bins = 16,
+			.maxNonFallbackLevels = 100,
+			.splitPlaneQualityThreshold = 0.4f,
+			.acceptableChildrenFatherHitProbabilityRatio = 1.3f,
+			.excellentChildrenFatherHitProbabilityRatio = 0.9f
+		};
+		return Bvh{ properties, influenceArea, bvhStrategies::computeCostSah, bvhStrategies::chooseSplittingPlanesLongest<0.f>, bvhStrategies::shouldStopThresholdOrLevel, "region" };
+	}
+
+	/**
+	 * @brief Returns a small triangle at each point of a grid covering the regions of the tests, so that each @p Bvh has something to build.
+	 */
+	static std::vector<Triangle> gridTriangles() {
+		std::vector<Triangle> triangles;
+		for (float x = -14; x <= 14; x += 2)
+			for (float y = -14; y <= 14; y += 2)
+				for (float z = -14; z <= 14; z += 2) triangles.emplace_back(Vector3{ x, y, z }, Vector3{ x + 0.3f, y, z }, Vector3{ x, y + 0.3f, z });
+		return triangles;
+	}
+
+	/**
+	 * @brief Returns the points of a grid covering @p bounds, without the ones closer than @p margin to a face of the region of a @p Bvh of @p topLevel (there, containment depends on the tolerance of each test).
+	 */
+	static std::vector<Vector3> gridPoints(const TopLevel& topLevel, const Aabb& bounds, int steps, float margin = 0.05f) {
+		std::vector<Vector3> points;
+		Vector3 step = (bounds.max - bounds.min) / static_cast<float>(steps);
+		for (int i = 0; i <= steps; ++i)
+			for (int j = 0; j <= steps; ++j)
+				for (int k = 0; k <= steps; ++k) {
+					Vector3 point = bounds.min + step * Vector3{ i, j, k };
+					bool nearFace = std::ranges::any_of(topLevel.getBvhs(), [&](const Bvh& bvh) {
+						return std::ranges::any_of(bvh.getInfluenceArea()->getBvhRegion().getFaces(), [&](const Plane& face) { return glm::abs(dot(point - face.getPoint(), face.getNormal())) < margin; });
+					});
+					if (!nearFace) points.push_back(point);
+				}
+		return points;
+	}
+
+	/**
+	 * @brief Returns the @p Bvh s of @p topLevel whose region contains @p point, sorted.
+	 */
+	static std::vector<const Bvh*> containingRegions(const TopLevel& topLevel, const Vector3& point) {
+		std::vector<const Bvh*> containing;
+		for (const auto& bvh : topLevel.getBvhs()) {
+			if (bvh.getInfluenceArea()->getBvhRegion().contains(point)) containing.push_back(&bvh);
+		}
+		return containing;
+	}
+
+	static std::vector<const Bvh*> sorted(std::vector<const Bvh*> bvhs) {
+		std::ranges::sort(bvhs);
+		return bvhs;
+	}
+
+	/**
+	 * @brief Returns the indices of the @p Bvh s returned by @p topLevel.containedIn, sorted, so that different @p TopLevel structures can be compared.
+	 */
+	static std::vector<int> containedInIndices(const TopLevel& topLevel, const Vector3& point) {
+		auto indices = topLevel.containedIn(point) | std::views::transform([&topLevel](const Bvh* bvh) { return static_cast<int>(bvh - topLevel.getBvhs().data()); }) | std::ranges::to<std::vector>();
+		std::ranges::sort(indices);
+		return indices;
+	}
+
+	/**
+	 * @brief Moves a plane region inside the scene, and then out of it, and checks that after each @p update, @p containedIn is the same as the one of a fresh build.
+	 * A large region bounds the scene, so that a fresh build has the same root as the updated structure.
+	 */
+	template<typename TopLevelType, typename Properties>
+	static void expectUpdateMatchesBuild(const Properties& properties) {
+		auto planeAt = [](float x) { return PlaneInfluenceArea{ Plane{ { x, 0, -10 }, { 0.2f, 0.1f, 1 }, 6, 6 }, 10, 100 }; };
+		PlaneInfluenceArea moving = planeAt(-6);
+		PlaneInfluenceArea scene{ Plane{ {0,0,-16}, {0,0,1}, 32, 32 }, 32, 100 };
+		PointInfluenceArea pointInfluenceArea{ Pov{ {5,-4,-10}, {0,0.2f,1}, 40, 40 }, 20, 1, 100 };
+		auto triangles = gridTriangles();
+		Bvh fallbackBvh{ sahBvh(scene) };
+		TopLevelType updated{ properties, fallbackBvh, sahBvh(moving), sahBvh(scene), sahBvh(pointInfluenceArea) };
+		updated.build(triangles);
+
+		for (float x : { -5.0f, -3.5f, 0.0f, -30.0f }) { //the last position is outside of the root
+			moving = planeAt(x);
+			updated.update();
+			TopLevelType fresh{ properties, fallbackBvh, sahBvh(moving), sahBvh(scene), sahBvh(pointInfluenceArea) };
+			fresh.build(triangles);
+			for (const auto& point : gridPoints(fresh, Aabb{ Vector3{ -40, -17, -17 }, Vector3{ 17 } }, 30)) {
+				EXPECT_EQ(containedInIndices(updated, point), containedInIndices(fresh, point)) << "After the plane moved to x = " << x << ", the updated structure should match a fresh build.";
+			}
+		}
+	}
+
+	// With enough levels, the leaves of the BSP tree match the regions exactly; with few levels, they are a subset or a superset of them, depending on the approach
+	TEST(TopLevelBsp, ContainedInMatchesRegions) {
+		PlaneInfluenceArea frontPlane{ Plane{ {-3,0,-10}, {0.2f,0.1f,1}, 6, 6 }, 20, 100 };
+		PlaneInfluenceArea sidePlane{ Plane{ {-10,2,0}, {1,0,0.3f}, 5, 5 }, 20, 100 };
+		PointInfluenceArea pointInfluenceArea{ Pov{ {5,-4,-10}, {0,0.2f,1}, 40, 40 }, 20, 1, 100 };
+		auto triangles = gridTriangles();
+		Bvh fallbackBvh{ sahBvh(frontPlane) };
+
+		for (bool conservativeApproach : { false, true }) {
+			for (int maxLevel : { 100, 2 }) {
+				TopLevelBsp topLevel{ TopLevelBsp::BspProperties{ .maxLevel = maxLevel, .conservativeApproach = conservativeApproach }, fallbackBvh, sahBvh(frontPlane), sahBvh(sidePlane), sahBvh(pointInfluenceArea) };
+				topLevel.build(triangles);
+
+				for (const auto& point : gridPoints(topLevel, Aabb{ Vector3{ -16 }, Vector3{ 16 } }, 40)) {
+					auto expected = containingRegions(topLevel, point), actual = sorted(topLevel.containedIn(point));
+					if (maxLevel == 100) EXPECT_EQ(actual, expected) << "The leaves should match the regions exactly.";
+					else if (conservativeApproach) EXPECT_TRUE(std::ranges::includes(expected, actual)) << "A conservative leaf should only contain the regions that fully contain it.";
+					else EXPECT_TRUE(std::ranges::includes(actual, expected)) << "A leaf should contain all the regions colliding with it.";
+				}
+			}
+		}
+	}
+
+	// Updating the octree after a region moved matches a fresh build, also when the region leaves the root
+	TEST(TopLevelOctree, UpdateMatchesBuild) {
+		for (bool conservativeApproach : { false, true }) expectUpdateMatchesBuild<TopLevelOctree>(TopLevelOctree::OctreeProperties{ .maxLevel = 5, .conservativeApproach = conservativeApproach });
+	}
+
+	// Updating the BSP tree after a region moved matches a fresh build, also when the region leaves the root
+	TEST(TopLevelBsp, UpdateMatchesBuild) {
+		for (bool conservativeApproach : { false, true }) expectUpdateMatchesBuild<TopLevelBsp>(TopLevelBsp::BspProperties{ .maxLevel = 100, .conservativeApproach = conservativeApproach });
+	}
+}